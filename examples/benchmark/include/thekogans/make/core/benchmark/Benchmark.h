@@ -0,0 +1,235 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#if !defined (__thekogans_make_core_benchmark_Benchmark_h)
+#define __thekogans_make_core_benchmark_Benchmark_h
+
+#include <string>
+#include <iosfwd>
+#include <vector>
+#include <map>
+#include <utility>
+#include "thekogans/util/Types.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+            namespace benchmark {
+
+                /// \struct Options Benchmark.h thekogans/make/core/benchmark/Benchmark.h
+                ///
+                /// \brief
+                /// Command line: suite [command] [-name:value ...]. Options
+                /// without a value (-name) are set to "yes".
+                struct Options {
+                    /// \brief
+                    /// Positional arguments (suite, command...).
+                    std::vector<std::string> arguments;
+                    /// \brief
+                    /// -name:value options.
+                    std::map<std::string, std::string> options;
+
+                    /// \brief
+                    /// ctor.
+                    /// \param[in] argc Argument count (including the program).
+                    /// \param[in] argv Arguments.
+                    Options (
+                        int argc,
+                        const char *argv[]);
+
+                    /// \brief
+                    /// Return the positional argument at index (or "").
+                    std::string GetArgument (std::size_t index) const;
+                    /// \brief
+                    /// Return the value of -name (or defaultValue).
+                    std::string Get (
+                        const std::string &name,
+                        const std::string &defaultValue = std::string ()) const;
+                    util::ui64 GetUI64 (
+                        const std::string &name,
+                        util::ui64 defaultValue) const;
+                    double GetDouble (
+                        const std::string &name,
+                        double defaultValue) const;
+                };
+
+                /// \struct Results Benchmark.h thekogans/make/core/benchmark/Benchmark.h
+                ///
+                /// \brief
+                /// Metrics collected by a suite run, in the order they were
+                /// added. Write produces either a table (for people) or a JSON
+                /// document (for regression scripts):
+                /// {"suite": "...", "parameters": {...}, "results": [{"name": "...", "metric": value, ...}, ...]}
+                struct Results {
+                    /// \brief
+                    /// Suite name.
+                    std::string suite;
+                    /// \brief
+                    /// Parameters the suite was run with (tree shape, corpus...).
+                    std::vector<std::pair<std::string, std::string>> parameters;
+                    /// \struct Results::Result Benchmark.h thekogans/make/core/benchmark/Benchmark.h
+                    ///
+                    /// \brief
+                    /// Metrics of one benchmark.
+                    struct Result {
+                        std::string name;
+                        std::vector<std::pair<std::string, double>> metrics;
+                    };
+                    /// \brief
+                    /// One entry per benchmark.
+                    std::vector<Result> results;
+
+                    /// \brief
+                    /// ctor.
+                    /// \param[in] suite_ Suite name.
+                    explicit Results (const std::string &suite_) :
+                        suite (suite_) {}
+
+                    void AddParameter (
+                        const std::string &name,
+                        const std::string &value);
+                    /// \brief
+                    /// Add (or replace) a metric of the named benchmark.
+                    void Add (
+                        const std::string &name,
+                        const std::string &metric,
+                        double value);
+
+                    /// \brief
+                    /// Write the results to path ("" or "-" = stdout). Paths
+                    /// ending in .json get JSON, anything else gets a table.
+                    void Write (const std::string &path) const;
+                };
+
+                /// \brief
+                /// Create (or replace) path with contents, creating missing
+                /// directories along the way.
+                void WriteFile (
+                    const std::string &path,
+                    const std::string &contents);
+
+                /// \brief
+                /// Return a monotonic time stamp in nanoseconds.
+                util::ui64 GetNow ();
+
+                /// \brief
+                /// Return the number of operator new calls made so far (by
+                /// all threads). The benchmark program replaces the global
+                /// operator new to count them.
+                util::ui64 GetAllocations ();
+
+                /// \struct Measurement Benchmark.h thekogans/make/core/benchmark/Benchmark.h
+                ///
+                /// \brief
+                /// Per operation cost of a benchmarked operation.
+                struct Measurement {
+                    util::ui64 operations;
+                    util::ui64 nanoseconds;
+                    util::ui64 allocations;
+
+                    Measurement () :
+                        operations (0),
+                        nanoseconds (0),
+                        allocations (0) {}
+
+                    inline double GetNanosecondsPerOperation () const {
+                        return operations != 0 ? (double)nanoseconds / operations : 0.0;
+                    }
+                    inline double GetAllocationsPerOperation () const {
+                        return operations != 0 ? (double)allocations / operations : 0.0;
+                    }
+                    inline double GetOperationsPerSecond () const {
+                        return nanoseconds != 0 ? operations * 1e9 / nanoseconds : 0.0;
+                    }
+
+                    /// \brief
+                    /// Add ns/op and allocs/op under name.
+                    void Report (
+                        Results &results,
+                        const std::string &name) const;
+                };
+
+                /// \brief
+                /// Call operation () iterations times.
+                /// \param[in] operation Operation to measure.
+                /// \param[in] iterations Number of times to call it.
+                /// \return Measurement.
+                template<typename Operation>
+                Measurement Measure (
+                        Operation operation,
+                        util::ui64 iterations) {
+                    Measurement measurement;
+                    util::ui64 allocations = GetAllocations ();
+                    util::ui64 start = GetNow ();
+                    for (util::ui64 i = 0; i < iterations; ++i) {
+                        operation ();
+                    }
+                    measurement.nanoseconds = GetNow () - start;
+                    measurement.allocations = GetAllocations () - allocations;
+                    measurement.operations = iterations;
+                    return measurement;
+                }
+
+                /// \brief
+                /// Call operation () in batches of doubling size until at
+                /// least minNanoseconds have been spent. Use for operations too
+                /// fast to time individually.
+                /// \param[in] operation Operation to measure.
+                /// \param[in] minNanoseconds Minimum measurement duration.
+                /// \return Measurement.
+                template<typename Operation>
+                Measurement MeasureFor (
+                        Operation operation,
+                        util::ui64 minNanoseconds) {
+                    // Warm up (caches, lazy singletons).
+                    operation ();
+                    Measurement measurement;
+                    for (util::ui64 batch = 1; measurement.nanoseconds < minNanoseconds; batch *= 2) {
+                        Measurement batchMeasurement = Measure (operation, batch);
+                        measurement.operations += batchMeasurement.operations;
+                        measurement.nanoseconds += batchMeasurement.nanoseconds;
+                        measurement.allocations += batchMeasurement.allocations;
+                    }
+                    return measurement;
+                }
+
+                /// \struct NullOutput Benchmark.h thekogans/make/core/benchmark/Benchmark.h
+                ///
+                /// \brief
+                /// Discards std::cout while in scope (for library calls that
+                /// report progress on stdout).
+                struct NullOutput {
+                    NullOutput ();
+                    ~NullOutput ();
+
+                private:
+                    std::streambuf *original;
+                };
+
+                /// \brief
+                /// Suites. Each returns the process exit code.
+                int RunExpressionSuite (const Options &options);
+                int RunGraphSuite (const Options &options);
+                int RunInstallSuite (const Options &options);
+                int RunSourcesSuite (const Options &options);
+
+            } // namespace benchmark
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
+
+#endif // !defined (__thekogans_make_core_benchmark_Benchmark_h)
@@ -0,0 +1,338 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <iostream>
+#include <fstream>
+#include <streambuf>
+#include "thekogans/util/Path.h"
+#include "thekogans/util/Directory.h"
+#include "thekogans/util/StringUtils.h"
+#include "thekogans/util/Exception.h"
+#include "thekogans/make/core/Counters.h"
+#include "thekogans/make/core/benchmark/Benchmark.h"
+
+namespace {
+    // Zero initialized static storage, so it's usable by
+    // allocations made during dynamic initialization.
+    std::atomic<thekogans::util::ui64> allocations;
+}
+
+// Count every allocation made by the program (including the library).
+// Only the counting is added; malloc does the work. The library's
+// ALLOCATIONS counter is bumped too, so the Profiler can report it.
+
+void *operator new (std::size_t size) {
+    ++allocations;
+    thekogans::make::core::Counters::Increment (
+        thekogans::make::core::Counters::ALLOCATIONS);
+    void *ptr = std::malloc (size != 0 ? size : 1);
+    if (ptr == 0) {
+        throw std::bad_alloc ();
+    }
+    return ptr;
+}
+
+void *operator new[] (std::size_t size) {
+    return operator new (size);
+}
+
+void *operator new (
+        std::size_t size,
+        const std::nothrow_t &) noexcept {
+    ++allocations;
+    thekogans::make::core::Counters::Increment (
+        thekogans::make::core::Counters::ALLOCATIONS);
+    return std::malloc (size != 0 ? size : 1);
+}
+
+void *operator new[] (
+        std::size_t size,
+        const std::nothrow_t &) noexcept {
+    return operator new (size, std::nothrow);
+}
+
+void operator delete (void *ptr) noexcept {
+    std::free (ptr);
+}
+
+void operator delete[] (void *ptr) noexcept {
+    std::free (ptr);
+}
+
+void operator delete (
+        void *ptr,
+        const std::nothrow_t &) noexcept {
+    std::free (ptr);
+}
+
+void operator delete[] (
+        void *ptr,
+        const std::nothrow_t &) noexcept {
+    std::free (ptr);
+}
+
+void operator delete (
+        void *ptr,
+        std::size_t) noexcept {
+    std::free (ptr);
+}
+
+void operator delete[] (
+        void *ptr,
+        std::size_t) noexcept {
+    std::free (ptr);
+}
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+            namespace benchmark {
+
+                Options::Options (
+                        int argc,
+                        const char *argv[]) {
+                    for (int i = 1; i < argc; ++i) {
+                        std::string argument = argv[i];
+                        if (argument.size () > 1 && argument[0] == '-') {
+                            std::string::size_type separator = argument.find (':');
+                            if (separator != std::string::npos) {
+                                options[argument.substr (1, separator - 1)] =
+                                    argument.substr (separator + 1);
+                            }
+                            else {
+                                options[argument.substr (1)] = "yes";
+                            }
+                        }
+                        else {
+                            arguments.push_back (argument);
+                        }
+                    }
+                }
+
+                std::string Options::GetArgument (std::size_t index) const {
+                    return index < arguments.size () ? arguments[index] : std::string ();
+                }
+
+                std::string Options::Get (
+                        const std::string &name,
+                        const std::string &defaultValue) const {
+                    std::map<std::string, std::string>::const_iterator it = options.find (name);
+                    return it != options.end () ? it->second : defaultValue;
+                }
+
+                util::ui64 Options::GetUI64 (
+                        const std::string &name,
+                        util::ui64 defaultValue) const {
+                    std::string value = Get (name);
+                    if (value.empty ()) {
+                        return defaultValue;
+                    }
+                    char *end = 0;
+                    util::ui64 result = std::strtoull (value.c_str (), &end, 10);
+                    if (*end != '\0') {
+                        THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                            "Invalid -%s: '%s' (expected an integer).",
+                            name.c_str (),
+                            value.c_str ());
+                    }
+                    return result;
+                }
+
+                double Options::GetDouble (
+                        const std::string &name,
+                        double defaultValue) const {
+                    std::string value = Get (name);
+                    if (value.empty ()) {
+                        return defaultValue;
+                    }
+                    char *end = 0;
+                    double result = std::strtod (value.c_str (), &end);
+                    if (*end != '\0') {
+                        THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                            "Invalid -%s: '%s' (expected a number).",
+                            name.c_str (),
+                            value.c_str ());
+                    }
+                    return result;
+                }
+
+                void Results::AddParameter (
+                        const std::string &name,
+                        const std::string &value) {
+                    parameters.push_back (
+                        std::pair<std::string, std::string> (name, value));
+                }
+
+                void Results::Add (
+                        const std::string &name,
+                        const std::string &metric,
+                        double value) {
+                    Result *result = 0;
+                    for (std::size_t i = 0, count = results.size (); i < count; ++i) {
+                        if (results[i].name == name) {
+                            result = &results[i];
+                            break;
+                        }
+                    }
+                    if (result == 0) {
+                        results.push_back (Result ());
+                        result = &results.back ();
+                        result->name = name;
+                    }
+                    for (std::size_t i = 0, count = result->metrics.size (); i < count; ++i) {
+                        if (result->metrics[i].first == metric) {
+                            result->metrics[i].second = value;
+                            return;
+                        }
+                    }
+                    result->metrics.push_back (std::pair<std::string, double> (metric, value));
+                }
+
+                namespace {
+                    std::string EscapeJSON (const std::string &value) {
+                        std::string escaped;
+                        for (std::size_t i = 0, count = value.size (); i < count; ++i) {
+                            char ch = value[i];
+                            if (ch == '"' || ch == '\\') {
+                                escaped += '\\';
+                                escaped += ch;
+                            }
+                            else if ((unsigned char)ch < 0x20) {
+                                escaped += util::FormatString ("\\u%04x", (unsigned char)ch);
+                            }
+                            else {
+                                escaped += ch;
+                            }
+                        }
+                        return escaped;
+                    }
+
+                    std::string FormatNumber (double value) {
+                        return util::FormatString ("%.6g", value);
+                    }
+
+                    bool IsJSON (const std::string &path) {
+                        const std::string JSON_EXT = ".json";
+                        return path.size () > JSON_EXT.size () &&
+                            path.compare (path.size () - JSON_EXT.size (), JSON_EXT.size (), JSON_EXT) == 0;
+                    }
+                }
+
+                void Results::Write (const std::string &path) const {
+                    std::ofstream file;
+                    if (!path.empty () && path != "-") {
+                        file.open (path.c_str (), std::ios::out | std::ios::trunc);
+                        if (!file.is_open ()) {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                "Unable to open: %s.",
+                                path.c_str ());
+                        }
+                    }
+                    std::ostream &stream = file.is_open () ? file : std::cout;
+                    if (IsJSON (path)) {
+                        stream << "{\n  \"suite\": \"" << EscapeJSON (suite) << "\",\n  \"parameters\": {";
+                        for (std::size_t i = 0, count = parameters.size (); i < count; ++i) {
+                            stream << (i > 0 ? ",\n    " : "\n    ") <<
+                                "\"" << EscapeJSON (parameters[i].first) << "\": \"" <<
+                                EscapeJSON (parameters[i].second) << "\"";
+                        }
+                        stream << "\n  },\n  \"results\": [";
+                        for (std::size_t i = 0, count = results.size (); i < count; ++i) {
+                            stream << (i > 0 ? ",\n    " : "\n    ") <<
+                                "{\"name\": \"" << EscapeJSON (results[i].name) << "\"";
+                            for (std::size_t j = 0, count = results[i].metrics.size (); j < count; ++j) {
+                                stream << ", \"" << EscapeJSON (results[i].metrics[j].first) <<
+                                    "\": " << FormatNumber (results[i].metrics[j].second);
+                            }
+                            stream << "}";
+                        }
+                        stream << "\n  ]\n}\n";
+                    }
+                    else {
+                        stream << suite << "\n";
+                        for (std::size_t i = 0, count = parameters.size (); i < count; ++i) {
+                            stream << "  " << parameters[i].first << " = " << parameters[i].second << "\n";
+                        }
+                        for (std::size_t i = 0, count = results.size (); i < count; ++i) {
+                            stream << util::FormatString ("%-48s", results[i].name.c_str ());
+                            for (std::size_t j = 0, count = results[i].metrics.size (); j < count; ++j) {
+                                stream << " " << results[i].metrics[j].first << "=" <<
+                                    FormatNumber (results[i].metrics[j].second);
+                            }
+                            stream << "\n";
+                        }
+                    }
+                    stream.flush ();
+                }
+
+                void WriteFile (
+                        const std::string &path,
+                        const std::string &contents) {
+                    util::Directory::Create (util::Path (path).GetDirectory ());
+                    std::ofstream file (path.c_str (), std::ios::out | std::ios::trunc | std::ios::binary);
+                    if (!file.is_open ()) {
+                        THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                            "Unable to open: %s.",
+                            path.c_str ());
+                    }
+                    file << contents;
+                }
+
+                util::ui64 GetNow () {
+                    return (util::ui64)std::chrono::duration_cast<std::chrono::nanoseconds> (
+                        std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+                }
+
+                util::ui64 GetAllocations () {
+                    return allocations.load (std::memory_order_relaxed);
+                }
+
+                void Measurement::Report (
+                        Results &results,
+                        const std::string &name) const {
+                    results.Add (name, "ns_per_op", GetNanosecondsPerOperation ());
+                    results.Add (name, "allocs_per_op", GetAllocationsPerOperation ());
+                    results.Add (name, "ops", (double)operations);
+                }
+
+                namespace {
+                    struct NullBuffer : public std::streambuf {
+                        virtual int_type overflow (int_type ch) {
+                            return traits_type::not_eof (ch);
+                        }
+                    };
+                }
+
+                NullOutput::NullOutput () {
+                    static NullBuffer nullBuffer;
+                    std::cout.flush ();
+                    original = std::cout.rdbuf (&nullBuffer);
+                }
+
+                NullOutput::~NullOutput () {
+                    std::cout.rdbuf (original);
+                }
+
+            } // namespace benchmark
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
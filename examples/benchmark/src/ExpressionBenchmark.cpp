@@ -0,0 +1,254 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#include <string>
+#include <vector>
+#include "thekogans/util/Buffer.h"
+#include "thekogans/util/StringUtils.h"
+#include "thekogans/util/Exception.h"
+#include "thekogans/make/core/Utils.h"
+#include "thekogans/make/core/Counters.h"
+#include "thekogans/make/core/Value.h"
+#include "thekogans/make/core/Parser.h"
+#include "thekogans/make/core/Function.h"
+#include "thekogans/make/core/thekogans_make.h"
+#include "thekogans/make/core/benchmark/Benchmark.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+            namespace benchmark {
+
+                namespace {
+                    // Number of feature_N constants (and terms in the
+                    // long_chain condition and long_list template).
+                    const util::ui32 LIST_LENGTH = 64;
+
+                    struct Expression {
+                        std::string name;
+                        std::string text;
+
+                        Expression (
+                            const std::string &name_,
+                            const std::string &text_) :
+                            name (name_),
+                            text (text_) {}
+                    };
+
+                    // The kinds of conditions found in thekogans_make.xml
+                    // files: platform tests, config/type switches, deep
+                    // nesting, function calls and long chains.
+                    void GetConditions (std::vector<Expression> &conditions) {
+                        conditions.push_back (Expression ("simple",
+                            "$(TOOLCHAIN_OS) == 'Windows'"));
+                        conditions.push_back (Expression ("config_type",
+                            "$(config) == 'Debug' && $(type) == 'Static'"));
+                        conditions.push_back (Expression ("platform",
+                            "$(TOOLCHAIN_OS) == 'Linux' && "
+                            "($(TOOLCHAIN_ARCH) == 'x86_64' || $(TOOLCHAIN_ARCH) == 'arm64')"));
+                        conditions.push_back (Expression ("nested",
+                            "($(config) == 'Debug' && ($(type) == 'Static' || ($(type) == 'Shared' && "
+                            "($(TOOLCHAIN_OS) == 'Linux' || ($(TOOLCHAIN_OS) == 'OSX' && "
+                            "$(TOOLCHAIN_ARCH) != 'i386'))))) || !($(generator) == 'make')"));
+                        conditions.push_back (Expression ("function",
+                            "$(have_feature -f:BENCH_HAVE_CURL) || $(version) >= '1.2.0'"));
+                        conditions.push_back (Expression ("quoted",
+                            "'$(organization)_$(project)-$(version)' != 'bench_expression-0.0.0'"));
+                        std::string chain;
+                        for (util::ui32 i = 0; i < LIST_LENGTH; ++i) {
+                            if (i > 0) {
+                                chain += " || ";
+                            }
+                            chain += "$(feature_" + util::ui32Tostring (i) + ") == 'no'";
+                        }
+                        conditions.push_back (Expression ("long_chain", chain));
+                    }
+
+                    // The kinds of strings Expand sees: paths, flags,
+                    // nested and indexed references and long lists.
+                    void GetTemplates (std::vector<Expression> &templates) {
+                        templates.push_back (Expression ("literal",
+                            "src/thekogans/make/core/thekogans_make.cpp"));
+                        templates.push_back (Expression ("header",
+                            "$(organization)/$(project_directory)/Config.h"));
+                        templates.push_back (Expression ("path",
+                            "$(project_root)/$(build_directory)/$(organization)_$(project)-$(version)$(link_library_suffix)"));
+                        templates.push_back (Expression ("flags",
+                            "-DBENCH_VERSION=$(major_version).$(minor_version).$(patch_version) "
+                            "-DBENCH_CONFIG_$(config) -DBENCH_TYPE_$(type) '-DBENCH_ROOT=$(project_root)'"));
+                        templates.push_back (Expression ("nested",
+                            "$(bench_prefix)/$($(bench_selector))/$(bench_triplet[0])"));
+                        templates.push_back (Expression ("function",
+                            "$(bench_list -separator:' ' -prefix:$(project_root)/include)"));
+                        std::string list;
+                        for (util::ui32 i = 0; i < LIST_LENGTH; ++i) {
+                            if (i > 0) {
+                                list += " ";
+                            }
+                            list += "-I$(bench_prefix)/include/feature_" + util::ui32Tostring (i);
+                        }
+                        templates.push_back (Expression ("long_list", list));
+                    }
+
+                    // $(...) calls as Function::ParseAndExec sees them
+                    // (positioned after the '$').
+                    void GetCalls (std::vector<Expression> &calls) {
+                        calls.push_back (Expression ("symbol", "(config)"));
+                        calls.push_back (Expression ("indexed", "(bench_triplet[0])"));
+                        calls.push_back (Expression ("nested", "($(bench_selector))"));
+                        calls.push_back (Expression ("parameters",
+                            "(have_feature -f:BENCH_HAVE_CURL -default:'no' -quiet)"));
+                        calls.push_back (Expression ("nested_parameters",
+                            "(bench_list -separator:' ' -prefix:$(project_root)/include -suffix:$(link_library_suffix))"));
+                    }
+
+                    // The symbols the corpus references, as constants of
+                    // a stand alone library project.
+                    std::string GetProjectConfig () {
+                        std::string xml =
+                            "<thekogans_make organization = \"bench\"\n"
+                            "                project = \"expression\"\n"
+                            "                project_type = \"library\"\n"
+                            "                major_version = \"1\"\n"
+                            "                minor_version = \"2\"\n"
+                            "                patch_version = \"3\"\n"
+                            "                guid = \"6f1d7e2a9c4b4e0d8a3f5b1c2d4e6f70\"\n"
+                            "                schema_version = \"2\">\n"
+                            "  <constants>\n"
+                            "    <constant name = \"bench_prefix\" value = \"$(project_root)/$(build_directory)\"/>\n"
+                            "    <constant name = \"bench_selector\" value = \"bench_leaf\"/>\n"
+                            "    <constant name = \"bench_leaf\" value = \"$(organization)_$(project)\"/>\n"
+                            "    <constant name = \"bench_triplet\" value = \"x86_64-linux-gnu\"/>\n";
+                        for (util::ui32 i = 0; i < LIST_LENGTH; ++i) {
+                            xml += "    <constant name = \"feature_" + util::ui32Tostring (i) +
+                                "\" value = \"yes\"/>\n";
+                        }
+                        xml +=
+                            "  </constants>\n"
+                            "</thekogans_make>\n";
+                        return xml;
+                    }
+
+                    std::string GetList () {
+                        std::string list;
+                        for (util::ui32 i = 0; i < LIST_LENGTH * 4; ++i) {
+                            if (i > 0) {
+                                list += " ";
+                            }
+                            list += "/usr/local/include/bench/feature_" + util::ui32Tostring (i);
+                        }
+                        return list;
+                    }
+                }
+
+                int RunExpressionSuite (const Options &options) {
+                    std::string root = options.Get ("root", "make_core_benchmark_expression");
+                    util::ui64 minNanoseconds = options.GetUI64 ("milliseconds", 100) * 1000000;
+                    WriteFile (ToSystemPath (MakePath (root, THEKOGANS_MAKE_XML)), GetProjectConfig ());
+                    const thekogans_make &config = thekogans_make::GetConfig (
+                        root,
+                        THEKOGANS_MAKE_XML,
+                        MAKE,
+                        CONFIG_DEBUG,
+                        TYPE_STATIC);
+                    thekogans_make::Pin pin (config);
+                    Results results ("expression");
+                    results.AddParameter ("root", root);
+                    results.AddParameter ("milliseconds", util::ui64Tostring (minNanoseconds / 1000000));
+                    results.AddParameter ("list_length", util::ui32Tostring (LIST_LENGTH));
+                    std::vector<Expression> conditions;
+                    GetConditions (conditions);
+                    for (std::size_t i = 0, count = conditions.size (); i < count; ++i) {
+                        const char *text = conditions[i].text.c_str ();
+                        std::string name = "Tokenizer/" + conditions[i].name;
+                        util::ui64 tokens = Counters::Get (Counters::TOKENS);
+                        Measurement measurement = MeasureFor (
+                            [&] () {
+                                Tokenizer tokenizer (text, config);
+                                while (tokenizer.GetToken ().type != Tokenizer::Token::END) {
+                                }
+                            },
+                            minNanoseconds);
+                        measurement.Report (results, name);
+                        // MeasureFor makes one extra (warm up) call.
+                        results.Add (name, "tokens_per_op",
+                            (double)(Counters::Get (Counters::TOKENS) - tokens) /
+                            (measurement.operations + 1));
+                    }
+                    for (std::size_t i = 0, count = conditions.size (); i < count; ++i) {
+                        const char *text = conditions[i].text.c_str ();
+                        MeasureFor (
+                            [&] () {
+                                Tokenizer tokenizer (text, config);
+                                Parser parser (tokenizer);
+                                parser.Parse ();
+                            },
+                            minNanoseconds).Report (results, "Parser::Parse/" + conditions[i].name);
+                    }
+                    for (std::size_t i = 0, count = conditions.size (); i < count; ++i) {
+                        const char *text = conditions[i].text.c_str ();
+                        MeasureFor (
+                            [&] () {
+                                config.Eval (text);
+                            },
+                            minNanoseconds).Report (results, "Eval/" + conditions[i].name);
+                    }
+                    std::vector<Expression> templates;
+                    GetTemplates (templates);
+                    for (std::size_t i = 0, count = templates.size (); i < count; ++i) {
+                        const char *text = templates[i].text.c_str ();
+                        MeasureFor (
+                            [&] () {
+                                config.Expand (text);
+                            },
+                            minNanoseconds).Report (results, "Expand/" + templates[i].name);
+                    }
+                    std::vector<Expression> calls;
+                    GetCalls (calls);
+                    for (std::size_t i = 0, count = calls.size (); i < count; ++i) {
+                        const char *text = calls[i].text.c_str ();
+                        std::size_t length = calls[i].text.size ();
+                        MeasureFor (
+                            [&] () {
+                                util::TenantReadBuffer buffer (util::HostEndian, text, length);
+                                Function::ParseAndExec (config, buffer);
+                            },
+                            minNanoseconds).Report (results, "Function::ParseAndExec/" + calls[i].name);
+                    }
+                    {
+                        std::string list = GetList ();
+                        Value value = Value::Parse (Value::TYPE_string, list);
+                        MeasureFor (
+                            [&] () {
+                                Value::Parse (Value::TYPE_string, list);
+                            },
+                            minNanoseconds).Report (results, "Value::Parse/long_list");
+                        MeasureFor (
+                            [&] () {
+                                value.ToString ();
+                            },
+                            minNanoseconds).Report (results, "Value::ToString/long_list");
+                        results.Add ("Value::Parse/long_list", "items", (double)value.value.size ());
+                    }
+                    results.Write (options.Get ("o"));
+                    return 0;
+                }
+
+            } // namespace benchmark
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
@@ -0,0 +1,455 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <set>
+#include <list>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include "thekogans/util/Path.h"
+#include "thekogans/util/StringUtils.h"
+#include "thekogans/util/Exception.h"
+#include "thekogans/make/core/Utils.h"
+#include "thekogans/make/core/Counters.h"
+#include "thekogans/make/core/Project.h"
+#include "thekogans/make/core/Toolchain.h"
+#include "thekogans/make/core/thekogans_make.h"
+#include "thekogans/make/core/benchmark/Benchmark.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+            namespace benchmark {
+
+                namespace {
+                    const char * const ORGANIZATION = "bench";
+                    const char * const VERSION = "1.0.0";
+                    // Written to $DEVELOPMENT_ROOT by generate. Holds the
+                    // tree shape (name = value lines), and tells run it's
+                    // pointed at a synthetic tree.
+                    const char * const GRAPH_MARKER = ".make_core_benchmark_graph";
+
+                    // Conditions that hold for the configuration run
+                    // measures (make, Debug, Static), so conditional
+                    // content is evaluated and kept.
+                    const char * const CONDITIONS[] = {
+                        "$(TOOLCHAIN_OS) != 'Bogus'",
+                        "$(config) == 'Debug' || $(config) == 'Release'",
+                        "$(type) != 'Bogus' &amp;&amp; $(generator) == 'make'",
+                        "($(config) == 'Debug' &amp;&amp; ($(type) == 'Static' || $(type) == 'Shared')) || $(TOOLCHAIN_OS) == 'Bogus'"
+                    };
+                    const std::size_t CONDITION_COUNT = sizeof (CONDITIONS) / sizeof (CONDITIONS[0]);
+
+                    struct GraphShape {
+                        util::ui32 projects;
+                        util::ui32 depth;
+                        util::ui32 fanout;
+                        double diamonds;
+                        double conditionals;
+                        util::ui32 files;
+                        double toolchain;
+                        util::ui32 seed;
+
+                        explicit GraphShape (const Options &options) :
+                                projects ((util::ui32)options.GetUI64 ("projects", 200)),
+                                depth ((util::ui32)options.GetUI64 ("depth", 6)),
+                                fanout ((util::ui32)options.GetUI64 ("fanout", 4)),
+                                diamonds (options.GetDouble ("diamonds", 0.3)),
+                                conditionals (options.GetDouble ("conditionals", 0.2)),
+                                files ((util::ui32)options.GetUI64 ("files", 50)),
+                                toolchain (options.GetDouble ("toolchain", 0.1)),
+                                seed ((util::ui32)options.GetUI64 ("seed", 1)) {
+                            if (depth < 2 || projects < depth || fanout == 0) {
+                                THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                    "Invalid graph shape: need depth >= 2, "
+                                    "projects >= depth and fanout >= 1 "
+                                    "(got %u, %u, %u).",
+                                    depth,
+                                    projects,
+                                    fanout);
+                            }
+                        }
+
+                        void GetParameters (std::list<std::pair<std::string, std::string>> &parameters) const {
+                            parameters.push_back (std::make_pair ("projects", util::ui32Tostring (projects)));
+                            parameters.push_back (std::make_pair ("depth", util::ui32Tostring (depth)));
+                            parameters.push_back (std::make_pair ("fanout", util::ui32Tostring (fanout)));
+                            parameters.push_back (std::make_pair ("diamonds", util::FormatString ("%g", diamonds)));
+                            parameters.push_back (std::make_pair ("conditionals", util::FormatString ("%g", conditionals)));
+                            parameters.push_back (std::make_pair ("files", util::ui32Tostring (files)));
+                            parameters.push_back (std::make_pair ("toolchain", util::FormatString ("%g", toolchain)));
+                            parameters.push_back (std::make_pair ("seed", util::ui32Tostring (seed)));
+                        }
+                    };
+
+                    std::string GetProjectName (util::ui32 index) {
+                        return "p" + util::ui32Tostring (index);
+                    }
+
+                    std::string GetToolchainName (util::ui32 index) {
+                        return "t" + util::ui32Tostring (index);
+                    }
+
+                    std::string MakeGUID (std::mt19937 &random) {
+                        std::string guid;
+                        for (std::size_t i = 0; i < 4; ++i) {
+                            guid += util::FormatString ("%08x", (util::ui32)random ());
+                        }
+                        return guid;
+                    }
+
+                    // Emit element (already indented) either as is, or
+                    // wrapped in an <if> with one of the CONDITIONS.
+                    void AddElement (
+                            std::string &xml,
+                            const std::string &indentation,
+                            const std::string &element,
+                            const GraphShape &shape,
+                            std::mt19937 &random) {
+                        std::uniform_real_distribution<double> probability (0.0, 1.0);
+                        if (probability (random) < shape.conditionals) {
+                            xml += indentation + "<if condition = \"" +
+                                CONDITIONS[random () % CONDITION_COUNT] + "\">\n";
+                            xml += "  " + indentation + element + "\n";
+                            xml += indentation + "</if>\n";
+                        }
+                        else {
+                            xml += indentation + element + "\n";
+                        }
+                    }
+
+                    std::string GetRootElement (
+                            const std::string &project,
+                            std::mt19937 &random) {
+                        return
+                            "<thekogans_make organization = \"" + std::string (ORGANIZATION) + "\"\n"
+                            "                project = \"" + project + "\"\n"
+                            "                project_type = \"library\"\n"
+                            "                major_version = \"1\"\n"
+                            "                minor_version = \"0\"\n"
+                            "                patch_version = \"0\"\n"
+                            "                guid = \"" + MakeGUID (random) + "\"\n"
+                            "                schema_version = \"2\">\n";
+                    }
+
+                    std::string GetProjectConfig (
+                            util::ui32 index,
+                            const std::vector<util::ui32> &projectDependencies,
+                            const std::vector<util::ui32> &toolchainDependencies,
+                            const GraphShape &shape,
+                            std::mt19937 &random) {
+                        std::string project = GetProjectName (index);
+                        std::string upperProject = util::StringToUpper (project.c_str ());
+                        std::string xml = GetRootElement (project, random);
+                        xml += "  <features>\n";
+                        AddElement (xml, "    ",
+                            "<feature>BENCH_" + upperProject + "_FEATURE</feature>", shape, random);
+                        xml += "  </features>\n";
+                        if (!projectDependencies.empty () || !toolchainDependencies.empty ()) {
+                            xml += "  <dependencies>\n";
+                            for (std::size_t i = 0, count = projectDependencies.size (); i < count; ++i) {
+                                AddElement (xml, "    ",
+                                    "<project organization = \"" + std::string (ORGANIZATION) +
+                                    "\" name = \"" + GetProjectName (projectDependencies[i]) + "\"/>",
+                                    shape, random);
+                            }
+                            for (std::size_t i = 0, count = toolchainDependencies.size (); i < count; ++i) {
+                                AddElement (xml, "    ",
+                                    "<toolchain organization = \"" + std::string (ORGANIZATION) +
+                                    "\" name = \"" + GetToolchainName (toolchainDependencies[i]) + "\"/>",
+                                    shape, random);
+                            }
+                            xml += "  </dependencies>\n";
+                        }
+                        xml += "  <cpp_preprocessor_definitions>\n";
+                        AddElement (xml, "    ",
+                            "<cpp_preprocessor_definition>BENCH_" + upperProject +
+                            "_CONFIG_$(config)</cpp_preprocessor_definition>", shape, random);
+                        xml += "  </cpp_preprocessor_definitions>\n";
+                        xml += "  <cpp_headers prefix = \"include\"\n"
+                            "               install = \"yes\">\n";
+                        for (util::ui32 i = 0; i < shape.files; ++i) {
+                            AddElement (xml, "    ",
+                                "<cpp_header>$(organization)/$(project_directory)/File" +
+                                util::ui32Tostring (i) + ".h</cpp_header>", shape, random);
+                        }
+                        xml += "  </cpp_headers>\n";
+                        xml += "  <cpp_sources prefix = \"src\">\n";
+                        for (util::ui32 i = 0; i < shape.files; ++i) {
+                            AddElement (xml, "    ",
+                                "<cpp_source>File" + util::ui32Tostring (i) + ".cpp</cpp_source>",
+                                shape, random);
+                        }
+                        xml += "  </cpp_sources>\n";
+                        xml += "</thekogans_make>\n";
+                        return xml;
+                    }
+
+                    std::string GetToolchainConfig (
+                            util::ui32 index,
+                            std::mt19937 &random) {
+                        std::string project = GetToolchainName (index);
+                        std::string xml = GetRootElement (project, random);
+                        xml += "  <features>\n"
+                            "    <feature>BENCH_" + util::StringToUpper (project.c_str ()) + "_FEATURE</feature>\n"
+                            "  </features>\n";
+                        xml += "</thekogans_make>\n";
+                        return xml;
+                    }
+
+                    int Generate (const Options &options) {
+                        std::string root = options.Get ("root");
+                        if (root.empty ()) {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION ("%s",
+                                "graph generate needs -root:directory.");
+                        }
+                        GraphShape shape (options);
+                        std::mt19937 random (shape.seed);
+                        std::uniform_real_distribution<double> probability (0.0, 1.0);
+                        // Level 0 is the root project. The rest are spread
+                        // evenly over levels 1..depth-1.
+                        std::vector<std::vector<util::ui32>> levels (shape.depth);
+                        levels[0].push_back (0);
+                        for (util::ui32 i = 1; i < shape.projects; ++i) {
+                            levels[1 + (i - 1) * (shape.depth - 1) / (shape.projects - 1)].push_back (i);
+                        }
+                        std::vector<std::set<util::ui32>> dependencies (shape.projects);
+                        // The root (an application) depends on all of level 1.
+                        dependencies[0].insert (levels[1].begin (), levels[1].end ());
+                        for (util::ui32 level = 1; level + 1 < shape.depth; ++level) {
+                            const std::vector<util::ui32> &nextLevel = levels[level + 1];
+                            std::set<util::ui32> reached;
+                            std::size_t next = 0;
+                            for (std::size_t i = 0, count = levels[level].size (); i < count; ++i) {
+                                util::ui32 project = levels[level][i];
+                                for (util::ui32 j = 0; j < shape.fanout; ++j) {
+                                    util::ui32 dependency;
+                                    if (probability (random) < shape.diamonds) {
+                                        // A diamond: depend on something
+                                        // (probably) already depended on, at
+                                        // any deeper level.
+                                        util::ui32 deeperLevel =
+                                            level + 1 + random () % (shape.depth - level - 1);
+                                        dependency = levels[deeperLevel][random () % levels[deeperLevel].size ()];
+                                    }
+                                    else {
+                                        dependency = nextLevel[next++ % nextLevel.size ()];
+                                    }
+                                    dependencies[project].insert (dependency);
+                                    reached.insert (dependency);
+                                }
+                            }
+                            // Keep every project reachable from the root.
+                            for (std::size_t i = 0, count = nextLevel.size (); i < count; ++i) {
+                                if (reached.find (nextLevel[i]) == reached.end ()) {
+                                    dependencies[levels[level][random () % levels[level].size ()]].insert (nextLevel[i]);
+                                }
+                            }
+                        }
+                        util::ui32 toolchainCount = std::max (1u,
+                            (util::ui32)std::lround (shape.projects * shape.toolchain));
+                        std::vector<std::vector<util::ui32>> toolchainDependencies (shape.projects);
+                        {
+                            // Leaves always use one, others sometimes do.
+                            util::ui32 next = 0;
+                            const std::vector<util::ui32> &leaves = levels[shape.depth - 1];
+                            for (std::size_t i = 0, count = leaves.size (); i < count; ++i) {
+                                toolchainDependencies[leaves[i]].push_back (next++ % toolchainCount);
+                            }
+                            for (util::ui32 level = 1; level + 1 < shape.depth; ++level) {
+                                for (std::size_t i = 0, count = levels[level].size (); i < count; ++i) {
+                                    if (probability (random) < shape.toolchain) {
+                                        toolchainDependencies[levels[level][i]].push_back (random () % toolchainCount);
+                                    }
+                                }
+                            }
+                        }
+                        std::string developmentRoot = MakePath (root, "development");
+                        std::string toolchainRoot = MakePath (root, "toolchain");
+                        for (util::ui32 i = 0; i < shape.projects; ++i) {
+                            WriteFile (
+                                ToSystemPath (
+                                    MakePath (
+                                        MakePath (MakePath (developmentRoot, ORGANIZATION), GetProjectName (i)),
+                                        THEKOGANS_MAKE_XML)),
+                                GetProjectConfig (
+                                    i,
+                                    std::vector<util::ui32> (dependencies[i].begin (), dependencies[i].end ()),
+                                    toolchainDependencies[i],
+                                    shape,
+                                    random));
+                        }
+                        for (util::ui32 i = 0; i < toolchainCount; ++i) {
+                            WriteFile (
+                                ToSystemPath (
+                                    MakePath (
+                                        MakePath (toolchainRoot, CONFIG_DIR),
+                                        GetFileName (ORGANIZATION, GetToolchainName (i), std::string (), VERSION, XML_EXT))),
+                                GetToolchainConfig (i, random));
+                        }
+                        {
+                            std::list<std::pair<std::string, std::string>> parameters;
+                            shape.GetParameters (parameters);
+                            std::string marker;
+                            for (std::list<std::pair<std::string, std::string>>::const_iterator
+                                    it = parameters.begin (),
+                                    end = parameters.end (); it != end; ++it) {
+                                marker += it->first + " = " + it->second + "\n";
+                            }
+                            WriteFile (ToSystemPath (MakePath (developmentRoot, GRAPH_MARKER)), marker);
+                        }
+                        std::cout <<
+                            "Generated " << shape.projects << " projects and " <<
+                            toolchainCount << " toolchain libraries. To run:\n"
+                            "export DEVELOPMENT_ROOT=" << ToSystemPath (developmentRoot) << "\n"
+                            "export TOOLCHAIN_ROOT=" << ToSystemPath (root) << "\n"
+                            "export TOOLCHAIN_DIR=" << ToSystemPath (toolchainRoot) << "\n";
+                        return 0;
+                    }
+
+                    void ReadMarker (
+                            const std::string &path,
+                            Results &results) {
+                        std::ifstream file (path.c_str ());
+                        std::string line;
+                        while (std::getline (file, line)) {
+                            std::string::size_type separator = line.find (" = ");
+                            if (separator != std::string::npos) {
+                                results.AddParameter (line.substr (0, separator), line.substr (separator + 3));
+                            }
+                        }
+                    }
+
+                    // Time a closure query. The result is cleared and
+                    // refilled on every call, as a generator would.
+                    template<typename Container>
+                    void MeasureQuery (
+                            const std::string &name,
+                            const thekogans_make &config,
+                            void (thekogans_make::*query) (Container &) const,
+                            util::ui64 iterations,
+                            Results &results) {
+                        Container container;
+                        Measurement measurement = Measure (
+                            [&] () {
+                                container.clear ();
+                                (config.*query) (container);
+                            },
+                            iterations);
+                        measurement.Report (results, name);
+                        results.Add (name, "items", (double)container.size ());
+                    }
+
+                    int Run (const Options &options) {
+                        std::string markerPath = ToSystemPath (MakePath (_DEVELOPMENT_ROOT, GRAPH_MARKER));
+                        if (_DEVELOPMENT_ROOT.empty () || !util::Path (markerPath).Exists ()) {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION ("%s",
+                                "DEVELOPMENT_ROOT does not point at a generated tree "
+                                "(see graph generate).");
+                        }
+                        util::ui64 iterations = std::max<util::ui64> (1, options.GetUI64 ("iterations", 10));
+                        Results results ("graph");
+                        ReadMarker (markerPath, results);
+                        results.AddParameter ("iterations", util::ui64Tostring (iterations));
+                        std::string project_root =
+                            Project::GetRoot (ORGANIZATION, GetProjectName (0), std::string (), std::string (), std::string ());
+                        const thekogans_make *config = 0;
+                        auto getConfig = [&] () {
+                            config = &thekogans_make::GetConfig (
+                                project_root,
+                                THEKOGANS_MAKE_XML,
+                                MAKE,
+                                CONFIG_DEBUG,
+                                TYPE_STATIC);
+                        };
+                        {
+                            // Cold: every config in the graph is read,
+                            // parsed and evaluated.
+                            Measurement measurement;
+                            util::ui64 misses = Counters::Get (Counters::CONFIG_CACHE_MISSES);
+                            util::ui64 xmlBytes = Counters::Get (Counters::XML_BYTES_PARSED);
+                            util::ui64 evalCalls = Counters::Get (Counters::EVAL_CALLS);
+                            for (util::ui64 i = 0; i < iterations; ++i) {
+                                thekogans_make::ClearConfigs ();
+                                Measurement iteration = Measure (getConfig, 1);
+                                measurement.operations += iteration.operations;
+                                measurement.nanoseconds += iteration.nanoseconds;
+                                measurement.allocations += iteration.allocations;
+                            }
+                            measurement.Report (results, "GetConfig (cold)");
+                            results.Add ("GetConfig (cold)", "configs_loaded",
+                                (double)(Counters::Get (Counters::CONFIG_CACHE_MISSES) - misses) / iterations);
+                            results.Add ("GetConfig (cold)", "xml_bytes_parsed",
+                                (double)(Counters::Get (Counters::XML_BYTES_PARSED) - xmlBytes) / iterations);
+                            results.Add ("GetConfig (cold)", "eval_calls",
+                                (double)(Counters::Get (Counters::EVAL_CALLS) - evalCalls) / iterations);
+                            results.Add ("GetConfig (cold)", "cache_bytes",
+                                (double)thekogans_make::GetConfigCacheSize ());
+                        }
+                        // Warm: a cache hit.
+                        MeasureFor (getConfig, 100000000).Report (results, "GetConfig (warm)");
+                        // The cache is only trimmed on request, but the
+                        // pin documents (and guarantees) what's relied on.
+                        thekogans_make::Pin pin (*config);
+                        {
+                            NullOutput nullOutput;
+                            Measure ([&] () {config->CheckDependencies ();}, iterations).Report (
+                                results, "CheckDependencies");
+                        }
+                        MeasureQuery<std::set<std::string>> (
+                            "GetFeatures", *config, &thekogans_make::GetFeatures, iterations, results);
+                        MeasureQuery<std::set<std::string>> (
+                            "GetIncludeDirectories", *config, &thekogans_make::GetIncludeDirectories, iterations, results);
+                        MeasureQuery<std::set<std::string>> (
+                            "GetFrameworkDirectories", *config, &thekogans_make::GetFrameworkDirectories, iterations, results);
+                        MeasureQuery<std::list<std::string>> (
+                            "GetLinkLibraries", *config, &thekogans_make::GetLinkLibraries, iterations, results);
+                        MeasureQuery<std::set<std::string>> (
+                            "GetSharedLibraries", *config, &thekogans_make::GetSharedLibraries, iterations, results);
+                        MeasureQuery<std::list<std::string>> (
+                            "GetCommonPreprocessorDefinitions", *config,
+                            &thekogans_make::GetCommonPreprocessorDefinitions, iterations, results);
+                        {
+                            NullOutput nullOutput;
+                            Measure ([&] () {config->ListDependencies (0);}, iterations).Report (
+                                results, "ListDependencies");
+                        }
+                        results.Write (options.Get ("o"));
+                        return 0;
+                    }
+                }
+
+                int RunGraphSuite (const Options &options) {
+                    std::string command = options.GetArgument (1);
+                    if (command == "generate") {
+                        return Generate (options);
+                    }
+                    if (command == "run") {
+                        return Run (options);
+                    }
+                    THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                        "Unknown graph command: '%s' (expected generate or run).",
+                        command.c_str ());
+                }
+
+            } // namespace benchmark
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
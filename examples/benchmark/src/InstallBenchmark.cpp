@@ -0,0 +1,580 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <set>
+#include <list>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include "thekogans/util/Path.h"
+#include "thekogans/util/Directory.h"
+#include "thekogans/util/StringUtils.h"
+#include "thekogans/util/Exception.h"
+#include "thekogans/make/core/Utils.h"
+#include "thekogans/make/core/Counters.h"
+#include "thekogans/make/core/Project.h"
+#include "thekogans/make/core/Manifest.h"
+#include "thekogans/make/core/FileHashCache.h"
+#include "thekogans/make/core/thekogans_make.h"
+#include "thekogans/make/core/benchmark/Benchmark.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+            namespace benchmark {
+
+                namespace {
+                    const char * const ORGANIZATION = "bench";
+                    const char * const VERSION = "1.0.0";
+                    const char * const APPLICATION = "fsapp";
+                    // Written to $DEVELOPMENT_ROOT by generate (see
+                    // GRAPH_MARKER in GraphBenchmark.cpp).
+                    const char * const INSTALL_MARKER = ".make_core_benchmark_install";
+                    const util::ui64 KB = 1024;
+                    const util::ui64 MB = 1024 * KB;
+
+                    std::string GetLibraryName (util::ui32 index) {
+                        return "fslib" + util::ui32Tostring (index);
+                    }
+
+                    // File sizes in a source tree are roughly log normal:
+                    // most files are small, a few are much bigger.
+                    util::ui64 GetFileSize (
+                            std::mt19937 &random,
+                            util::ui64 median,
+                            util::ui64 max) {
+                        std::lognormal_distribution<double> size (std::log ((double)median), 1.0);
+                        return std::min<util::ui64> (max, std::max<util::ui64> (64, (util::ui64)size (random)));
+                    }
+
+                    void WriteRandomFile (
+                            const std::string &path,
+                            util::ui64 size,
+                            std::mt19937 &random) {
+                        std::string contents ((std::size_t)size, ' ');
+                        for (std::size_t i = 0, count = contents.size (); i < count; ++i) {
+                            // Printable, so headers look like text.
+                            contents[i] = (char)(' ' + random () % 95);
+                        }
+                        WriteFile (ToSystemPath (path), contents);
+                    }
+
+                    void DeletePath (const std::string &path) {
+                        util::Path systemPath (ToSystemPath (path));
+                        if (systemPath.Exists ()) {
+                            systemPath.Delete ();
+                        }
+                    }
+
+                    struct TreeShape {
+                        util::ui32 libraries;
+                        util::ui32 headers;
+                        util::ui32 installed;
+                        util::ui32 seed;
+
+                        explicit TreeShape (const Options &options) :
+                                libraries ((util::ui32)options.GetUI64 ("libraries", 8)),
+                                headers ((util::ui32)options.GetUI64 ("headers", 200)),
+                                installed ((util::ui32)options.GetUI64 ("installed", 100)),
+                                seed ((util::ui32)options.GetUI64 ("seed", 1)) {
+                            if (libraries == 0 || headers == 0) {
+                                THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                    "Invalid tree shape: need libraries >= 1 "
+                                    "and headers >= 1 (got %u, %u).",
+                                    libraries,
+                                    headers);
+                            }
+                        }
+                    };
+
+                    std::string GetLibraryConfig (
+                            const std::string &library,
+                            const TreeShape &shape) {
+                        std::string xml =
+                            "<thekogans_make organization = \"" + std::string (ORGANIZATION) + "\"\n"
+                            "                project = \"" + library + "\"\n"
+                            "                project_type = \"library\"\n"
+                            "                major_version = \"1\"\n"
+                            "                minor_version = \"0\"\n"
+                            "                patch_version = \"0\"\n"
+                            "                schema_version = \"2\">\n"
+                            "  <cpp_headers prefix = \"include\"\n"
+                            "               install = \"yes\">\n";
+                        for (util::ui32 i = 0; i < shape.headers; ++i) {
+                            xml += "    <cpp_header>" + std::string (ORGANIZATION) + "/" + library +
+                                "/Header" + util::ui32Tostring (i) + ".h</cpp_header>\n";
+                        }
+                        xml +=
+                            "  </cpp_headers>\n"
+                            "  <cpp_sources prefix = \"src\">\n"
+                            "    <cpp_source>" + library + ".cpp</cpp_source>\n"
+                            "  </cpp_sources>\n"
+                            "</thekogans_make>\n";
+                        return xml;
+                    }
+
+                    std::string GetApplicationConfig (const TreeShape &shape) {
+                        std::string xml =
+                            "<thekogans_make organization = \"" + std::string (ORGANIZATION) + "\"\n"
+                            "                project = \"" + APPLICATION + "\"\n"
+                            "                project_type = \"program\"\n"
+                            "                major_version = \"1\"\n"
+                            "                minor_version = \"0\"\n"
+                            "                patch_version = \"0\"\n"
+                            "                schema_version = \"2\">\n"
+                            "  <dependencies>\n";
+                        for (util::ui32 i = 0; i < shape.libraries; ++i) {
+                            xml += "    <project organization = \"" + std::string (ORGANIZATION) +
+                                "\" name = \"" + GetLibraryName (i) + "\"/>\n";
+                        }
+                        xml +=
+                            "  </dependencies>\n"
+                            "  <cpp_sources prefix = \"src\">\n"
+                            "    <cpp_source>main.cpp</cpp_source>\n"
+                            "  </cpp_sources>\n"
+                            "</thekogans_make>\n";
+                        return xml;
+                    }
+
+                    int Generate (const Options &options) {
+                        std::string root = options.Get ("root");
+                        if (root.empty ()) {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION ("%s",
+                                "install generate needs -root:directory.");
+                        }
+                        TreeShape shape (options);
+                        std::mt19937 random (shape.seed);
+                        std::string developmentRoot = MakePath (root, "development");
+                        std::string toolchainRoot = MakePath (root, "toolchain");
+                        util::ui64 bytes = 0;
+                        for (util::ui32 i = 0; i < shape.libraries; ++i) {
+                            std::string library = GetLibraryName (i);
+                            std::string project_root =
+                                MakePath (MakePath (developmentRoot, ORGANIZATION), library);
+                            WriteFile (
+                                ToSystemPath (MakePath (project_root, THEKOGANS_MAKE_XML)),
+                                GetLibraryConfig (library, shape));
+                            for (util::ui32 j = 0; j < shape.headers; ++j) {
+                                util::ui64 size = GetFileSize (random, 4 * KB, 1 * MB);
+                                WriteRandomFile (
+                                    MakePath (
+                                        MakePath (MakePath (MakePath (project_root, "include"), ORGANIZATION), library),
+                                        "Header" + util::ui32Tostring (j) + ".h"),
+                                    size,
+                                    random);
+                                bytes += size;
+                            }
+                        }
+                        WriteFile (
+                            ToSystemPath (
+                                MakePath (
+                                    MakePath (MakePath (developmentRoot, ORGANIZATION), APPLICATION),
+                                    THEKOGANS_MAKE_XML)),
+                            GetApplicationConfig (shape));
+                        // Other installed libraries, for Uninstall to walk past.
+                        for (util::ui32 i = 0; i < shape.installed; ++i) {
+                            std::string installed = GetFileName (
+                                ORGANIZATION, "installed" + util::ui32Tostring (i), std::string (), VERSION, std::string ());
+                            for (util::ui32 j = 0; j < 8; ++j) {
+                                WriteRandomFile (
+                                    MakePath (
+                                        MakePath (MakePath (toolchainRoot, "include"), installed),
+                                        "Header" + util::ui32Tostring (j) + ".h"),
+                                    GetFileSize (random, 4 * KB, 64 * KB),
+                                    random);
+                            }
+                        }
+                        util::Directory::Create (ToSystemPath (MakePath (toolchainRoot, CONFIG_DIR)));
+                        WriteFile (
+                            ToSystemPath (MakePath (developmentRoot, INSTALL_MARKER)),
+                            "libraries = " + util::ui32Tostring (shape.libraries) + "\n"
+                            "headers = " + util::ui32Tostring (shape.headers) + "\n"
+                            "installed = " + util::ui32Tostring (shape.installed) + "\n"
+                            "seed = " + util::ui32Tostring (shape.seed) + "\n");
+                        std::cout <<
+                            "Generated " << shape.libraries << " libraries (" <<
+                            shape.libraries * shape.headers << " headers, " <<
+                            bytes / KB << " KB) and " << shape.installed <<
+                            " installed libraries. To run:\n"
+                            "export DEVELOPMENT_ROOT=" << ToSystemPath (developmentRoot) << "\n"
+                            "export TOOLCHAIN_ROOT=" << ToSystemPath (root) << "\n"
+                            "export TOOLCHAIN_DIR=" << ToSystemPath (toolchainRoot) << "\n";
+                        return 0;
+                    }
+
+                    void ReadMarker (
+                            const std::string &path,
+                            Results &results) {
+                        std::ifstream file (path.c_str ());
+                        std::string line;
+                        while (std::getline (file, line)) {
+                            std::string::size_type separator = line.find (" = ");
+                            if (separator != std::string::npos) {
+                                results.AddParameter (line.substr (0, separator), line.substr (separator + 3));
+                            }
+                        }
+                    }
+
+                    struct FileSet {
+                        std::vector<std::string> paths;
+                        util::ui64 bytes;
+
+                        FileSet () :
+                            bytes (0) {}
+
+                        void Add (const std::string &path) {
+                            paths.push_back (path);
+                            bytes += util::Directory::Entry (ToSystemPath (path)).size;
+                        }
+                    };
+
+                    // What Installer::InstallLibrary copies for install = "yes"
+                    // headers (sources and tests install the same way).
+                    void GetInstallPaths (
+                            const thekogans_make &config,
+                            std::vector<CopyPaths> &installPaths,
+                            FileSet &files) {
+                        for (std::list<thekogans_make::FileList::Ptr>::const_iterator
+                                it = config.cpp_headers.begin (),
+                                end = config.cpp_headers.end (); it != end; ++it) {
+                            if ((*it)->install) {
+                                std::string prefix = MakePath (config.project_root, (*it)->prefix);
+                                for (std::list<thekogans_make::FileList::File::Ptr>::const_iterator
+                                        jt = (*it)->files.begin (),
+                                        end = (*it)->files.end (); jt != end; ++jt) {
+                                    installPaths.push_back (
+                                        CopyPaths (
+                                            MakePath (prefix, (*jt)->name),
+                                            MakePath ((*it)->destinationPrefix, (*jt)->name)));
+                                    files.Add (installPaths.back ().first);
+                                }
+                            }
+                        }
+                    }
+
+                    // Call setup () untimed before each timed operation ().
+                    template<
+                        typename Setup,
+                        typename Operation>
+                    Measurement MeasureEach (
+                            Setup setup,
+                            Operation operation,
+                            util::ui64 iterations) {
+                        Measurement measurement;
+                        for (util::ui64 i = 0; i < iterations; ++i) {
+                            setup ();
+                            Measurement iteration = Measure (operation, 1);
+                            measurement.operations += iteration.operations;
+                            measurement.nanoseconds += iteration.nanoseconds;
+                            measurement.allocations += iteration.allocations;
+                        }
+                        return measurement;
+                    }
+
+                    // Each operation processes files (bytes in all).
+                    // files_copied is what the library actually copied,
+                    // and shows up to date passes doing no work.
+                    void ReportThroughput (
+                            Results &results,
+                            const std::string &name,
+                            const Measurement &measurement,
+                            std::size_t files,
+                            util::ui64 bytes,
+                            util::ui64 filesCopied) {
+                        measurement.Report (results, name);
+                        double seconds = measurement.nanoseconds / 1e9;
+                        if (seconds > 0.0) {
+                            results.Add (name, "files_per_s", files * measurement.operations / seconds);
+                            results.Add (name, "mb_per_s",
+                                (double)bytes * measurement.operations / MB / seconds);
+                        }
+                        results.Add (name, "files_copied_per_op",
+                            measurement.operations != 0 ? (double)filesCopied / measurement.operations : 0.0);
+                    }
+
+                    int Run (const Options &options) {
+                        std::string markerPath = ToSystemPath (MakePath (_DEVELOPMENT_ROOT, INSTALL_MARKER));
+                        if (_DEVELOPMENT_ROOT.empty () || _TOOLCHAIN_DIR.empty () ||
+                                !util::Path (markerPath).Exists ()) {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION ("%s",
+                                "DEVELOPMENT_ROOT does not point at a generated tree "
+                                "(see install generate).");
+                        }
+                        util::ui64 iterations = std::max<util::ui64> (1, options.GetUI64 ("iterations", 5));
+                        Results results ("install");
+                        ReadMarker (markerPath, results);
+                        results.AddParameter ("iterations", util::ui64Tostring (iterations));
+                        const thekogans_make &application = thekogans_make::GetConfig (
+                            Project::GetRoot (ORGANIZATION, APPLICATION, std::string (), std::string (), std::string ()),
+                            THEKOGANS_MAKE_XML,
+                            MAKE,
+                            CONFIG_DEBUG,
+                            TYPE_SHARED);
+                        thekogans_make::Pin applicationPin (application);
+                        const thekogans_make &library = thekogans_make::GetConfig (
+                            Project::GetRoot (ORGANIZATION, GetLibraryName (0), std::string (), std::string (), std::string ()),
+                            THEKOGANS_MAKE_XML,
+                            MAKE,
+                            CONFIG_DEBUG,
+                            TYPE_SHARED);
+                        thekogans_make::Pin libraryPin (library);
+                        // Nothing is built, so stand in for the shared
+                        // libraries CopyDependencies copies (a few MB each).
+                        FileSet sharedLibraries;
+                        {
+                            std::set<std::string> paths;
+                            application.GetSharedLibraries (paths);
+                            std::mt19937 random ((util::ui32)options.GetUI64 ("seed", 1));
+                            for (std::set<std::string>::const_iterator
+                                    it = paths.begin (),
+                                    end = paths.end (); it != end; ++it) {
+                                if (!util::Path (ToSystemPath (*it)).Exists ()) {
+                                    WriteRandomFile (*it, GetFileSize (random, 2 * MB, 64 * MB), random);
+                                }
+                                sharedLibraries.Add (*it);
+                            }
+                        }
+                        std::vector<CopyPaths> installPaths;
+                        FileSet headers;
+                        GetInstallPaths (library, installPaths, headers);
+                        std::string scratch = MakePath (_TOOLCHAIN_ROOT, "scratch");
+                        {
+                            // The library reports progress on stdout.
+                            NullOutput nullOutput;
+                            {
+                                std::string to = MakePath (scratch, "CopyFile");
+                                util::ui64 filesCopied = Counters::Get (Counters::FILES_COPIED);
+                                auto copy = [&] () {
+                                    for (std::size_t i = 0, count = headers.paths.size (); i < count; ++i) {
+                                        CopyFile (headers.paths[i], MakePath (to, util::Path (headers.paths[i]).GetFullFileName ()));
+                                    }
+                                };
+                                Measurement measurement = MeasureEach (
+                                    [&] () {
+                                        DeletePath (to);
+                                        util::Directory::Create (ToSystemPath (to));
+                                    },
+                                    copy,
+                                    iterations);
+                                ReportThroughput (results, "CopyFile", measurement,
+                                    headers.paths.size (), headers.bytes,
+                                    Counters::Get (Counters::FILES_COPIED) - filesCopied);
+                                filesCopied = Counters::Get (Counters::FILES_COPIED);
+                                measurement = Measure (copy, iterations);
+                                ReportThroughput (results, "CopyFile (up to date)", measurement,
+                                    headers.paths.size (), headers.bytes,
+                                    Counters::Get (Counters::FILES_COPIED) - filesCopied);
+                            }
+                            {
+                                std::string to = MakePath (scratch, "CopyFiles");
+                                std::vector<CopyPaths> paths;
+                                for (std::size_t i = 0, count = headers.paths.size (); i < count; ++i) {
+                                    paths.push_back (
+                                        CopyPaths (
+                                            headers.paths[i],
+                                            MakePath (to, util::Path (headers.paths[i]).GetFullFileName ())));
+                                }
+                                util::ui64 filesCopied = Counters::Get (Counters::FILES_COPIED);
+                                Measurement measurement = MeasureEach (
+                                    [&] () {
+                                        DeletePath (to);
+                                    },
+                                    [&] () {
+                                        CopyFiles (paths);
+                                    },
+                                    iterations);
+                                ReportThroughput (results, "CopyFiles", measurement,
+                                    paths.size (), headers.bytes,
+                                    Counters::Get (Counters::FILES_COPIED) - filesCopied);
+                            }
+                            {
+                                std::string binDirectory = application.GetProjectBinDirectory ();
+                                auto copyDependencies = [&] () {
+                                    CopyDependencies (application.project_root, CONFIG_DEBUG, TYPE_SHARED);
+                                };
+                                util::ui64 filesCopied = Counters::Get (Counters::FILES_COPIED);
+                                Measurement measurement = MeasureEach (
+                                    [&] () {
+                                        DeletePath (binDirectory);
+                                        util::Directory::Create (ToSystemPath (binDirectory));
+                                    },
+                                    copyDependencies,
+                                    iterations);
+                                ReportThroughput (results, "CopyDependencies", measurement,
+                                    sharedLibraries.paths.size (), sharedLibraries.bytes,
+                                    Counters::Get (Counters::FILES_COPIED) - filesCopied);
+                                filesCopied = Counters::Get (Counters::FILES_COPIED);
+                                measurement = Measure (copyDependencies, iterations);
+                                ReportThroughput (results, "CopyDependencies (up to date)", measurement,
+                                    sharedLibraries.paths.size (), sharedLibraries.bytes,
+                                    Counters::Get (Counters::FILES_COPIED) - filesCopied);
+                            }
+                            {
+                                // Installer::InstallLibrary builds the project
+                                // first, so its copy phase is timed on its own:
+                                // uninstall the previous install and copy, or
+                                // sync when installing incrementally.
+                                std::string version = library.GetVersion ();
+                                util::ui64 filesCopied = Counters::Get (Counters::FILES_COPIED);
+                                Measurement measurement = Measure (
+                                    [&] () {
+                                        UninstallLibrary (library.organization, library.project, version, false);
+                                        CopyFiles (installPaths);
+                                    },
+                                    iterations);
+                                ReportThroughput (results, "InstallLibrary (copy phase)", measurement,
+                                    installPaths.size (), headers.bytes,
+                                    Counters::Get (Counters::FILES_COPIED) - filesCopied);
+                                filesCopied = Counters::Get (Counters::FILES_COPIED);
+                                measurement = Measure (
+                                    [&] () {
+                                        SyncInstall (library.organization, library.project, version, installPaths);
+                                    },
+                                    iterations);
+                                ReportThroughput (results, "InstallLibrary (copy phase, incremental)", measurement,
+                                    installPaths.size (), headers.bytes,
+                                    Counters::Get (Counters::FILES_COPIED) - filesCopied);
+                                // Uninstall walks all of $TOOLCHAIN_DIR
+                                // (DeleteFolders) looking for the install.
+                                util::ui64 readdirs = Counters::Get (Counters::FILE_SYSTEM_READDIRS);
+                                measurement = MeasureEach (
+                                    [&] () {
+                                        CopyFiles (installPaths);
+                                    },
+                                    [&] () {
+                                        UninstallLibrary (library.organization, library.project, version, false);
+                                    },
+                                    iterations);
+                                ReportThroughput (results, "UninstallLibrary", measurement,
+                                    installPaths.size (), headers.bytes, 0);
+                                results.Add ("UninstallLibrary", "readdirs_per_op",
+                                    (double)(Counters::Get (Counters::FILE_SYSTEM_READDIRS) - readdirs) / iterations);
+                            }
+                            {
+                                FileSet files = headers;
+                                files.paths.insert (files.paths.end (),
+                                    sharedLibraries.paths.begin (), sharedLibraries.paths.end ());
+                                files.bytes += sharedLibraries.bytes;
+                                std::vector<std::string> systemPaths;
+                                for (std::size_t i = 0, count = files.paths.size (); i < count; ++i) {
+                                    systemPaths.push_back (ToSystemPath (files.paths[i]));
+                                }
+                                // Cold: an in memory cache that starts out empty.
+                                ReportThroughput (results, "GetFileHash (cold)",
+                                    Measure (
+                                        [&] () {
+                                            FileHashCache cache ((std::string ()));
+                                            for (std::size_t i = 0, count = systemPaths.size (); i < count; ++i) {
+                                                cache.GetHash (systemPaths[i]);
+                                            }
+                                        },
+                                        iterations),
+                                    files.paths.size (), files.bytes, 0);
+                                ReportThroughput (results, "GetFileHashes (cold)",
+                                    Measure (
+                                        [&] () {
+                                            FileHashCache cache ((std::string ()));
+                                            std::vector<std::string> hashes;
+                                            cache.GetHashes (systemPaths, hashes);
+                                        },
+                                        iterations),
+                                    files.paths.size (), files.bytes, 0);
+                                // Warm: the toolchain cache, after one pass.
+                                auto getFileHash = [&] () {
+                                    for (std::size_t i = 0, count = files.paths.size (); i < count; ++i) {
+                                        GetFileHash (files.paths[i]);
+                                    }
+                                };
+                                getFileHash ();
+                                ReportThroughput (results, "GetFileHash (warm)",
+                                    Measure (getFileHash, iterations),
+                                    files.paths.size (), files.bytes, 0);
+                            }
+                            {
+                                // A bin directory manifest recording every
+                                // header and shared library for two goals.
+                                std::string directory = MakePath (scratch, "manifest");
+                                std::string path = ToSystemPath (
+                                    MakePath (directory, THEKOGANS_MANIFEST + EXT_SEPARATOR + XML_EXT));
+                                const char * const GOALS[] = {APPLICATION, "fsapp_tests"};
+                                std::size_t records = (headers.paths.size () + sharedLibraries.paths.size ()) * 2;
+                                auto save = [&] () {
+                                    Manifest manifest (path);
+                                    for (std::size_t i = 0; i < 2; ++i) {
+                                        for (std::size_t j = 0, count = headers.paths.size (); j < count; ++j) {
+                                            manifest.AddFile (util::Path (headers.paths[j]).GetFullFileName (), GOALS[i]);
+                                        }
+                                        for (std::size_t j = 0, count = sharedLibraries.paths.size (); j < count; ++j) {
+                                            manifest.AddFile (util::Path (sharedLibraries.paths[j]).GetFullFileName (), GOALS[i]);
+                                        }
+                                    }
+                                    manifest.Save ();
+                                };
+                                ReportThroughput (results, "Manifest::Save (new)",
+                                    MeasureEach (
+                                        [&] () {
+                                            DeletePath (directory);
+                                            util::Directory::Create (ToSystemPath (directory));
+                                        },
+                                        save,
+                                        iterations),
+                                    records, 0, 0);
+                                ReportThroughput (results, "Manifest (load)",
+                                    Measure (
+                                        [&] () {
+                                            Manifest manifest (path);
+                                        },
+                                        iterations),
+                                    records, 0, 0);
+                                util::ui64 change = 0;
+                                ReportThroughput (results, "Manifest::Save (one change)",
+                                    Measure (
+                                        [&] () {
+                                            Manifest manifest (path);
+                                            manifest.AddFile ("Change" + util::ui64Tostring (change++), APPLICATION);
+                                            manifest.Save ();
+                                        },
+                                        iterations),
+                                    records, 0, 0);
+                            }
+                            DeletePath (scratch);
+                        }
+                        results.Write (options.Get ("o"));
+                        return 0;
+                    }
+                }
+
+                int RunInstallSuite (const Options &options) {
+                    std::string command = options.GetArgument (1);
+                    if (command == "generate") {
+                        return Generate (options);
+                    }
+                    if (command == "run") {
+                        return Run (options);
+                    }
+                    THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                        "Unknown install command: '%s' (expected generate or run).",
+                        command.c_str ());
+                }
+
+            } // namespace benchmark
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
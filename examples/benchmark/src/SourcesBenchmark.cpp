@@ -0,0 +1,832 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#include "thekogans/util/Exception.h"
+#include "thekogans/make/core/benchmark/Benchmark.h"
+
+#if defined (THEKOGANS_MAKE_CORE_HAVE_CURL) && !defined (TOOLCHAIN_OS_Windows)
+    #include <sys/types.h>
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+    #include <unistd.h>
+    #include <cerrno>
+    #include <cmath>
+    #include <cstdlib>
+    #include <cstring>
+    #include <algorithm>
+    #include <atomic>
+    #include <memory>
+    #include <mutex>
+    #include <random>
+    #include <thread>
+    #include <list>
+    #include <map>
+    #include <set>
+    #include <vector>
+    #include <iostream>
+    #include <fstream>
+    #include <sstream>
+    #include "thekogans/util/Path.h"
+    #include "thekogans/util/Directory.h"
+    #include "thekogans/util/StringUtils.h"
+    #include "thekogans/make/core/Utils.h"
+    #include "thekogans/make/core/Counters.h"
+    #include "thekogans/make/core/Project.h"
+    #include "thekogans/make/core/FileHashCache.h"
+    #include "thekogans/make/core/SourceCache.h"
+    #include "thekogans/make/core/Source.h"
+    #include "thekogans/make/core/Sources.h"
+#endif // defined (THEKOGANS_MAKE_CORE_HAVE_CURL) && !defined (TOOLCHAIN_OS_Windows)
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+            namespace benchmark {
+
+            #if defined (THEKOGANS_MAKE_CORE_HAVE_CURL) && !defined (TOOLCHAIN_OS_Windows)
+                namespace {
+                    const char * const VERSION = "1.0.0";
+                    const char * const FETCH_BRANCH = "";
+                    // Written to $DEVELOPMENT_ROOT by generate (see
+                    // GRAPH_MARKER in GraphBenchmark.cpp).
+                    const char * const SOURCES_MARKER = ".make_core_benchmark_sources";
+                    // Served (and file:// url) root, under $TOOLCHAIN_ROOT.
+                    const char * const WWW_DIR = "www";
+
+                    std::string GetOrganizationName (util::ui32 index) {
+                        return "bench" + util::ui32Tostring (index);
+                    }
+
+                    std::string GetProjectName (util::ui32 index) {
+                        return "project" + util::ui32Tostring (index);
+                    }
+
+                    // Archives fetched end to end live in the first source.
+                    std::string GetFetchProjectName (util::ui32 index) {
+                        return "fetch" + util::ui32Tostring (index);
+                    }
+
+                    void DeletePath (const std::string &path) {
+                        util::Path systemPath (ToSystemPath (path));
+                        if (systemPath.Exists ()) {
+                            systemPath.Delete ();
+                        }
+                    }
+
+                    bool ReadFile (
+                            const std::string &path,
+                            std::string &contents) {
+                        std::ifstream file (path.c_str (), std::ios::in | std::ios::binary);
+                        if (!file.is_open ()) {
+                            return false;
+                        }
+                        std::stringstream stream;
+                        stream << file.rdbuf ();
+                        contents = stream.str ();
+                        return true;
+                    }
+
+                    /// \struct HTTPServer SourcesBenchmark.cpp
+                    ///
+                    /// \brief
+                    /// A minimal HTTP/1.1 server (GET only, one request per
+                    /// connection) listening on 127.0.0.1, so UpdateSources
+                    /// and GetSourceProject can be measured without a network
+                    /// or an external server. Responses carry a strong ETag
+                    /// (a hash of the file), and If-None-Match is answered
+                    /// with 304 Not Modified.
+                    struct HTTPServer {
+                        std::string root;
+                        int listener;
+                        util::ui16 port;
+                        std::atomic<util::ui64> requests;
+                        std::atomic<util::ui64> notModified;
+
+                        explicit HTTPServer (const std::string &root_) :
+                                root (root_),
+                                listener (socket (AF_INET, SOCK_STREAM, 0)),
+                                port (0),
+                                requests (0),
+                                notModified (0),
+                                done (false) {
+                            if (listener == -1) {
+                                THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                    "socket failed: %s", strerror (errno));
+                            }
+                            sockaddr_in address;
+                            memset (&address, 0, sizeof (address));
+                            address.sin_family = AF_INET;
+                            address.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+                            address.sin_port = 0;
+                            socklen_t length = sizeof (address);
+                            if (bind (listener, (const sockaddr *)&address, sizeof (address)) != 0 ||
+                                    listen (listener, SOMAXCONN) != 0 ||
+                                    getsockname (listener, (sockaddr *)&address, &length) != 0) {
+                                // close can change errno.
+                                std::string error = strerror (errno);
+                                close (listener);
+                                THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                    "Unable to listen on 127.0.0.1: %s", error.c_str ());
+                            }
+                            port = ntohs (address.sin_port);
+                            acceptThread = std::thread (&HTTPServer::Accept, this);
+                        }
+                        ~HTTPServer () {
+                            done = true;
+                            // Wake up accept.
+                            int wakeup = Connect ();
+                            if (wakeup != -1) {
+                                close (wakeup);
+                            }
+                            acceptThread.join ();
+                            close (listener);
+                            std::lock_guard<std::mutex> guard (mutex);
+                            for (std::list<std::thread>::iterator
+                                    it = connectionThreads.begin (),
+                                    end = connectionThreads.end (); it != end; ++it) {
+                                it->join ();
+                            }
+                        }
+
+                        std::string GetURL () const {
+                            return "http://127.0.0.1:" + util::ui32Tostring (port);
+                        }
+
+                    private:
+                        std::atomic<bool> done;
+                        std::thread acceptThread;
+                        std::mutex mutex;
+                        std::list<std::thread> connectionThreads;
+
+                        int Connect () const {
+                            int connection = socket (AF_INET, SOCK_STREAM, 0);
+                            if (connection != -1) {
+                                sockaddr_in address;
+                                memset (&address, 0, sizeof (address));
+                                address.sin_family = AF_INET;
+                                address.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+                                address.sin_port = htons (port);
+                                if (connect (connection, (const sockaddr *)&address, sizeof (address)) != 0) {
+                                    close (connection);
+                                    connection = -1;
+                                }
+                            }
+                            return connection;
+                        }
+
+                        void Accept () {
+                            while (1) {
+                                int connection = accept (listener, 0, 0);
+                                if (done) {
+                                    if (connection != -1) {
+                                        close (connection);
+                                    }
+                                    break;
+                                }
+                                if (connection != -1) {
+                                    std::lock_guard<std::mutex> guard (mutex);
+                                    connectionThreads.push_back (
+                                        std::thread (&HTTPServer::Serve, this, connection));
+                                }
+                            }
+                        }
+
+                        static bool Send (
+                                int connection,
+                                const char *data,
+                                std::size_t length) {
+                        #if defined (MSG_NOSIGNAL)
+                            const int flags = MSG_NOSIGNAL;
+                        #else // defined (MSG_NOSIGNAL)
+                            const int flags = 0;
+                        #endif // defined (MSG_NOSIGNAL)
+                            while (length > 0) {
+                                ssize_t sent = send (connection, data, length, flags);
+                                if (sent <= 0) {
+                                    return false;
+                                }
+                                data += sent;
+                                length -= (std::size_t)sent;
+                            }
+                            return true;
+                        }
+
+                        static std::string GetETag (const std::string &contents) {
+                            // FNV-1a
+                            util::ui64 hash = 14695981039346656037ULL;
+                            for (std::size_t i = 0, count = contents.size (); i < count; ++i) {
+                                hash ^= (util::ui8)contents[i];
+                                hash *= 1099511628211ULL;
+                            }
+                            return util::FormatString ("\"%016llx-%llx\"",
+                                (unsigned long long)hash, (unsigned long long)contents.size ());
+                        }
+
+                        void Serve (int connection) {
+                            std::string request;
+                            char buffer[4096];
+                            while (request.find ("\r\n\r\n") == std::string::npos && request.size () < 65536) {
+                                ssize_t count = recv (connection, buffer, sizeof (buffer), 0);
+                                if (count <= 0) {
+                                    break;
+                                }
+                                request.append (buffer, (std::size_t)count);
+                            }
+                            ++requests;
+                            std::string status = "404 Not Found";
+                            std::string headers;
+                            std::string body;
+                            std::string::size_type pathStart = request.find (' ');
+                            std::string::size_type pathEnd = pathStart != std::string::npos ?
+                                request.find_first_of (" ?", pathStart + 1) : std::string::npos;
+                            if (request.compare (0, 4, "GET ") == 0 && pathEnd != std::string::npos) {
+                                std::string path = request.substr (pathStart + 1, pathEnd - pathStart - 1);
+                                std::string contents;
+                                if (path.find ("..") == std::string::npos &&
+                                        ReadFile (ToSystemPath (MakePath (root, path)), contents)) {
+                                    std::string etag = GetETag (contents);
+                                    std::string ifNoneMatch;
+                                    {
+                                        std::string lowerRequest = util::StringToLower (request.c_str ());
+                                        std::string::size_type header = lowerRequest.find ("\r\nif-none-match:");
+                                        if (header != std::string::npos) {
+                                            header += 16;
+                                            std::string::size_type headerEnd = request.find ("\r\n", header);
+                                            ifNoneMatch = util::TrimSpaces (
+                                                request.substr (header, headerEnd - header).c_str ());
+                                        }
+                                    }
+                                    headers = "ETag: " + etag + "\r\n";
+                                    if (ifNoneMatch == etag) {
+                                        status = "304 Not Modified";
+                                        ++notModified;
+                                    }
+                                    else {
+                                        status = "200 OK";
+                                        body.swap (contents);
+                                    }
+                                }
+                            }
+                            std::string response =
+                                "HTTP/1.1 " + status + "\r\n" + headers +
+                                "Content-Length: " + util::ui64Tostring (body.size ()) + "\r\n"
+                                "Connection: close\r\n\r\n";
+                            if (Send (connection, response.data (), response.size ()) && !body.empty ()) {
+                                Send (connection, body.data (), body.size ());
+                            }
+                            close (connection);
+                        }
+
+                        THEKOGANS_UTIL_DISALLOW_COPY_AND_ASSIGN (HTTPServer)
+                    };
+
+                    struct RegistryShape {
+                        util::ui32 sources;
+                        util::ui32 projects;
+                        util::ui32 versions;
+                        util::ui32 branches;
+                        util::ui32 archives;
+                        util::ui32 files;
+                        util::ui32 seed;
+
+                        explicit RegistryShape (const Options &options) :
+                                sources ((util::ui32)options.GetUI64 ("sources", 8)),
+                                projects ((util::ui32)options.GetUI64 ("projects", 100)),
+                                versions ((util::ui32)options.GetUI64 ("versions", 10)),
+                                branches ((util::ui32)options.GetUI64 ("branches", 2)),
+                                archives ((util::ui32)options.GetUI64 ("archives", 8)),
+                                files ((util::ui32)options.GetUI64 ("files", 64)),
+                                seed ((util::ui32)options.GetUI64 ("seed", 1)) {
+                            if (sources == 0 || projects == 0 || versions == 0 ||
+                                    branches == 0 || archives == 0) {
+                                THEKOGANS_UTIL_THROW_STRING_EXCEPTION ("%s",
+                                    "Invalid registry shape: sources, projects, versions, "
+                                    "branches and archives must be >= 1.");
+                            }
+                        }
+
+                        explicit RegistryShape (const std::map<std::string, std::string> &marker) :
+                                sources (Get (marker, "sources")),
+                                projects (Get (marker, "projects")),
+                                versions (Get (marker, "versions")),
+                                branches (Get (marker, "branches")),
+                                archives (Get (marker, "archives")),
+                                files (Get (marker, "files")),
+                                seed (Get (marker, "seed")) {}
+
+                        std::string GetMarker () const {
+                            return
+                                "sources = " + util::ui32Tostring (sources) + "\n"
+                                "projects = " + util::ui32Tostring (projects) + "\n"
+                                "versions = " + util::ui32Tostring (versions) + "\n"
+                                "branches = " + util::ui32Tostring (branches) + "\n"
+                                "archives = " + util::ui32Tostring (archives) + "\n"
+                                "files = " + util::ui32Tostring (files) + "\n"
+                                "seed = " + util::ui32Tostring (seed) + "\n";
+                        }
+
+                    private:
+                        static util::ui32 Get (
+                                const std::map<std::string, std::string> &marker,
+                                const std::string &name) {
+                            std::map<std::string, std::string>::const_iterator it = marker.find (name);
+                            return it != marker.end () ? util::stringToui32 (it->second.c_str ()) : 0;
+                        }
+                    };
+
+                    std::string GetBranchName (util::ui32 index) {
+                        return index == 0 ? std::string () : "branch" + util::ui32Tostring (index);
+                    }
+
+                    std::string GetProjectVersion (util::ui32 index) {
+                        return "1." + util::ui32Tostring (index / 10) + "." + util::ui32Tostring (index % 10);
+                    }
+
+                    std::string GetProjectElement (
+                            const std::string &name,
+                            const std::string &branch,
+                            const std::string &version,
+                            const std::string &SHA2_256) {
+                        std::string xml = "  <project name = \"" + name + "\"";
+                        if (!branch.empty ()) {
+                            xml += " branch = \"" + branch + "\"";
+                        }
+                        return xml + " version = \"" + version + "\" SHA2-256 = \"" + SHA2_256 + "\"/>\n";
+                    }
+
+                    int Generate (const Options &options) {
+                        std::string root = options.Get ("root");
+                        if (root.empty () || root[0] != '/') {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION ("%s",
+                                "sources generate needs an absolute -root:directory "
+                                "(it's also served as a file:// url).");
+                        }
+                        RegistryShape shape (options);
+                        std::mt19937 random (shape.seed);
+                        std::string developmentRoot = MakePath (root, "development");
+                        std::string toolchainDir = MakePath (root, "toolchain");
+                        std::string fetchRoot = MakePath (MakePath (root, WWW_DIR), GetOrganizationName (0));
+                        std::string stagingRoot = MakePath (root, "staging");
+                        // The archives (real .tar.gz, as the library
+                        // extracts them with tar) of projects with
+                        // log normally sized files.
+                        std::lognormal_distribution<double> fileSize (std::log (16.0 * 1024), 1.0);
+                        for (util::ui32 i = 0; i < shape.archives; ++i) {
+                            std::string project = GetFetchProjectName (i);
+                            std::string projectDirectory = project + "-" + VERSION;
+                            std::string projectRoot = MakePath (stagingRoot, projectDirectory);
+                            WriteFile (ToSystemPath (MakePath (projectRoot, THEKOGANS_MAKE_XML)),
+                                "<thekogans_make organization = \"" + GetOrganizationName (0) + "\"\n"
+                                "                project = \"" + project + "\"\n"
+                                "                project_type = \"library\"\n"
+                                "                major_version = \"1\"\n"
+                                "                minor_version = \"0\"\n"
+                                "                patch_version = \"0\"\n"
+                                "                schema_version = \"2\">\n"
+                                "</thekogans_make>\n");
+                            for (util::ui32 j = 0; j < shape.files; ++j) {
+                                std::string contents (
+                                    std::min<std::size_t> (4 * 1024 * 1024,
+                                        std::max<std::size_t> (64, (std::size_t)fileSize (random))), ' ');
+                                for (std::size_t k = 0, count = contents.size (); k < count; ++k) {
+                                    contents[k] = (char)(' ' + random () % 95);
+                                }
+                                WriteFile (
+                                    ToSystemPath (MakePath (MakePath (projectRoot, "src"),
+                                        "File" + util::ui32Tostring (j) + ".cpp")),
+                                    contents);
+                            }
+                            std::string archive = ToSystemPath (
+                                MakePath (
+                                    fetchRoot,
+                                    GetFileName (GetOrganizationName (0), project, FETCH_BRANCH, VERSION, TAR_GZ_EXT)));
+                            util::Directory::Create (util::Path (archive).GetDirectory ());
+                            std::string command = "tar -czf \"" + archive + "\" -C \"" +
+                                ToSystemPath (stagingRoot) + "\" \"" + projectDirectory + "\"";
+                            if (std::system (command.c_str ()) != 0) {
+                                THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                    "Unable to execute: '%s'.",
+                                    command.c_str ());
+                            }
+                        }
+                        DeletePath (stagingRoot);
+                        util::Directory::Create (ToSystemPath (toolchainDir));
+                        WriteFile (ToSystemPath (MakePath (developmentRoot, SOURCES_MARKER)), shape.GetMarker ());
+                        std::cout <<
+                            "Generated " << shape.archives << " archives. Registries (" <<
+                            shape.sources << " sources of " <<
+                            shape.projects * shape.branches * shape.versions <<
+                            " projects each) are written by run. To run:\n"
+                            "export DEVELOPMENT_ROOT=" << ToSystemPath (developmentRoot) << "\n"
+                            "export TOOLCHAIN_ROOT=" << ToSystemPath (root) << "\n"
+                            "export TOOLCHAIN_DIR=" << ToSystemPath (toolchainDir) << "\n";
+                        return 0;
+                    }
+
+                    void ReadMarker (
+                            const std::string &path,
+                            std::map<std::string, std::string> &marker,
+                            Results &results) {
+                        std::ifstream file (path.c_str ());
+                        std::string line;
+                        while (std::getline (file, line)) {
+                            std::string::size_type separator = line.find (" = ");
+                            if (separator != std::string::npos) {
+                                marker[line.substr (0, separator)] = line.substr (separator + 3);
+                                results.AddParameter (line.substr (0, separator), line.substr (separator + 3));
+                            }
+                        }
+                    }
+
+                    struct Archive {
+                        std::string name;
+                        std::string SHA2_256;
+                        util::ui64 size;
+                    };
+
+                    // Source.xml of every source. The url is the server's,
+                    // as UpdateSources takes it from the downloaded file.
+                    void WriteRegistries (
+                            const std::string &www,
+                            const std::string &url,
+                            const RegistryShape &shape,
+                            const std::vector<Archive> &archives) {
+                        std::mt19937 random (shape.seed);
+                        for (util::ui32 i = 0; i < shape.sources; ++i) {
+                            std::string organization = GetOrganizationName (i);
+                            std::string xml =
+                                "<source organization = \"" + organization + "\"\n"
+                                "        url = \"" + url + "\"\n"
+                                "        schema_version = \"1\">\n";
+                            if (i == 0) {
+                                for (std::size_t j = 0, count = archives.size (); j < count; ++j) {
+                                    xml += GetProjectElement (
+                                        archives[j].name, FETCH_BRANCH, VERSION, archives[j].SHA2_256);
+                                }
+                            }
+                            for (util::ui32 j = 0; j < shape.projects; ++j) {
+                                for (util::ui32 k = 0; k < shape.branches; ++k) {
+                                    for (util::ui32 l = 0; l < shape.versions; ++l) {
+                                        std::string SHA2_256;
+                                        for (std::size_t m = 0; m < 8; ++m) {
+                                            SHA2_256 += util::FormatString ("%08x", (util::ui32)random ());
+                                        }
+                                        xml += GetProjectElement (
+                                            GetProjectName (j), GetBranchName (k), GetProjectVersion (l), SHA2_256);
+                                    }
+                                }
+                            }
+                            xml += "</source>\n";
+                            WriteFile (ToSystemPath (MakePath (MakePath (www, organization), SOURCE_XML)), xml);
+                        }
+                    }
+
+                    // A Sources.xml listing every source at url (with no
+                    // validators, so the next UpdateSources downloads
+                    // everything). withArchives = the first source lists
+                    // the archives, so they can be fetched without an
+                    // update.
+                    void WriteSources (
+                            const std::string &path,
+                            const std::string &url,
+                            const RegistryShape &shape,
+                            const std::vector<Archive> &archives,
+                            bool withArchives) {
+                        std::string xml = "<sources schema_version = \"1\">\n";
+                        for (util::ui32 i = 0; i < shape.sources; ++i) {
+                            xml += "<source organization = \"" + GetOrganizationName (i) + "\"\n"
+                                "        url = \"" + url + "\"\n"
+                                "        schema_version = \"1\">\n";
+                            if (i == 0 && withArchives) {
+                                for (std::size_t j = 0, count = archives.size (); j < count; ++j) {
+                                    xml += GetProjectElement (
+                                        archives[j].name, FETCH_BRANCH, VERSION, archives[j].SHA2_256);
+                                }
+                            }
+                            xml += "</source>\n";
+                        }
+                        xml += "</sources>\n";
+                        WriteFile (ToSystemPath (path), xml);
+                    }
+
+                    // items (bytes in all) are processed by each operation.
+                    void ReportTransfer (
+                            Results &results,
+                            const std::string &name,
+                            const Measurement &measurement,
+                            std::size_t items,
+                            util::ui64 bytes) {
+                        measurement.Report (results, name);
+                        double seconds = measurement.nanoseconds / 1e9;
+                        if (seconds > 0.0) {
+                            results.Add (name, "items_per_s", items * measurement.operations / seconds);
+                            results.Add (name, "mb_per_s",
+                                (double)bytes * measurement.operations / (1024.0 * 1024.0) / seconds);
+                        }
+                    }
+
+                    int Run (const Options &options) {
+                        std::string markerPath = ToSystemPath (MakePath (_DEVELOPMENT_ROOT, SOURCES_MARKER));
+                        if (_DEVELOPMENT_ROOT.empty () || _TOOLCHAIN_ROOT.empty () ||
+                                !util::Path (markerPath).Exists ()) {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION ("%s",
+                                "DEVELOPMENT_ROOT does not point at a generated tree "
+                                "(see sources generate).");
+                        }
+                        util::ui64 iterations = std::max<util::ui64> (1, options.GetUI64 ("iterations", 3));
+                        util::ui32 connections = (util::ui32)options.GetUI64 ("connections", Sources::DEFAULT_MAX_CONNECTIONS);
+                        Results results ("sources");
+                        std::map<std::string, std::string> marker;
+                        ReadMarker (markerPath, marker, results);
+                        RegistryShape shape (marker);
+                        results.AddParameter ("iterations", util::ui64Tostring (iterations));
+                        results.AddParameter ("connections", util::ui32Tostring (connections));
+                        std::string www = MakePath (_TOOLCHAIN_ROOT, WWW_DIR);
+                        std::vector<Archive> archives (shape.archives);
+                        {
+                            FileHashCache cache ((std::string ()));
+                            for (util::ui32 i = 0; i < shape.archives; ++i) {
+                                archives[i].name = GetFetchProjectName (i);
+                                std::string path = ToSystemPath (
+                                    MakePath (
+                                        MakePath (www, GetOrganizationName (0)),
+                                        GetFileName (GetOrganizationName (0), archives[i].name, FETCH_BRANCH, VERSION, TAR_GZ_EXT)));
+                                archives[i].SHA2_256 = cache.GetHash (path);
+                                archives[i].size = util::Directory::Entry (path).size;
+                            }
+                        }
+                        util::ui64 archiveBytes = 0;
+                        for (std::size_t i = 0, count = archives.size (); i < count; ++i) {
+                            archiveBytes += archives[i].size;
+                        }
+                        {
+                            // The library reports progress on stdout.
+                            NullOutput nullOutput;
+                            HTTPServer server (www);
+                            std::string fileURL = "file://" + www;
+                            WriteRegistries (www, server.GetURL (), shape, archives);
+                            util::ui64 registryBytes = 0;
+                            for (util::ui32 i = 0; i < shape.sources; ++i) {
+                                registryBytes += util::Directory::Entry (
+                                    ToSystemPath (MakePath (MakePath (www, GetOrganizationName (i)), SOURCE_XML))).size;
+                            }
+                            std::string httpSourcesPath = MakePath (_TOOLCHAIN_ROOT, "Sources-http.xml");
+                            std::string fileSourcesPath = MakePath (_TOOLCHAIN_ROOT, "Sources-file.xml");
+                            std::unique_ptr<Sources> httpSources;
+                            std::unique_ptr<Sources> fileSources;
+                            // UpdateSources: curl_multi fetching every
+                            // Source.xml, then parsing and saving.
+                            {
+                                util::ui64 requests = server.requests;
+                                Measurement measurement;
+                                for (util::ui64 i = 0; i < iterations; ++i) {
+                                    WriteSources (httpSourcesPath, server.GetURL (), shape, archives, false);
+                                    httpSources.reset (new Sources (ToSystemPath (httpSourcesPath)));
+                                    Measurement iteration = Measure (
+                                        [&] () {
+                                            httpSources->UpdateSources (std::string (), connections);
+                                        },
+                                        1);
+                                    measurement.operations += iteration.operations;
+                                    measurement.nanoseconds += iteration.nanoseconds;
+                                    measurement.allocations += iteration.allocations;
+                                }
+                                ReportTransfer (results, "UpdateSources (http)", measurement,
+                                    shape.sources, registryBytes);
+                                results.Add ("UpdateSources (http)", "requests_per_op",
+                                    (double)(server.requests - requests) / iterations);
+                            }
+                            {
+                                // Validators from the last update: every
+                                // source answers 304.
+                                util::ui64 requests = server.requests;
+                                util::ui64 notModified = server.notModified;
+                                util::ui64 bytes = Counters::Get (Counters::BYTES_DOWNLOADED);
+                                ReportTransfer (results, "UpdateSources (http, not modified)",
+                                    Measure (
+                                        [&] () {
+                                            httpSources->UpdateSources (std::string (), connections);
+                                        },
+                                        iterations),
+                                    shape.sources, 0);
+                                results.Add ("UpdateSources (http, not modified)", "requests_per_op",
+                                    (double)(server.requests - requests) / iterations);
+                                results.Add ("UpdateSources (http, not modified)", "not_modified_per_op",
+                                    (double)(server.notModified - notModified) / iterations);
+                                results.Add ("UpdateSources (http, not modified)", "bytes_downloaded_per_op",
+                                    (double)(Counters::Get (Counters::BYTES_DOWNLOADED) - bytes) / iterations);
+                            }
+                            {
+                                WriteSources (fileSourcesPath, fileURL, shape, archives, false);
+                                Sources sources (ToSystemPath (fileSourcesPath));
+                                ReportTransfer (results, "UpdateSources (file://)",
+                                    Measure (
+                                        [&] () {
+                                            sources.UpdateSources (std::string (), connections);
+                                        },
+                                        iterations),
+                                    shape.sources, registryBytes);
+                            }
+                            // Lookups over the (updated) registries.
+                            {
+                                std::string organization = GetOrganizationName (shape.sources - 1);
+                                std::vector<std::string> names (shape.projects);
+                                for (util::ui32 i = 0; i < shape.projects; ++i) {
+                                    names[i] = GetProjectName (i);
+                                }
+                                std::string branch = GetBranchName (shape.branches - 1);
+                                std::string version = GetProjectVersion (shape.versions / 2);
+                                util::ui64 minNanoseconds = 100000000;
+                                std::size_t next = 0;
+                                MeasureFor (
+                                    [&] () {
+                                        httpSources->GetSourceProjectLatestVersion (
+                                            organization, names[next++ % names.size ()], branch);
+                                    },
+                                    minNanoseconds).Report (results, "GetSourceProjectLatestVersion");
+                                MeasureFor (
+                                    [&] () {
+                                        httpSources->IsSourceProject (
+                                            organization, names[next++ % names.size ()], branch, version);
+                                    },
+                                    minNanoseconds).Report (results, "IsSourceProject");
+                                MeasureFor (
+                                    [&] () {
+                                        httpSources->GetSourceProjectSHA2_256 (
+                                            organization, names[next++ % names.size ()], branch, version);
+                                    },
+                                    minNanoseconds).Report (results, "GetSourceProjectSHA2_256");
+                                std::set<std::string> versions;
+                                MeasureFor (
+                                    [&] () {
+                                        versions.clear ();
+                                        httpSources->GetSourceProjectVersions (
+                                            organization, names[next++ % names.size ()], branch, versions);
+                                    },
+                                    minNanoseconds).Report (results, "GetSourceProjectVersions");
+                                results.Add ("GetSourceProjectLatestVersion", "registry_entries",
+                                    (double)shape.projects * shape.branches * shape.versions);
+                            }
+                            // End to end: download (or read from the
+                            // SourceCache), hash and extract each archive.
+                            WriteSources (fileSourcesPath, fileURL, shape, archives, true);
+                            fileSources.reset (new Sources (ToSystemPath (fileSourcesPath)));
+                            SourceCache &cache = *ToolchainSourceCache::Instance ();
+                            auto fetch = [&] (
+                                    const std::string &name,
+                                    const Sources &sources,
+                                    bool cached) {
+                                Measurement measurement;
+                                util::ui64 bytes = Counters::Get (Counters::BYTES_DOWNLOADED);
+                                for (util::ui64 i = 0; i < iterations; ++i) {
+                                    for (std::size_t j = 0, count = archives.size (); j < count; ++j) {
+                                        DeletePath (
+                                            Project::GetRoot (GetOrganizationName (0),
+                                                archives[j].name, FETCH_BRANCH, VERSION, std::string ()));
+                                        if (!cached) {
+                                            DeletePath (cache.GetArchivePath (archives[j].SHA2_256));
+                                        }
+                                        Measurement iteration = Measure (
+                                            [&] () {
+                                                sources.GetSourceProject (
+                                                    GetOrganizationName (0), archives[j].name, FETCH_BRANCH, VERSION);
+                                            },
+                                            1);
+                                        measurement.operations += iteration.operations;
+                                        measurement.nanoseconds += iteration.nanoseconds;
+                                        measurement.allocations += iteration.allocations;
+                                    }
+                                }
+                                // One operation = one archive.
+                                ReportTransfer (results, name, measurement, 1, archiveBytes / archives.size ());
+                                results.Add (name, "bytes_downloaded_per_op",
+                                    (double)(Counters::Get (Counters::BYTES_DOWNLOADED) - bytes) / measurement.operations);
+                            };
+                            fetch ("GetSourceProject (http)", *httpSources, false);
+                            fetch ("GetSourceProject (cached)", *httpSources, true);
+                            fetch ("GetSourceProject (file://)", *fileSources, false);
+                        }
+                        results.Write (options.Get ("o"));
+                        return 0;
+                    }
+
+                    void Expect (
+                            bool condition,
+                            const char *what) {
+                        if (!condition) {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                "sources check failed: %s.", what);
+                        }
+                    }
+
+                    // Conditional GET (SourceTransfer over CURLMultiHandle)
+                    // against the local server: the first update downloads
+                    // every Source.xml and records its validators, the next
+                    // ones (also from a reloaded Sources.xml) get 304s, and
+                    // only a changed Source.xml is downloaded again.
+                    int Check (const Options &options) {
+                        std::string root = options.Get ("root", "make_core_benchmark_sources_check");
+                        std::map<std::string, std::string> marker;
+                        marker["sources"] = "4";
+                        marker["projects"] = "2";
+                        marker["versions"] = "2";
+                        marker["branches"] = "1";
+                        marker["seed"] = "1";
+                        RegistryShape shape (marker);
+                        std::vector<Archive> archives;
+                        std::string www = MakePath (root, WWW_DIR);
+                        std::string sourcesPath = MakePath (root, SOURCES_XML);
+                        {
+                            // The library reports progress on stdout.
+                            NullOutput nullOutput;
+                            HTTPServer server (www);
+                            WriteRegistries (www, server.GetURL (), shape, archives);
+                            WriteSources (sourcesPath, server.GetURL (), shape, archives, false);
+                            {
+                                Sources sources (ToSystemPath (sourcesPath));
+                                sources.UpdateSources (std::string ());
+                                Expect (server.requests == shape.sources && server.notModified == 0,
+                                    "the first update must download every Source.xml");
+                                for (std::list<Source::Ptr>::const_iterator
+                                        it = sources.sources.begin (),
+                                        end = sources.sources.end (); it != end; ++it) {
+                                    Expect (!(*it)->etag.empty (), "the ETag of a downloaded Source.xml must be kept");
+                                }
+                                Expect (
+                                    sources.IsSourceProject (
+                                        GetOrganizationName (0), GetProjectName (0), std::string (), GetProjectVersion (0)),
+                                    "a downloaded Source.xml must be parsed");
+                                sources.UpdateSources (std::string ());
+                                Expect (server.requests == 2 * shape.sources && server.notModified == shape.sources,
+                                    "an unchanged Source.xml must be answered with 304");
+                            }
+                            {
+                                Sources sources (ToSystemPath (sourcesPath));
+                                sources.UpdateSources (std::string ());
+                                Expect (server.notModified == 2 * shape.sources,
+                                    "the validators must be saved in Sources.xml");
+                                std::string organization = GetOrganizationName (1);
+                                WriteFile (
+                                    ToSystemPath (MakePath (MakePath (www, organization), SOURCE_XML)),
+                                    "<source organization = \"" + organization + "\"\n"
+                                    "        url = \"" + server.GetURL () + "\"\n"
+                                    "        schema_version = \"1\">\n" +
+                                    GetProjectElement ("added", std::string (), VERSION, std::string (64, '0')) +
+                                    "</source>\n");
+                                sources.UpdateSources (std::string ());
+                                Expect (server.requests == 4 * shape.sources &&
+                                    server.notModified == 3 * shape.sources - 1,
+                                    "only a changed Source.xml must be downloaded");
+                                Expect (
+                                    sources.IsSourceProject (organization, "added", std::string (), VERSION),
+                                    "a changed Source.xml must replace the old one");
+                            }
+                        }
+                        DeletePath (root);
+                        std::cout << "sources check: ok" << std::endl;
+                        return 0;
+                    }
+                }
+
+                int RunSourcesSuite (const Options &options) {
+                    std::string command = options.GetArgument (1);
+                    if (command == "generate") {
+                        return Generate (options);
+                    }
+                    if (command == "run") {
+                        return Run (options);
+                    }
+                    if (command == "check") {
+                        return Check (options);
+                    }
+                    THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                        "Unknown sources command: '%s' (expected generate, run or check).",
+                        command.c_str ());
+                }
+            #else // defined (THEKOGANS_MAKE_CORE_HAVE_CURL) && !defined (TOOLCHAIN_OS_Windows)
+                int RunSourcesSuite (const Options & /*options*/) {
+                    THEKOGANS_UTIL_THROW_STRING_EXCEPTION ("%s",
+                        "The sources suite needs curl (THEKOGANS_MAKE_CORE_HAVE_CURL) "
+                        "and POSIX sockets.");
+                }
+            #endif // defined (THEKOGANS_MAKE_CORE_HAVE_CURL) && !defined (TOOLCHAIN_OS_Windows)
+
+            } // namespace benchmark
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
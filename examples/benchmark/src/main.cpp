@@ -0,0 +1,90 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#include <string>
+#include <iostream>
+#include "thekogans/util/Exception.h"
+#include "thekogans/make/core/benchmark/Benchmark.h"
+
+using namespace thekogans;
+using namespace thekogans::make::core;
+
+namespace {
+    void Usage (const char *program) {
+        std::cout << "usage: " << program << " suite [command] [-option:value ...]\n"
+            "\n"
+            "expression [-root:make_core_benchmark_expression] [-milliseconds:100] [-o:results.json]\n"
+            "    Write a project with the constants the corpus uses to root, and time\n"
+            "    Tokenizer, Parser::Parse, Eval, Expand, Function::ParseAndExec and\n"
+            "    Value::Parse/ToString over a corpus of conditions, templates and calls.\n"
+            "graph generate -root:directory [-projects:200] [-depth:6] [-fanout:4]\n"
+            "    [-diamonds:0.3] [-conditionals:0.2] [-files:50] [-toolchain:0.1] [-seed:1]\n"
+            "    Generate a synthetic project tree (root/development) and toolchain\n"
+            "    (root/toolchain), and print the environment to run against it.\n"
+            "graph run [-iterations:10] [-o:results.json]\n"
+            "    With DEVELOPMENT_ROOT, TOOLCHAIN_ROOT and TOOLCHAIN_DIR pointing at a\n"
+            "    generated tree, time GetConfig (cold and warm), CheckDependencies,\n"
+            "    the dependency closure queries and ListDependencies.\n"
+            "install generate -root:directory [-libraries:8] [-headers:200] [-installed:100] [-seed:1]\n"
+            "    Generate libraries with log normally sized headers, an application\n"
+            "    depending on them, and a toolchain with other libraries installed.\n"
+            "install run [-iterations:5] [-seed:1] [-o:results.json]\n"
+            "    With the environment pointing at a generated tree, time CopyFile(s),\n"
+            "    CopyDependencies, the InstallLibrary copy phase, UninstallLibrary,\n"
+            "    GetFileHash (cold and warm) and Manifest load/save.\n"
+            "sources generate -root:/absolute/directory [-sources:8] [-projects:100] [-versions:10]\n"
+            "    [-branches:2] [-archives:8] [-files:64] [-seed:1]\n"
+            "    Generate project archives to serve, and the environment to run against them.\n"
+            "sources run [-iterations:3] [-connections:8] [-o:results.json]\n"
+            "    Serve root/www from an in process HTTP server (and as file://), and time\n"
+            "    UpdateSources (full and not modified), the source lookups over the\n"
+            "    registries, and GetSourceProject (download, cached and file://).\n"
+            "sources check [-root:make_core_benchmark_sources_check]\n"
+            "    Check conditional GET against the local server: unchanged Source.xml\n"
+            "    files are answered with 304 (also after Sources.xml is reloaded), and\n"
+            "    only a changed one is downloaded again. Exits with 1 on failure.\n"
+            "\n"
+            "-o:path writes the results to path (.json = JSON, otherwise a table).\n";
+    }
+}
+
+int main (
+        int argc,
+        const char *argv[]) {
+    benchmark::Options options (argc, argv);
+    std::string suite = options.GetArgument (0);
+    THEKOGANS_UTIL_TRY {
+        if (suite == "expression") {
+            return benchmark::RunExpressionSuite (options);
+        }
+        if (suite == "graph") {
+            return benchmark::RunGraphSuite (options);
+        }
+        if (suite == "install") {
+            return benchmark::RunInstallSuite (options);
+        }
+        if (suite == "sources") {
+            return benchmark::RunSourcesSuite (options);
+        }
+        Usage (argv[0]);
+        return 1;
+    }
+    THEKOGANS_UTIL_CATCH (util::Exception) {
+        std::cerr << exception.what () << std::endl;
+        return 1;
+    }
+}
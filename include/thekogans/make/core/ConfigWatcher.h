@@ -0,0 +1,104 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#if !defined (__thekogans_make_core_ConfigWatcher_h)
+#define __thekogans_make_core_ConfigWatcher_h
+
+#include "thekogans/util/Environment.h"
+
+#if defined (TOOLCHAIN_OS_Linux)
+
+#include <string>
+#include <map>
+#include "thekogans/util/Types.h"
+#include "thekogans/make/core/Config.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+
+            /// \struct ConfigWatcher ConfigWatcher.h thekogans/make/core/ConfigWatcher.h
+            ///
+            /// \brief
+            /// Keeps the config cache of a long running (resident) process
+            /// honest. Uses inotify to watch the directories of every loaded
+            /// config (see thekogans_make::GetConfigFiles) and the toolchain
+            /// config directory. When a config file changes, the configs that
+            /// were loaded from it (directly or through dependencies) are
+            /// dropped (thekogans_make::InvalidateConfigs). When a toolchain
+            /// config appears or disappears (install/uninstall), dependency
+            /// resolution itself might change and the whole cache is dropped.
+            /// Like GetConfig, ConfigWatcher is not thread safe. Call
+            /// ProcessEvents between requests, when no config references
+            /// are in use. GetHandle can be used to wait (poll/select) for
+            /// events alongside other descriptors (e.g. a request socket).
+
+            struct _LIB_THEKOGANS_MAKE_CORE_DECL ConfigWatcher {
+                /// \brief
+                /// ctor. Create the inotify instance.
+                ConfigWatcher ();
+                /// \brief
+                /// dtor. Close the inotify instance.
+                ~ConfigWatcher ();
+
+                /// \brief
+                /// Return the inotify descriptor (readable when there are events).
+                /// \return The inotify descriptor.
+                inline int GetHandle () const {
+                    return handle;
+                }
+
+                /// \brief
+                /// Watch the toolchain config directory and the directories of
+                /// all loaded configs. Call after every request that might have
+                /// loaded new configs. Already watched directories are skipped.
+                void WatchConfigs ();
+
+                /// \brief
+                /// Read pending events and invalidate the affected configs.
+                /// Does not block.
+                /// \return Number of cached configs dropped.
+                std::size_t ProcessEvents ();
+
+            private:
+                /// \brief
+                /// inotify descriptor.
+                int handle;
+                /// \brief
+                /// $TOOLCHAIN_DIR/config (system path).
+                std::string toolchainConfigDirectory;
+                /// \brief
+                /// Watch descriptor -> directory.
+                std::map<int, std::string> directories;
+
+                /// \brief
+                /// Watch the given directory (if not already watched).
+                /// \param[in] directory Directory to watch.
+                void Watch (const std::string &directory);
+
+                /// \brief
+                /// ConfigWatcher is neither copy constructable, nor assignable.
+                THEKOGANS_UTIL_DISALLOW_COPY_AND_ASSIGN (ConfigWatcher)
+            };
+
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
+
+#endif // defined (TOOLCHAIN_OS_Linux)
+
+#endif // !defined (__thekogans_make_core_ConfigWatcher_h)
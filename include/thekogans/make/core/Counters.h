@@ -0,0 +1,160 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#if !defined (__thekogans_make_core_Counters_h)
+#define __thekogans_make_core_Counters_h
+
+#include <atomic>
+#include <string>
+#include <map>
+#include <iostream>
+#include "thekogans/util/Types.h"
+#include "thekogans/make/core/Config.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+
+            /// \struct Counters Counters.h thekogans/make/core/Counters.h
+            ///
+            /// \brief
+            /// Process wide runtime statistics. Counters live in static storage
+            /// and are bumped with relaxed atomic adds, so they can be used on
+            /// hot paths from any thread without locking. Per function call
+            /// counts are kept in a fixed size, open addressed table whose slots
+            /// are claimed with a compare and swap. Setting $THEKOGANS_MAKE_COUNTERS
+            /// to a file path (or '-' for stderr) dumps the counters there at exit.
+            /// Paths ending in .json get a JSON object (see DumpJSON), suitable
+            /// for diffing benchmark runs.
+
+            struct _LIB_THEKOGANS_MAKE_CORE_DECL Counters {
+                /// \enum
+                /// Counter ids.
+                enum Counter {
+                    /// \brief
+                    /// thekogans_make::GetConfig found the config in the cache.
+                    CONFIG_CACHE_HITS,
+                    /// \brief
+                    /// thekogans_make::GetConfig had to load the config.
+                    CONFIG_CACHE_MISSES,
+                    /// \brief
+                    /// thekogans_make::TrimConfigs evicted the config from the cache.
+                    CONFIG_CACHE_EVICTIONS,
+                    /// \brief
+                    /// Bytes of config xml handed to the parser.
+                    XML_BYTES_PARSED,
+                    /// \brief
+                    /// thekogans_make::Eval calls.
+                    EVAL_CALLS,
+                    /// \brief
+                    /// thekogans_make::Expand calls.
+                    EXPAND_CALLS,
+                    /// \brief
+                    /// Tokens scanned by the expression Tokenizer.
+                    TOKENS,
+                    /// \brief
+                    /// thekogans_make::LookupSymbol calls that fell
+                    /// through to the process environment.
+                    ENVIRONMENT_LOOKUPS,
+                    /// \brief
+                    /// File system stats (existence, size and timestamp checks).
+                    FILE_SYSTEM_STATS,
+                    /// \brief
+                    /// Directories read.
+                    FILE_SYSTEM_READDIRS,
+                    /// \brief
+                    /// Files copied by CopyFile(s) (links are not counted).
+                    FILES_COPIED,
+                    /// \brief
+                    /// Bytes copied by CopyFile(s).
+                    BYTES_COPIED,
+                    /// \brief
+                    /// Files hashed by GetFileHash(es) (cache hits are not counted).
+                    FILES_HASHED,
+                    /// \brief
+                    /// Bytes hashed by GetFileHash(es).
+                    BYTES_HASHED,
+                    /// \brief
+                    /// Bytes received from source servers (Source.xml and archives).
+                    BYTES_DOWNLOADED,
+                    /// \brief
+                    /// Source project/toolchain lookups (each is a linear
+                    /// scan of the organization's Source.xml entries).
+                    SOURCE_LOOKUPS,
+                    /// \brief
+                    /// Heap allocations. The library can't count these
+                    /// itself. A host program that replaces the global
+                    /// operator new bumps it (see examples/benchmark).
+                    ALLOCATIONS,
+                    /// \brief
+                    /// Number of counters.
+                    COUNTER_COUNT
+                };
+
+                /// \brief
+                /// Return the counter name (used by Dump).
+                /// \param[in] counter Counter id.
+                /// \return Counter name.
+                static const char *GetName (Counter counter);
+
+                /// \brief
+                /// Add value to the given counter.
+                /// \param[in] counter Counter id.
+                /// \param[in] value Value to add.
+                static void Increment (
+                    Counter counter,
+                    util::ui64 value = 1);
+                /// \brief
+                /// Return the current value of the given counter.
+                /// \param[in] counter Counter id.
+                /// \return Current value of the given counter.
+                static util::ui64 Get (Counter counter);
+
+                /// \brief
+                /// Count a Function::Exec call.
+                /// \param[in] name Function name.
+                static void IncrementFunction (const std::string &name);
+                /// \brief
+                /// Return the number of times the given function was called.
+                /// \param[in] name Function name.
+                /// \return Number of times the given function was called.
+                static util::ui64 GetFunction (const std::string &name);
+                /// \brief
+                /// Return the call counts of all functions called so far.
+                /// \param[out] functions Function name -> call count.
+                static void GetFunctions (std::map<std::string, util::ui64> &functions);
+
+                /// \brief
+                /// Zero all counters (function names are kept).
+                static void Reset ();
+
+                /// \brief
+                /// Write the counters out in 'name value' form, one per line.
+                /// \param[in] stream Where to write the counters.
+                static void Dump (std::ostream &stream);
+                /// \brief
+                /// Write the counters out as a flat JSON object
+                /// ({"name": value, "function_calls.name": value, ...}).
+                /// \param[in] stream Where to write the counters.
+                static void DumpJSON (std::ostream &stream);
+            };
+
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
+
+#endif // !defined (__thekogans_make_core_Counters_h)
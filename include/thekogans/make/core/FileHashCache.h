@@ -0,0 +1,152 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#if !defined (__thekogans_make_core_FileHashCache_h)
+#define __thekogans_make_core_FileHashCache_h
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include "thekogans/util/Types.h"
+#include "thekogans/util/Singleton.h"
+#include "thekogans/util/SpinLock.h"
+#include "thekogans/make/core/Config.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+
+            /// \struct FileHashCache FileHashCache.h thekogans/make/core/FileHashCache.h
+            ///
+            /// \brief
+            /// A persistent cache of file SHA2-256 hashes. Entries are keyed by
+            /// file identity (device and inode) and validated against size,
+            /// modification and change times (in nanoseconds), so a file is only
+            /// rehashed when its contents change. The cache lives in a sidecar
+            /// file ($THEKOGANS_MAKE_FILE_HASH_CACHE or
+            /// $TOOLCHAIN_ROOT/.thekogans_make_file_hashes). New entries are
+            /// appended, and the file is compacted when stale entries outnumber
+            /// live ones.
+
+            struct _LIB_THEKOGANS_MAKE_CORE_DECL FileHashCache {
+                /// \brief
+                /// Sidecar file path (empty = in memory only).
+                std::string path;
+
+                /// \brief
+                /// ctor.
+                /// \param[in] path_ Sidecar file path.
+                explicit FileHashCache (const std::string &path_ = GetDefaultPath ()) :
+                    path (path_),
+                    loaded (false),
+                    records (0) {}
+
+                /// \brief
+                /// Return $THEKOGANS_MAKE_FILE_HASH_CACHE or
+                /// $TOOLCHAIN_ROOT/.thekogans_make_file_hashes.
+                /// \return Sidecar file path.
+                static std::string GetDefaultPath ();
+
+                /// \brief
+                /// Return the SHA2-256 of the given file, hashing it only if
+                /// the cache does not have a valid entry for it.
+                /// \param[in] filePath File to hash (system path).
+                /// \return Hex encoded SHA2-256.
+                std::string GetHash (const std::string &filePath);
+                /// \brief
+                /// Return the SHA2-256 of a batch of files. Cache misses are
+                /// hashed concurrently on a pool of worker threads.
+                /// \param[in] filePaths Files to hash (system paths).
+                /// \param[out] hashes Hex encoded SHA2-256 of each file (in
+                /// filePaths order).
+                /// \param[in] workerCount Max worker threads (0 = one per core).
+                void GetHashes (
+                    const std::vector<std::string> &filePaths,
+                    std::vector<std::string> &hashes,
+                    util::ui32 workerCount = 0);
+
+            private:
+                /// \struct FileHashCache::Entry FileHashCache.h thekogans/make/core/FileHashCache.h
+                ///
+                /// \brief
+                /// What the hash was computed against.
+                struct Entry {
+                    util::ui64 size;
+                    util::ui64 mtime;
+                    util::ui64 ctime;
+                    std::string hash;
+
+                    Entry () :
+                        size (0),
+                        mtime (0),
+                        ctime (0) {}
+                    Entry (
+                        util::ui64 size_,
+                        util::ui64 mtime_,
+                        util::ui64 ctime_,
+                        const std::string &hash_) :
+                        size (size_),
+                        mtime (mtime_),
+                        ctime (ctime_),
+                        hash (hash_) {}
+
+                    inline bool Matches (const Entry &entry) const {
+                        return size == entry.size &&
+                            mtime == entry.mtime &&
+                            ctime == entry.ctime;
+                    }
+                };
+                /// \brief
+                /// Maps file identity to Entry.
+                std::unordered_map<std::string, Entry> entries;
+                /// \brief
+                /// true = sidecar file was read.
+                bool loaded;
+                /// \brief
+                /// Number of records in the sidecar file (including stale ones).
+                std::size_t records;
+                /// \brief
+                /// Synchronize access to entries, loaded and records. A mutex
+                /// (not a spin lock) as the first GetHash loads the sidecar
+                /// file while holding it.
+                std::mutex mutex;
+
+                /// \brief
+                /// Read the sidecar file, compacting it if needed.
+                void Load ();
+                /// \brief
+                /// Rewrite the sidecar file with only the live entries.
+                void Compact ();
+                /// \brief
+                /// Append a record to the sidecar file. Called without
+                /// holding the mutex.
+                /// \param[in] record Record to append (see FormatRecord).
+                void Append (const std::string &record);
+
+                /// \brief
+                /// FileHashCache is neither copy constructable, nor assignable.
+                THEKOGANS_UTIL_DISALLOW_COPY_AND_ASSIGN (FileHashCache)
+            };
+
+            using ToolchainFileHashCache = util::Singleton<FileHashCache, util::SpinLock>;
+
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
+
+#endif // !defined (__thekogans_make_core_FileHashCache_h)
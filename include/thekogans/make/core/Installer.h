@@ -33,17 +33,22 @@ namespace thekogans {
                 std::string type;
                 bool hide_commands;
                 bool parallel_build;
+                // true = don't uninstall the previous install. Copy only
+                // new and changed files and delete stale ones (see SyncInstall).
+                bool incremental;
                 std::set<std::string> installedProjects;
 
                 Installer (
                     const std::string &config_,
                     const std::string &type_,
                     bool hide_commands_,
-                    bool parallel_build_) :
+                    bool parallel_build_,
+                    bool incremental_ = false) :
                     config (config_),
                     type (type_),
                     hide_commands (hide_commands_),
-                    parallel_build (parallel_build_) {}
+                    parallel_build (parallel_build_),
+                    incremental (incremental_) {}
 
                 void InstallLibrary (const std::string &project_root);
                 void InstallProgram (const std::string &project_root);
@@ -29,12 +29,44 @@ namespace thekogans {
     namespace make {
         namespace core {
 
+            /// \struct Manifest Manifest.h thekogans/make/core/Manifest.h
+            ///
+            /// \brief
+            /// Keeps track of which goals depend on the files copied in to a
+            /// bin directory. The manifest is stored as an append only journal
+            /// (one "+\tfile\tdependent" or "-\tfile\tdependent" record per
+            /// change) next to the legacy thekogans_manifest.xml. Tabs, newlines
+            /// and backslashes in file and dependent names are escaped (\t, \n,
+            /// \r and \\). Save appends the records accumulated since the last
+            /// Save, and the journal is compacted (rewritten with live records
+            /// only) once most of it is garbage. A legacy xml manifest is read
+            /// if no journal exists. The first Save writes the journal next to
+            /// it, and from then on the journal takes precedence. The xml file
+            /// is left in place for older tools. Writers (Save)
+            /// from different processes serialize on a .lock file next to the
+            /// journal.
+
             struct _LIB_THEKOGANS_MAKE_CORE_DECL Manifest {
             private:
                 std::string path;
+                /// \brief
+                /// Journal path (path with the extension replaced by .journal).
+                std::string journalPath;
                 using Dependents = std::unordered_set<std::string>;
                 using Files = std::unordered_map<std::string, Dependents>;
                 Files files;
+                /// \brief
+                /// Number of (file, dependent) pairs in files.
+                std::size_t liveRecords;
+                /// \brief
+                /// Number of records in the journal file.
+                std::size_t journalRecords;
+                /// \brief
+                /// Records not yet appended to the journal.
+                std::string pendingRecords;
+                /// \brief
+                /// true = the manifest was read from the legacy xml file.
+                bool legacy;
                 bool modified;
 
             public:
@@ -66,10 +98,26 @@ namespace thekogans {
                     const std::string &dependent);
 
                 /// \brief
-                /// Save the manifest to the file.
+                /// Append the changes made since the last Save to the journal
+                /// (compacting it if needed).
                 void Save ();
 
             private:
+                /// \brief
+                /// Replay the journal.
+                void LoadJournal ();
+                /// \brief
+                /// Apply the complete (newline terminated) records.
+                /// \param[in] records Records to apply.
+                void ReplayRecords (const std::string &records);
+                /// \brief
+                /// Load the legacy xml manifest.
+                /// \param[in] maxManifestFileSize Max xml file size.
+                void LoadXML (util::ui64 maxManifestFileSize);
+                /// \brief
+                /// Rewrite the journal with live records only (including
+                /// any appended by other processes since it was loaded).
+                void Compact ();
                 /// \brief
                 /// Parse the manifest tag.
                 /// \param[in] node Root node.
@@ -0,0 +1,119 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#if !defined (__thekogans_make_core_OrderedSet_h)
+#define __thekogans_make_core_OrderedSet_h
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <unordered_set>
+#include "thekogans/make/core/Config.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+
+            /// \struct OrderedSet OrderedSet.h thekogans/make/core/OrderedSet.h
+            ///
+            /// \brief
+            /// A list that remembers what's in it. Items keep their insertion
+            /// order (like a std::list), while membership tests are O(1) (like
+            /// a std::unordered_set). Used in place of std::find over a
+            /// std::list when aggregating values over the dependency graph.
+
+            template<
+                typename T,
+                typename Hash = std::hash<T>>
+            struct OrderedSet {
+                using Items = std::list<T>;
+                using const_iterator = typename Items::const_iterator;
+
+            private:
+                /// \brief
+                /// Items in insertion order.
+                Items items;
+                /// \brief
+                /// Index of items.
+                std::unordered_set<T, Hash> index;
+
+            public:
+                /// \brief
+                /// ctor.
+                OrderedSet () {}
+                /// \brief
+                /// ctor. Items are taken as is (duplicates included),
+                /// and only items inserted later are de-duplicated.
+                /// \param[in] items_ Initial items.
+                explicit OrderedSet (const Items &items_) :
+                    items (items_),
+                    index (items_.begin (), items_.end ()) {}
+
+                /// \brief
+                /// Append the given item if it's not already in the set.
+                /// \param[in] item Item to append.
+                /// \return true = item was appended, false = item was already in the set.
+                bool Insert (const T &item) {
+                    if (index.insert (item).second) {
+                        items.push_back (item);
+                        return true;
+                    }
+                    return false;
+                }
+                /// \brief
+                /// Return true if the given item is in the set.
+                /// \param[in] item Item to look for.
+                /// \return true if the given item is in the set.
+                bool Contains (const T &item) const {
+                    return index.find (item) != index.end ();
+                }
+
+                /// \brief
+                /// Return the items in insertion order.
+                /// \return Items in insertion order.
+                const Items &GetItems () const {
+                    return items;
+                }
+                /// \brief
+                /// Swap the items out in to the given list and clear the set.
+                /// \param[out] items_ Where to put the items.
+                void Release (Items &items_) {
+                    items_.swap (items);
+                    items.clear ();
+                    index.clear ();
+                }
+
+                std::size_t Size () const {
+                    return items.size ();
+                }
+                bool IsEmpty () const {
+                    return items.empty ();
+                }
+
+                const_iterator begin () const {
+                    return items.begin ();
+                }
+                const_iterator end () const {
+                    return items.end ();
+                }
+            };
+
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
+
+#endif // !defined (__thekogans_make_core_OrderedSet_h)
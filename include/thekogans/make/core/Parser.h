@@ -32,6 +32,9 @@ namespace thekogans {
 
             struct _LIB_THEKOGANS_MAKE_CORE_DECL Tokenizer {
                 const char *expression;
+                // Computed once. Function calls need the length
+                // of what's left, and expressions can be long.
+                const char *end;
                 const thekogans_make &config;
                 struct Token {
                     enum Type {
@@ -0,0 +1,249 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#if !defined (__thekogans_make_core_Profiler_h)
+#define __thekogans_make_core_Profiler_h
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+#include "pugixml/pugixml.hpp"
+#include "thekogans/util/Types.h"
+#include "thekogans/util/Singleton.h"
+#include "thekogans/util/SpinLock.h"
+#include "thekogans/make/core/Config.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+
+            /// \struct Profiler Profiler.h thekogans/make/core/Profiler.h
+            ///
+            /// \brief
+            /// Attributes config load time to the thekogans_make.xml elements
+            /// (keyed by file and line), conditions (Eval), templates (Expand)
+            /// and $(function) calls that consumed it. Times are inclusive (an
+            /// <if> includes the Eval of its condition and everything it
+            /// contains). Every entry also records the number of Eval/Expand
+            /// calls and heap allocations made on its behalf. Allocations are
+            /// read from Counters::ALLOCATIONS, which is only bumped if the host
+            /// program replaces the global operator new. Profiling is off (and Scopes cost an
+            /// atomic load) unless $THEKOGANS_MAKE_PROFILE is set to a file path
+            /// (or '-' for stderr), in which case a report, sorted by total time,
+            /// is written there at exit.
+
+            struct _LIB_THEKOGANS_MAKE_CORE_DECL Profiler {
+                /// \struct Profiler::Entry Profiler.h thekogans/make/core/Profiler.h
+                ///
+                /// \brief
+                /// Accumulated cost of an element or expression.
+                struct Entry {
+                    /// \brief
+                    /// element, eval, expand or function.
+                    std::string kind;
+                    /// \brief
+                    /// file:line for elements, empty for expressions.
+                    std::string location;
+                    /// \brief
+                    /// Element tag, expression text or function name.
+                    std::string name;
+                    /// \brief
+                    /// Number of times the element/expression was evaluated.
+                    util::ui64 calls;
+                    /// \brief
+                    /// Total time in nanoseconds.
+                    util::ui64 time;
+                    /// \brief
+                    /// Number of Eval/Expand calls made on its behalf.
+                    util::ui64 expressions;
+                    /// \brief
+                    /// Number of heap allocations made on its behalf.
+                    util::ui64 allocations;
+
+                    Entry () :
+                        calls (0),
+                        time (0),
+                        expressions (0),
+                        allocations (0) {}
+                };
+
+                /// \struct Profiler::Scope Profiler.h thekogans/make/core/Profiler.h
+                ///
+                /// \brief
+                /// Charges the time spent in the enclosing scope to an entry.
+                struct _LIB_THEKOGANS_MAKE_CORE_DECL Scope {
+                    /// \brief
+                    /// ctor. Profile an element. Nested Scopes for the
+                    /// same element (a top level <if> is seen both by the
+                    /// ctor and by ParseDefault) are ignored.
+                    /// \param[in] file Config file the element came from
+                    /// (as passed to Profiler::AddFile).
+                    /// \param[in] node Element to profile.
+                    Scope (
+                        const std::string &file,
+                        const pugi::xml_node &node);
+                    /// \brief
+                    /// ctor. Profile an expression.
+                    /// \param[in] kind_ eval, expand or function.
+                    /// \param[in] name_ Expression text or function name.
+                    Scope (
+                        const char *kind_,
+                        const std::string &name_);
+                    /// \brief
+                    /// dtor. Charge the entry.
+                    ~Scope ();
+
+                private:
+                    /// \brief
+                    /// false = profiling was off when the Scope was created.
+                    bool enabled;
+                    /// \brief
+                    /// Entry kind.
+                    const char *kind;
+                    /// \brief
+                    /// Entry location.
+                    std::string location;
+                    /// \brief
+                    /// Entry name.
+                    std::string name;
+                    /// \brief
+                    /// Start time.
+                    util::ui64 start;
+                    /// \brief
+                    /// Eval/Expand count at start.
+                    util::ui64 expressions;
+                    /// \brief
+                    /// Allocation count at start.
+                    util::ui64 allocations;
+                    /// \brief
+                    /// Innermost element being profiled when the Scope was created.
+                    pugi::xml_node_struct *previousElement;
+
+                    /// \brief
+                    /// Scope is neither copy constructable, nor assignable.
+                    THEKOGANS_UTIL_DISALLOW_COPY_AND_ASSIGN (Scope)
+                };
+
+                /// \brief
+                /// ctor. Enables profiling if $THEKOGANS_MAKE_PROFILE is set.
+                Profiler ();
+
+                /// \brief
+                /// Return true if profiling is on.
+                /// \return true if profiling is on.
+                inline bool IsEnabled () const {
+                    return enabled;
+                }
+
+                /// \brief
+                /// Remember where the lines of a config file start, so
+                /// that element offsets can be reported as line numbers.
+                /// \param[in] file Config file path.
+                /// \param[in] buffer Config file contents.
+                /// \param[in] length Config file length.
+                void AddFile (
+                    const std::string &file,
+                    const char *buffer,
+                    std::size_t length);
+                /// \brief
+                /// Convert an element offset to a line number.
+                /// \param[in] file Config file path.
+                /// \param[in] offset Element offset (pugi::xml_node::offset_debug).
+                /// \return 1 based line number (0 = unknown).
+                util::ui32 GetLine (
+                    const std::string &file,
+                    std::ptrdiff_t offset) const;
+
+                /// \brief
+                /// Charge an entry.
+                /// \param[in] kind Entry kind.
+                /// \param[in] location Entry location.
+                /// \param[in] name Entry name.
+                /// \param[in] time Time spent (nanoseconds).
+                /// \param[in] expressions Eval/Expand calls made.
+                /// \param[in] allocations Heap allocations made.
+                void Add (
+                    const char *kind,
+                    const std::string &location,
+                    const std::string &name,
+                    util::ui64 time,
+                    util::ui64 expressions,
+                    util::ui64 allocations);
+
+                /// \brief
+                /// Return the accumulated entries, hottest first.
+                /// \param[out] entries Accumulated entries.
+                void GetEntries (std::vector<Entry> &entries) const;
+                /// \brief
+                /// Write the report.
+                /// \param[in] stream Where to write the report.
+                /// \param[in] count Max number of entries to write (0 = all).
+                void Report (
+                    std::ostream &stream,
+                    std::size_t count = 0) const;
+
+            private:
+                /// \brief
+                /// true = $THEKOGANS_MAKE_PROFILE is set.
+                bool enabled;
+                /// \brief
+                /// Where the report goes.
+                std::string path;
+                /// \brief
+                /// Config file -> line start offsets.
+                std::unordered_map<std::string, std::vector<std::ptrdiff_t>> files;
+                /// \brief
+                /// kind, location and name -> accumulated cost.
+                std::unordered_map<std::string, Entry> entries;
+                /// \brief
+                /// Synchronize access to files and entries.
+                mutable util::SpinLock spinLock;
+
+                /// \brief
+                /// Write the report to path (called at exit).
+                static void WriteReport ();
+
+                /// \brief
+                /// Profiler is neither copy constructable, nor assignable.
+                THEKOGANS_UTIL_DISALLOW_COPY_AND_ASSIGN (Profiler)
+            };
+
+            using ToolchainProfiler = util::Singleton<Profiler, util::SpinLock>;
+
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
+
+/// \def THEKOGANS_MAKE_CORE_PROFILE_ELEMENT(file, node)
+/// Charge the rest of the enclosing scope to the given element.
+/// file is only evaluated if profiling is enabled.
+#define THEKOGANS_MAKE_CORE_PROFILE_ELEMENT(file, node)\
+    thekogans::make::core::Profiler::Scope profilerScope (\
+        thekogans::make::core::ToolchainProfiler::Instance ()->IsEnabled () ?\
+            std::string (file) : std::string (), node)
+
+/// \def THEKOGANS_MAKE_CORE_PROFILE_EXPRESSION(kind, name)
+/// Charge the rest of the enclosing scope to the given expression.
+/// name is only evaluated if profiling is enabled.
+#define THEKOGANS_MAKE_CORE_PROFILE_EXPRESSION(kind, name)\
+    thekogans::make::core::Profiler::Scope profilerScope (\
+        kind,\
+        thekogans::make::core::ToolchainProfiler::Instance ()->IsEnabled () ?\
+            std::string (name) : std::string ())
+
+#endif // !defined (__thekogans_make_core_Profiler_h)
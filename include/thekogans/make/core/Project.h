@@ -87,6 +87,20 @@ namespace thekogans {
                     const std::string &organization,
                     const std::string &project,
                     const std::string &branch);
+            #if defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
+                /// \brief
+                /// Walk the dependency graph rooted at project_root level by
+                /// level and fetch all missing source projects of each level
+                /// concurrently. Only unconditional, literal (no $(...)) project
+                /// dependencies are considered. Anything missed here is still
+                /// resolved (synchronously) by Find. Each call walks the graph
+                /// afresh, so projects whose fetch failed, or whose configs were
+                /// dropped from the cache, are retried. thekogans_make::GetConfig
+                /// calls it once per top level load, not for the dependency
+                /// loads nested in it.
+                /// \param[in] project_root Root of the graph to prefetch.
+                static void Prefetch (const std::string &project_root);
+            #endif // defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
             };
 
         } // namespace core
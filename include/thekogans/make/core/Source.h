@@ -53,6 +53,8 @@ namespace thekogans {
                 static const char * const ATTR_VERSION;
                 static const char * const ATTR_FILE;
                 static const char * const ATTR_SHA2_256;
+                static const char * const ATTR_ETAG;
+                static const char * const ATTR_LAST_MODIFIED;
 
                 static const char * const TAG_SOURCE;
                 static const char * const TAG_PROJECT;
@@ -61,6 +63,11 @@ namespace thekogans {
                 std::string organization;
                 std::string url;
                 std::string schema_version;
+                /// \brief
+                /// HTTP validators returned with the last Source.xml
+                /// download. Used to issue conditional GET requests.
+                std::string etag;
+                std::string last_modified;
                 struct Project {
                     using Ptr = std::unique_ptr<Project>;
 
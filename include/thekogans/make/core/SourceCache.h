@@ -0,0 +1,202 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#if !defined (__thekogans_make_core_SourceCache_h)
+#define __thekogans_make_core_SourceCache_h
+
+#include <string>
+#include <set>
+#include <mutex>
+#include "thekogans/util/Types.h"
+#include "thekogans/util/Singleton.h"
+#include "thekogans/util/SpinLock.h"
+#include "thekogans/make/core/Config.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+
+            /// \struct SourceCache SourceCache.h thekogans/make/core/SourceCache.h
+            ///
+            /// \brief
+            /// A content addressed store of source project and toolchain archives.
+            /// Archives are keyed by the SHA2-256 recorded in Source.xml, so an
+            /// archive fetched once (in any workspace sharing the cache) is never
+            /// fetched again. The cache location defaults to $TOOLCHAIN_ROOT/sources/cache
+            /// and can be overridden with $THEKOGANS_MAKE_SOURCE_CACHE. The cache size
+            /// is bounded by $THEKOGANS_MAKE_SOURCE_CACHE_MAX_SIZE (bytes, K, M and G
+            /// suffixes are accepted). Least recently used archives are evicted first.
+
+            struct _LIB_THEKOGANS_MAKE_CORE_DECL SourceCache {
+                /// \brief
+                /// Default max cache size (4GB).
+                static const util::ui64 DEFAULT_MAX_SIZE;
+
+                /// \brief
+                /// Cache root directory.
+                std::string path;
+                /// \brief
+                /// Max cache size in bytes (0 = unbounded).
+                util::ui64 maxSize;
+
+                /// \brief
+                /// ctor.
+                /// \param[in] path_ Cache root directory.
+                /// \param[in] maxSize_ Max cache size in bytes (0 = unbounded).
+                SourceCache (
+                    const std::string &path_ = GetDefaultPath (),
+                    util::ui64 maxSize_ = GetDefaultMaxSize ()) :
+                    path (path_),
+                    maxSize (maxSize_),
+                    trimHolds (0),
+                    trimPending (false),
+                    size (0),
+                    sizeKnown (false) {}
+
+                /// \brief
+                /// Return the cache root ($THEKOGANS_MAKE_SOURCE_CACHE or
+                /// $TOOLCHAIN_ROOT/sources/cache).
+                /// \return Cache root.
+                static std::string GetDefaultPath ();
+                /// \brief
+                /// Return the max cache size ($THEKOGANS_MAKE_SOURCE_CACHE_MAX_SIZE
+                /// or DEFAULT_MAX_SIZE).
+                /// \return Max cache size.
+                static util::ui64 GetDefaultMaxSize ();
+
+                /// \brief
+                /// Return the path where an archive with the given hash lives.
+                /// Throws unless SHA2_256 is 64 hex digits, so a hash read from
+                /// Source.xml can't name a path outside the cache.
+                /// \param[in] SHA2_256 Archive hash.
+                /// \return Archive path (the archive might not exist).
+                std::string GetArchivePath (const std::string &SHA2_256) const;
+                /// \brief
+                /// Return a unique temporary path inside the cache. Files written
+                /// there can be atomically committed with Commit.
+                /// \param[in] SHA2_256 Hash of the archive that will be written.
+                /// \return Temporary path.
+                std::string GetTempPath (const std::string &SHA2_256) const;
+
+                /// \brief
+                /// Lookup an archive. If found, it's marked as most recently used.
+                /// \param[in] SHA2_256 Archive hash.
+                /// \return Archive path if found, empty string if not.
+                std::string Lookup (const std::string &SHA2_256) const;
+                /// \brief
+                /// Verify the hash of a file written to GetTempPath and atomically
+                /// move it in to the cache. On hash mismatch the file is deleted
+                /// and an exception is thrown.
+                /// \param[in] tempPath File returned by GetTempPath.
+                /// \param[in] SHA2_256 Expected hash.
+                /// \param[in] verify false = the caller already hashed the file
+                /// while writing it (streaming fetch), skip rehashing.
+                /// \return Archive path.
+                std::string Commit (
+                    const std::string &tempPath,
+                    const std::string &SHA2_256,
+                    bool verify = true);
+                /// \brief
+                /// Copy a (verified) file in to the cache.
+                /// \param[in] filePath File to copy.
+                /// \param[in] SHA2_256 Expected hash.
+                /// \return Archive path.
+                std::string Insert (
+                    const std::string &filePath,
+                    const std::string &SHA2_256);
+                /// \brief
+                /// Expose a cached archive the way a source server does
+                /// ($url/$organization/$archiveName) and return a file:// url
+                /// suitable for passing to the source install scripts.
+                /// \param[in] SHA2_256 Archive hash.
+                /// \param[in] organization Source organization.
+                /// \param[in] archiveName Archive file name.
+                /// \return file:// url of the view root.
+                std::string GetURL (
+                    const std::string &SHA2_256,
+                    const std::string &organization,
+                    const std::string &archiveName) const;
+
+                /// \brief
+                /// Evict least recently used archives until the cache fits in maxSize.
+                /// While a DeferTrim is alive, the eviction is postponed until
+                /// the last one goes away. The cache is only scanned when its
+                /// (running) size is unknown or over maxSize.
+                /// \param[in] SHA2_256 If not empty, the archive (just committed
+                /// and about to be used by the caller) to never evict.
+                void Trim (const std::string &SHA2_256 = std::string ());
+
+                /// \struct SourceCache::DeferTrim SourceCache.h thekogans/make/core/SourceCache.h
+                ///
+                /// \brief
+                /// Keeps Trim from evicting archives while other threads might
+                /// be between a Lookup and their use of the archive (see
+                /// Project::Prefetch). The last DeferTrim to go away performs
+                /// any Trim requested in the mean time.
+                struct _LIB_THEKOGANS_MAKE_CORE_DECL DeferTrim {
+                    /// \brief
+                    /// Cache whose trimming is deferred.
+                    SourceCache &cache;
+
+                    /// \brief
+                    /// ctor.
+                    /// \param[in] cache_ Cache whose trimming to defer.
+                    explicit DeferTrim (SourceCache &cache_);
+                    /// \brief
+                    /// dtor. Perform the pending Trim (if any).
+                    ~DeferTrim ();
+
+                    /// \brief
+                    /// DeferTrim is neither copy constructable, nor assignable.
+                    THEKOGANS_UTIL_DISALLOW_COPY_AND_ASSIGN (DeferTrim)
+                };
+
+            private:
+                /// \brief
+                /// Serializes Lookup, Commit, GetURL and Trim.
+                mutable std::mutex mutex;
+                /// \brief
+                /// Number of live DeferTrim.
+                std::size_t trimHolds;
+                /// \brief
+                /// true = Trim was called while trimHolds > 0.
+                bool trimPending;
+                /// \brief
+                /// Archives Trim was asked to keep while it was deferred.
+                std::set<std::string> trimKeep;
+                /// \brief
+                /// Size of the cached archives as of the last scan, plus
+                /// what was committed since.
+                util::ui64 size;
+                /// \brief
+                /// false = the cache hasn't been scanned yet.
+                bool sizeKnown;
+
+            public:
+
+                /// \brief
+                /// SourceCache is neither copy constructable, nor assignable.
+                THEKOGANS_UTIL_DISALLOW_COPY_AND_ASSIGN (SourceCache)
+            };
+
+            using ToolchainSourceCache = util::Singleton<SourceCache, util::SpinLock>;
+
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
+
+#endif // !defined (__thekogans_make_core_SourceCache_h)
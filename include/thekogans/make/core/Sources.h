@@ -21,8 +21,10 @@
 #include <memory>
 #include <string>
 #include <list>
+#include <vector>
 #include <set>
 #include "pugixml/pugixml.hpp"
+#include "thekogans/util/Types.h"
 #include "thekogans/util/Heap.h"
 #include "thekogans/util/Singleton.h"
 #include "thekogans/util/StringUtils.h"
@@ -46,6 +48,13 @@ namespace thekogans {
                 static const char * const ATTR_SCHEMA_VERSION;
                 static const char * const TAG_SOURCES;
 
+                enum {
+                    /// \brief
+                    /// Default max number of concurrent connections
+                    /// used by UpdateSources.
+                    DEFAULT_MAX_CONNECTIONS = 8
+                };
+
                 std::string sourcesFilePath;
                 std::string schema_version;
                 std::list<Source::Ptr> sources;
@@ -55,7 +64,16 @@ namespace thekogans {
 
                 void ListSources () const;
             #if defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
-                void UpdateSources (const std::string &organization);
+                /// \brief
+                /// Update the given source (or all sources if organization is empty).
+                /// When updating all sources, Source.xml files are fetched concurrently
+                /// using conditional GET requests (ETag/Last-Modified) so that sources
+                /// that did not change are not downloaded again.
+                /// \param[in] organization Source to update (empty = all).
+                /// \param[in] maxConnections Max number of concurrent connections.
+                void UpdateSources (
+                    const std::string &organization,
+                    util::ui32 maxConnections = DEFAULT_MAX_CONNECTIONS);
             #endif // defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
 
                 void GetSources (std::set<std::string> &sources) const;
@@ -124,8 +142,38 @@ namespace thekogans {
 
             private:
                 Source *GetSource (const std::string &organization) const;
+                /// \brief
+                /// Return the url the install scripts should fetch the given
+                /// archive from. If the archive is (or can be put) in the
+                /// SourceCache, a file:// url to the cached copy is returned.
+                /// Otherwise, the source url is returned.
+                /// \param[in] source Source the archive comes from.
+                /// \param[in] archiveName Archive file name.
+                /// \param[in] SHA2_256 Archive hash (from Source.xml).
+                /// \return Url to pass to the install scripts.
+                std::string GetArchiveURL (
+                    const Source &source,
+                    const std::string &archiveName,
+                    const std::string &SHA2_256) const;
             #if defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
+                /// \brief
+                /// Download (or read from the SourceCache), verify and extract a
+                /// source project in one streaming pass. The project is extracted
+                /// in to a staging directory which is renamed in to place only if
+                /// the archive hash matches the one recorded in Source.xml.
+                /// \param[in] source Source the project comes from.
+                /// \param[in] project Project to fetch.
+                void FetchSourceProject (
+                    const Source &source,
+                    const Source::Project &project) const;
                 void UpdateSource (Source &source);
+                void UpdateSources (
+                    const std::list<Source *> &sources_,
+                    util::ui32 maxConnections);
+                void ParseSource (
+                    Source &source,
+                    const std::string &sourceUrl,
+                    const std::vector<util::ui8> &buffer);
             #endif // defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
                 void Save () const;
 
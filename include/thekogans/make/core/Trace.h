@@ -0,0 +1,247 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#if !defined (__thekogans_make_core_Trace_h)
+#define __thekogans_make_core_Trace_h
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "thekogans/util/Types.h"
+#include "thekogans/util/Singleton.h"
+#include "thekogans/util/SpinLock.h"
+#include "thekogans/make/core/Config.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+
+            /// \struct Trace Trace.h thekogans/make/core/Trace.h
+            ///
+            /// \brief
+            /// Build event hooks. Interesting phases of a build (config loads,
+            /// dependency resolution, generator runs, gnu_make invocations,
+            /// copies, installs and downloads) are bracketed by Spans. Every
+            /// completed Span is handed to the registered Sinks. Tracing is off
+            /// (and Spans cost an atomic load) until a Sink is added. Setting
+            /// $THEKOGANS_MAKE_TRACE to a file path registers a ChromeTraceSink
+            /// that writes the trace there at exit.
+
+            struct _LIB_THEKOGANS_MAKE_CORE_DECL Trace {
+                /// \struct Trace::Event Trace.h thekogans/make/core/Trace.h
+                ///
+                /// \brief
+                /// A completed span or an instant event.
+                struct Event {
+                    /// \brief
+                    /// Event category (config, dependencies, closure, generator,
+                    /// make, build, copy, hash, manifest, install, download).
+                    std::string category;
+                    /// \brief
+                    /// Event name (usually the path or url being worked on).
+                    std::string name;
+                    /// \brief
+                    /// Start time (microseconds since the Trace was created).
+                    util::ui64 start;
+                    /// \brief
+                    /// Duration in microseconds.
+                    util::ui64 duration;
+                    /// \brief
+                    /// Thread that produced the event.
+                    util::ui64 threadId;
+                    /// \brief
+                    /// true = instant event (duration is ignored).
+                    bool instant;
+
+                    Event () :
+                        start (0),
+                        duration (0),
+                        threadId (0),
+                        instant (false) {}
+                };
+
+                /// \struct Trace::Sink Trace.h thekogans/make/core/Trace.h
+                ///
+                /// \brief
+                /// Derive from Sink to receive build events. OnEvent
+                /// is called from whichever thread completed the span.
+                struct _LIB_THEKOGANS_MAKE_CORE_DECL Sink {
+                    /// \brief
+                    /// dtor.
+                    virtual ~Sink () {}
+
+                    /// \brief
+                    /// Called for every completed event.
+                    /// \param[in] event Completed event.
+                    virtual void OnEvent (const Event &event) = 0;
+                    /// \brief
+                    /// Called by Trace::Flush (and at exit).
+                    virtual void Flush () {}
+                };
+
+                /// \struct Trace::Span Trace.h thekogans/make/core/Trace.h
+                ///
+                /// \brief
+                /// Scoped span. The event is emitted when the Span goes out of scope.
+                struct _LIB_THEKOGANS_MAKE_CORE_DECL Span {
+                    /// \brief
+                    /// ctor.
+                    /// \param[in] category_ Event category.
+                    /// \param[in] name_ Event name.
+                    Span (
+                        const char *category_,
+                        const std::string &name_);
+                    /// \brief
+                    /// dtor. Emit the event.
+                    ~Span ();
+
+                private:
+                    /// \brief
+                    /// false = tracing was off when the Span was created.
+                    bool enabled;
+                    /// \brief
+                    /// Event category.
+                    const char *category;
+                    /// \brief
+                    /// Event name.
+                    std::string name;
+                    /// \brief
+                    /// Start time.
+                    util::ui64 start;
+
+                    /// \brief
+                    /// Span is neither copy constructable, nor assignable.
+                    THEKOGANS_UTIL_DISALLOW_COPY_AND_ASSIGN (Span)
+                };
+
+                /// \brief
+                /// ctor. Registers a ChromeTraceSink if $THEKOGANS_MAKE_TRACE is set.
+                Trace ();
+                /// \brief
+                /// dtor. Flushes and deletes the sinks.
+                ~Trace ();
+
+                /// \brief
+                /// Return true if there is anyone listening.
+                /// \return true if there is anyone listening.
+                inline bool IsEnabled () const {
+                    return enabled.load (std::memory_order_relaxed);
+                }
+
+                /// \brief
+                /// Register an event sink. Trace takes ownership.
+                /// \param[in] sink Sink to register.
+                void AddSink (Sink *sink);
+
+                /// \brief
+                /// Return the number of microseconds since the Trace was created.
+                /// \return Microseconds since the Trace was created.
+                util::ui64 Now () const;
+
+                /// \brief
+                /// Hand an event to all sinks.
+                /// \param[in] event Event to emit.
+                void Emit (const Event &event);
+                /// \brief
+                /// Emit an instant event.
+                /// \param[in] category Event category.
+                /// \param[in] name Event name.
+                void Emit (
+                    const char *category,
+                    const std::string &name);
+
+                /// \brief
+                /// Flush all sinks. Sink errors are logged, not thrown, as
+                /// this is also called at exit.
+                void Flush ();
+
+            private:
+                /// \brief
+                /// true = at least one sink is registered.
+                std::atomic<bool> enabled;
+                /// \brief
+                /// Creation time (steady clock, microseconds).
+                util::ui64 epoch;
+                /// \brief
+                /// Registered sinks.
+                std::vector<Sink *> sinks;
+                /// \brief
+                /// Synchronize access to sinks.
+                util::SpinLock spinLock;
+
+                /// \brief
+                /// Trace is neither copy constructable, nor assignable.
+                THEKOGANS_UTIL_DISALLOW_COPY_AND_ASSIGN (Trace)
+            };
+
+            using ToolchainTrace = util::Singleton<Trace, util::SpinLock>;
+
+            /// \struct ChromeTraceSink Trace.h thekogans/make/core/Trace.h
+            ///
+            /// \brief
+            /// Collects events and writes them out in Chrome Trace Event
+            /// format (JSON). Open the file in chrome://tracing or
+            /// https://ui.perfetto.dev.
+
+            struct _LIB_THEKOGANS_MAKE_CORE_DECL ChromeTraceSink : public Trace::Sink {
+                /// \brief
+                /// ctor.
+                /// \param[in] path_ Where to write the trace.
+                explicit ChromeTraceSink (const std::string &path_) :
+                    path (path_) {}
+
+                /// \brief
+                /// Collect the event.
+                /// \param[in] event Completed event.
+                virtual void OnEvent (const Trace::Event &event);
+                /// \brief
+                /// Write the collected events to path.
+                virtual void Flush ();
+
+            private:
+                /// \brief
+                /// Where to write the trace.
+                std::string path;
+                /// \brief
+                /// Collected events.
+                std::vector<Trace::Event> events;
+                /// \brief
+                /// Synchronize access to events.
+                util::SpinLock spinLock;
+            };
+
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
+
+/// \def THEKOGANS_MAKE_CORE_TRACE_SPAN_NAME(line)
+/// Make the span variable name unique per line, so that
+/// nested scopes can each have their own span.
+#define THEKOGANS_MAKE_CORE_TRACE_SPAN_NAME(line)\
+    THEKOGANS_MAKE_CORE_TRACE_SPAN_NAME_ (line)
+#define THEKOGANS_MAKE_CORE_TRACE_SPAN_NAME_(line) traceSpan##line
+
+/// \def THEKOGANS_MAKE_CORE_TRACE_SPAN(category, name)
+/// Trace the rest of the enclosing scope. name is
+/// only evaluated if tracing is enabled.
+#define THEKOGANS_MAKE_CORE_TRACE_SPAN(category, name)\
+    thekogans::make::core::Trace::Span THEKOGANS_MAKE_CORE_TRACE_SPAN_NAME (__LINE__) (\
+        category,\
+        thekogans::make::core::ToolchainTrace::Instance ()->IsEnabled () ?\
+            std::string (name) : std::string ())
+
+#endif // !defined (__thekogans_make_core_Trace_h)
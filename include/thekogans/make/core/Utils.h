@@ -20,6 +20,8 @@
 
 #include <string>
 #include <list>
+#include <vector>
+#include <utility>
 #include <unordered_set>
 #include <unordered_map>
 #include "thekogans/util/Environment.h"
@@ -208,15 +210,62 @@ namespace thekogans {
             _LIB_THEKOGANS_MAKE_CORE_DECL std::string _LIB_THEKOGANS_MAKE_CORE_API MakePath (
                 const std::list<std::string> &components,
                 bool absolute);
+            // Return the absolute path with symlinks, '.' and '..' resolved,
+            // so that two spellings of the same (system) path compare equal.
+            // If the file is gone, its directory is resolved instead.
+            _LIB_THEKOGANS_MAKE_CORE_DECL std::string _LIB_THEKOGANS_MAKE_CORE_API GetCanonicalPath (
+                const std::string &path);
+            // Parse a size in bytes with an optional (case insensitive) K, M
+            // or G suffix (e.g. "512M"). Throws on anything else.
+            _LIB_THEKOGANS_MAKE_CORE_DECL util::ui64 _LIB_THEKOGANS_MAKE_CORE_API ParseSize (
+                const std::string &size);
 
             _LIB_THEKOGANS_MAKE_CORE_DECL std::string _LIB_THEKOGANS_MAKE_CORE_API GetFileHash (
                 const std::string &path);
+            _LIB_THEKOGANS_MAKE_CORE_DECL void _LIB_THEKOGANS_MAKE_CORE_API GetFileHashes (
+                const std::vector<std::string> &paths,
+                std::vector<std::string> &hashes);
+            // How CopyFile puts a file in its destination. Link modes
+            // fall back to COPY_MODE_COPY when linking is not possible.
+            enum CopyMode {
+                COPY_MODE_COPY,
+                COPY_MODE_HARDLINK,
+                COPY_MODE_SYMLINK
+            };
+            // $THEKOGANS_MAKE_LINK_DEPENDENCIES (hardlink | symlink) lets
+            // development builds link, rather than copy, dependencies in to
+            // project bin directories.
+            _LIB_THEKOGANS_MAKE_CORE_DECL CopyMode _LIB_THEKOGANS_MAKE_CORE_API GetDependenciesCopyMode ();
             _LIB_THEKOGANS_MAKE_CORE_DECL bool _LIB_THEKOGANS_MAKE_CORE_API CopyFile (
                 const std::string &from,
-                const std::string &to);
+                const std::string &to,
+                CopyMode mode = COPY_MODE_COPY,
+                bool preserveTimes = false);
+            // from, to
+            typedef std::pair<std::string, std::string> CopyPaths;
+            // Copy a batch of files. Destination directories are created
+            // once, the files are copied (if out of date) on a pool of
+            // worker threads, and a summary is printed instead of a line
+            // per file. compareContents = true, a file is out of date if its
+            // contents (hash) differ, rather than if it is older than its
+            // source. Returns the number of files copied.
+            _LIB_THEKOGANS_MAKE_CORE_DECL std::size_t _LIB_THEKOGANS_MAKE_CORE_API CopyFiles (
+                const std::vector<CopyPaths> &paths,
+                CopyMode mode = COPY_MODE_COPY,
+                bool preserveTimes = false,
+                bool compareContents = false);
             _LIB_THEKOGANS_MAKE_CORE_DECL bool _LIB_THEKOGANS_MAKE_CORE_API DeleteFile (
                 const std::string &file);
 
+            // Incremental alternative to Uninstall + CopyFiles. Files of the
+            // installed version that are not in paths are deleted, and only
+            // new or changed (by content) files are copied. Unchanged files
+            // keep their timestamps, so dependents are not rebuilt.
+            _LIB_THEKOGANS_MAKE_CORE_DECL void _LIB_THEKOGANS_MAKE_CORE_API SyncInstall (
+                const std::string &organization,
+                const std::string &project,
+                const std::string &version,
+                const std::vector<CopyPaths> &paths);
             _LIB_THEKOGANS_MAKE_CORE_DECL void _LIB_THEKOGANS_MAKE_CORE_API Uninstall (
                 const std::string &organization,
                 const std::string &project,
@@ -243,7 +292,8 @@ namespace thekogans {
                 const std::string &project_root,
                 const std::string &config,
                 const std::string &type,
-                const std::string &destination = std::string ());
+                const std::string &destination = std::string (),
+                CopyMode mode = COPY_MODE_COPY);
             _LIB_THEKOGANS_MAKE_CORE_DECL void _LIB_THEKOGANS_MAKE_CORE_API CopyPlugin (
                 const std::string &project_root,
                 const std::string &config);
@@ -271,6 +321,25 @@ namespace thekogans {
                 bool hide_commands,
                 bool parallel_build,
                 const std::string &target);
+            // Tests are built (and linked) against TYPE_STATIC unless
+            // $THEKOGANS_MAKE_TESTS_LINKAGE is 'configured', in which case
+            // they reuse the artifacts of the configured type (and any
+            // up to date build tree that goes with it).
+            _LIB_THEKOGANS_MAKE_CORE_DECL std::string _LIB_THEKOGANS_MAKE_CORE_API GetTestsType (
+                const std::string &type);
+            // config, type
+            typedef std::pair<std::string, std::string> BuildVariant;
+            // Build several variants of the same project concurrently. The
+            // build systems are generated up front, gnu_make is then run
+            // for all variants at once (sharing one job per core between
+            // them) and dependencies are copied once all builds are done.
+            _LIB_THEKOGANS_MAKE_CORE_DECL void _LIB_THEKOGANS_MAKE_CORE_API BuildProjectVariants (
+                const std::string &project_root,
+                const std::list<BuildVariant> &variants,
+                const std::string &mode,
+                bool hide_commands,
+                bool parallel_build,
+                const std::string &target);
 
             inline bool IsEscapableCh (char ch) {
                 return
@@ -27,6 +27,7 @@
 #include "thekogans/util/Heap.h"
 #include "thekogans/util/GUID.h"
 #include "thekogans/make/core/Config.h"
+#include "thekogans/make/core/OrderedSet.h"
 #include "thekogans/make/core/Value.h"
 #include "thekogans/make/core/Installer.h"
 #include "thekogans/make/core/Toolchain.h"
@@ -70,6 +71,7 @@ namespace thekogans {
                 static const char * const ATTR_TYPE;
                 static const char * const ATTR_FLAGS;
                 static const char * const ATTR_PATH;
+                static const char * const ATTR_SHA2_256;
 
                 static const char * const TAG_THEKOGANS_MAKE;
                 static const char * const TAG_GOAL;
@@ -80,6 +82,9 @@ namespace thekogans {
                 static const char * const TAG_PLUGIN_HOSTS;
                 static const char * const TAG_DEPENDENCIES;
                 static const char * const TAG_DEPENDENCY;
+                static const char * const TAG_CLOSURE;
+                static const char * const TAG_CONFIG_FILE;
+                static const char * const TAG_DEPENDENCY_VERSION;
                 static const char * const TAG_PRECOMPILED_HEADER;
                 static const char * const TAG_FILE;
                 static const char * const TAG_OUTPUT_FILE;
@@ -99,6 +104,7 @@ namespace thekogans {
                 static const char * const TAG_LIBRARIAN_FLAG;
                 static const char * const TAG_LINK_LIBRARIES;
                 static const char * const TAG_LINK_LIBRARY;
+                static const char * const TAG_SHARED_LIBRARY;
                 static const char * const TAG_MASM_FLAGS;
                 static const char * const TAG_MASM_FLAG;
                 static const char * const TAG_MASM_PREPROCESSOR_DEFINITIONS;
@@ -235,6 +241,13 @@ namespace thekogans {
                     virtual std::string GetType () const = 0;
 
                     virtual bool EquivalentTo (const Dependency & /*dependency*/) const = 0;
+                    /// \brief
+                    /// Return a key such that a.EquivalentTo (b) iff
+                    /// a.GetEquivalenceKey () == b.GetEquivalenceKey ().
+                    /// Lets equivalent dependencies be found with a hash
+                    /// lookup instead of a linear EquivalentTo scan.
+                    /// \return Equivalence key.
+                    virtual std::string GetEquivalenceKey () const = 0;
 
                     using VersionAndBranch = std::pair<std::string, std::string>;
                     using VersionSet = std::set<VersionAndBranch>;
@@ -246,7 +259,7 @@ namespace thekogans {
                         std::set<std::string> & /*visitedDependencies*/) const = 0;
 
                     virtual void GetPreprocessorDefinitions (
-                        std::list<std::string> & /*preprocessorDefinitions*/) const = 0;
+                        OrderedSet<std::string> & /*preprocessorDefinitions*/) const = 0;
                     virtual void GetFeatures (
                         std::set<std::string> & /*features*/) const = 0;
 
@@ -266,6 +279,45 @@ namespace thekogans {
                 };
                 std::list<Dependency::Ptr> plugin_hosts;
                 std::list<Dependency::Ptr> dependencies;
+                /// \brief
+                /// Flattened (transitive) dependency closure of an installed
+                /// library variant. Installer writes one per variant in to the
+                /// toolchain config, and ToolchainDependency uses it instead of
+                /// recursively loading every transitive dependency config.
+                struct _LIB_THEKOGANS_MAKE_CORE_DECL Closure {
+                    /// \brief
+                    /// true = the config had a (consistent) closure for this variant.
+                    bool present;
+                    std::set<std::string> features;
+                    std::set<std::string> include_directories;
+                    /// \brief
+                    /// Link order (last occurrence of each library).
+                    std::list<std::string> link_libraries;
+                    std::set<std::string> shared_libraries;
+                    /// \brief
+                    /// Transitive library versions, as CollectVersions would
+                    /// find them. Lets CheckDependencies stop at the closure.
+                    Dependency::Versions versions;
+                    /// \brief
+                    /// Transitive toolchain config files and their SHA2-256. If
+                    /// any of them changed since the closure was computed, the
+                    /// closure is ignored.
+                    std::map<std::string, std::string> config_files;
+
+                    Closure () :
+                        present (false) {}
+
+                    /// \brief
+                    /// Return the closure xml.
+                    /// \param[in] indentationLevel Tag indentation level.
+                    /// \param[in] config Variant config.
+                    /// \param[in] type Variant type.
+                    /// \return Closure xml.
+                    std::string ToString (
+                        util::ui32 indentationLevel,
+                        const std::string &config,
+                        const std::string &type) const;
+                } closure;
                 struct _LIB_THEKOGANS_MAKE_CORE_DECL PrecompiledHeader {
                     enum Type {
                         None,
@@ -422,6 +474,11 @@ namespace thekogans {
                 SymbolTable globalSymbolTable;
                 SymbolTable localSymbolTable;
 
+                /// \brief
+                /// The following getters return root element attributes. They
+                /// read the config file only up to the root start tag (no
+                /// evaluation, no dependencies) and cache the result per file,
+                /// revalidating by mtime.
                 static std::string GetOrganization (
                     const std::string &project_root,
                     const std::string &config_file);
@@ -450,12 +507,134 @@ namespace thekogans {
                     const std::string &project_root,
                     const std::string &config_file);
 
+                /// \brief
+                /// Load (or return the cached) config for the given project,
+                /// generator, config and type. The returned reference stays
+                /// valid until the config is dropped from the cache, which
+                /// only happens when InvalidateConfigs or ClearConfigs is
+                /// called, or when TrimConfigs evicts it. GetConfig itself
+                /// never evicts. TrimConfigs runs when the outermost TrimPoint
+                /// (Installer::Install*, BuildProject(Variants)) returns, or
+                /// when a long running process calls it. Callers that hold on
+                /// to a reference across either must thekogans_make::Pin it. Pinning
+                /// is opt in and covers only the pinned config. Dependencies
+                /// look up their configs through GetConfig on every use, so
+                /// references obtained through them need their own pins.
+                /// \param[in] project_root Project root directory.
+                /// \param[in] config_file Config file name (relative to project_root).
+                /// \param[in] generator Generator name.
+                /// \param[in] config Build config (Debug or Release).
+                /// \param[in] type Build type (Static or Shared).
+                /// \return Cached config.
                 static const thekogans_make &GetConfig (
                     const std::string &project_root,
                     const std::string &config_file,
                     const std::string &generator,
                     const std::string &config,
                     const std::string &type);
+                /// \brief
+                /// Drop every cached config that was loaded from the given
+                /// config file, or whose loading read it (through its
+                /// dependencies). Used by long running processes to pick
+                /// up config edits. References returned by GetConfig for
+                /// dropped configs become invalid.
+                /// \param[in] configFilePath Changed config file.
+                /// \return Number of cached configs dropped.
+                static std::size_t InvalidateConfigs (const std::string &configFilePath);
+                /// \brief
+                /// Drop all cached configs (used when dependency resolution
+                /// itself might change, e.g. a toolchain was (un)installed).
+                /// \return Number of cached configs dropped.
+                static std::size_t ClearConfigs ();
+                /// \brief
+                /// Return the config files (canonical system paths) the cached configs
+                /// were loaded from. These are the files to watch.
+                /// \param[out] configFiles Config files.
+                static void GetConfigFiles (std::set<std::string> &configFiles);
+
+                /// \struct thekogans_make::Pin thekogans_make.h thekogans/make/core/thekogans_make.h
+                ///
+                /// \brief
+                /// Keeps a config returned by GetConfig alive. Pinned configs
+                /// are never evicted by TrimConfigs. If InvalidateConfigs or
+                /// ClearConfigs drop a pinned config, GetConfig stops serving
+                /// it, but it stays valid until its last pin goes away.
+                struct _LIB_THEKOGANS_MAKE_CORE_DECL Pin {
+                    /// \brief
+                    /// Pinned config.
+                    const thekogans_make &config;
+
+                    /// \brief
+                    /// ctor.
+                    /// \param[in] config_ Config (returned by GetConfig) to pin.
+                    explicit Pin (const thekogans_make &config_);
+                    /// \brief
+                    /// dtor. Unpin the config.
+                    ~Pin ();
+
+                    /// \brief
+                    /// Pin is neither copy constructable, nor assignable.
+                    THEKOGANS_UTIL_DISALLOW_COPY_AND_ASSIGN (Pin)
+                };
+
+                /// \struct thekogans_make::TrimPoint thekogans_make.h thekogans/make/core/thekogans_make.h
+                ///
+                /// \brief
+                /// Marks a library entry point that doesn't hand config
+                /// references back to its caller. When the outermost
+                /// TrimPoint goes out of scope (normally, not while an
+                /// exception is propagating) TrimConfigs is called. Nested
+                /// TrimPoints (an install building its dependencies) don't
+                /// trim, so the entry points can hold unpinned references.
+                struct _LIB_THEKOGANS_MAKE_CORE_DECL TrimPoint {
+                    /// \brief
+                    /// ctor.
+                    TrimPoint ();
+                    /// \brief
+                    /// dtor. Trim the config cache if this is the outermost TrimPoint.
+                    ~TrimPoint ();
+
+                    /// \brief
+                    /// TrimPoint is neither copy constructable, nor assignable.
+                    THEKOGANS_UTIL_DISALLOW_COPY_AND_ASSIGN (TrimPoint)
+                };
+
+                /// \brief
+                /// Return the config cache size limit used by TrimConfigs.
+                /// Defaults to $THEKOGANS_MAKE_CONFIG_CACHE_MAX_SIZE (bytes, K, M
+                /// and G suffixes are accepted). The limit is only enforced at
+                /// TrimPoints and explicit TrimConfigs calls. A process that
+                /// only calls GetConfig never evicts anything.
+                /// \return Max config cache size in bytes (0 = unbounded).
+                static std::size_t GetConfigCacheMaxSize ();
+                /// \brief
+                /// Set the config cache size limit used by TrimConfigs.
+                /// \param[in] maxSize Max config cache size in bytes (0 = unbounded).
+                static void SetConfigCacheMaxSize (std::size_t maxSize);
+                /// \brief
+                /// Return the approximate memory used by the cached configs.
+                /// \return Sum of GetSize of all cached configs.
+                static std::size_t GetConfigCacheSize ();
+                /// \brief
+                /// Return the number of cached configs.
+                /// \return Number of cached configs.
+                static std::size_t GetConfigCacheCount ();
+                /// \brief
+                /// Evict least recently used, unpinned configs until the cache
+                /// fits in GetConfigCacheMaxSize. GetConfig returns references,
+                /// so eviction never happens behind the caller's back. Long
+                /// running processes call this between requests (the same place
+                /// they call ConfigWatcher::ProcessEvents), pinning whatever
+                /// they hold on to across requests. References returned by
+                /// GetConfig for evicted configs become invalid.
+                /// \return Number of cached configs evicted.
+                static std::size_t TrimConfigs ();
+
+                /// \brief
+                /// Return the approximate memory used by this config (its
+                /// DOM derived lists, symbol tables and dependencies).
+                /// \return Approximate size in bytes.
+                std::size_t GetSize () const;
 
                 void CheckDependencies () const;
                 void ListDependencies (util::ui32 indentationLevel) const;
@@ -516,6 +695,13 @@ namespace thekogans {
                 void GetCommonPreprocessorDefinitions (
                     std::list<std::string> &preprocessorDefinitions) const;
                 std::string GetGoalFileName () const;
+                /// \brief
+                /// Compute the closure this (library) project will have once it's
+                /// installed in the toolchain. Project dependencies are treated
+                /// as the toolchain dependencies they will be installed as, so
+                /// they (and this project) must already be installed.
+                /// \param[out] closure Where to put the closure.
+                void GetToolchainClosure (Closure &closure) const;
 
             private:
                 thekogans_make (
@@ -526,6 +712,8 @@ namespace thekogans {
                     const std::string &type_);
 
                 void Parseconstants (pugi::xml_node &node);
+                void Parseclosure (pugi::xml_node &node);
+                bool IsClosureConsistent () const;
                 void Parsedependencies (
                     pugi::xml_node &node,
                     std::list<Dependency::Ptr> &dependencies);
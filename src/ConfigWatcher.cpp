@@ -0,0 +1,143 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#include "thekogans/util/Environment.h"
+
+#if defined (TOOLCHAIN_OS_Linux)
+
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <set>
+#include "thekogans/util/Path.h"
+#include "thekogans/util/Exception.h"
+#include "thekogans/make/core/thekogans_make.h"
+#include "thekogans/make/core/Utils.h"
+#include "thekogans/make/core/ConfigWatcher.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+
+            namespace {
+                // Editors either rewrite in place (IN_CLOSE_WRITE)
+                // or write a temp file and rename it (IN_MOVED_TO).
+                const uint32_t WATCH_MASK =
+                    IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                    IN_CREATE | IN_DELETE | IN_ONLYDIR;
+                const uint32_t ADD_REMOVE_MASK =
+                    IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE;
+            }
+
+            ConfigWatcher::ConfigWatcher () :
+                    handle (inotify_init1 (IN_NONBLOCK | IN_CLOEXEC)),
+                    toolchainConfigDirectory (ToSystemPath (MakePath (_TOOLCHAIN_DIR, CONFIG_DIR))) {
+                if (handle == -1) {
+                    THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                        "Unable to create an inotify instance (%s).",
+                        strerror (errno));
+                }
+            }
+
+            ConfigWatcher::~ConfigWatcher () {
+                close (handle);
+            }
+
+            void ConfigWatcher::WatchConfigs () {
+                Watch (toolchainConfigDirectory);
+                std::set<std::string> configFiles;
+                thekogans_make::GetConfigFiles (configFiles);
+                std::set<std::string> configDirectories;
+                for (std::set<std::string>::const_iterator
+                        it = configFiles.begin (),
+                        end = configFiles.end (); it != end; ++it) {
+                    configDirectories.insert (util::Path (*it).GetDirectory ());
+                }
+                for (std::set<std::string>::const_iterator
+                        it = configDirectories.begin (),
+                        end = configDirectories.end (); it != end; ++it) {
+                    Watch (*it);
+                }
+            }
+
+            std::size_t ConfigWatcher::ProcessEvents () {
+                std::size_t count = 0;
+                alignas (struct inotify_event) char buffer[16384];
+                for (;;) {
+                    ssize_t size = read (handle, buffer, sizeof (buffer));
+                    if (size <= 0) {
+                        if (size == -1 && errno == EINTR) {
+                            continue;
+                        }
+                        break;
+                    }
+                    for (char *ptr = buffer; ptr < buffer + size;) {
+                        const struct inotify_event *event = (const struct inotify_event *)ptr;
+                        ptr += sizeof (struct inotify_event) + event->len;
+                        if ((event->mask & IN_Q_OVERFLOW) != 0) {
+                            // Events were lost. Can't be precise.
+                            count += thekogans_make::ClearConfigs ();
+                            continue;
+                        }
+                        std::map<int, std::string>::iterator it = directories.find (event->wd);
+                        if (it == directories.end ()) {
+                            continue;
+                        }
+                        if ((event->mask & IN_IGNORED) != 0) {
+                            // The directory is gone. If it comes back, the
+                            // configs in it will be reloaded and rewatched.
+                            directories.erase (it);
+                            continue;
+                        }
+                        if (event->len == 0) {
+                            continue;
+                        }
+                        if (it->second == toolchainConfigDirectory &&
+                                (event->mask & ADD_REMOVE_MASK) != 0) {
+                            // A toolchain project was (un)installed. Version
+                            // resolution (Toolchain::Find) might change.
+                            count += thekogans_make::ClearConfigs ();
+                        }
+                        else {
+                            count += thekogans_make::InvalidateConfigs (
+                                MakePath (it->second, event->name));
+                        }
+                    }
+                }
+                return count;
+            }
+
+            void ConfigWatcher::Watch (const std::string &directory) {
+                if (util::Path (directory).Exists ()) {
+                    // Watching a directory twice returns the same descriptor.
+                    int wd = inotify_add_watch (handle, directory.c_str (), WATCH_MASK);
+                    if (wd == -1) {
+                        THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                            "Unable to watch '%s' (%s).",
+                            directory.c_str (),
+                            strerror (errno));
+                    }
+                    directories[wd] = directory;
+                }
+            }
+
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
+
+#endif // defined (TOOLCHAIN_OS_Linux)
@@ -0,0 +1,219 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#include "thekogans/util/Environment.h"
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <fstream>
+#include "thekogans/util/StringUtils.h"
+#include "thekogans/make/core/Counters.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+
+            namespace {
+                // Both tables are zero initialized static storage, so
+                // they are usable before (and after) dynamic initialization.
+                std::atomic<util::ui64> counters[Counters::COUNTER_COUNT];
+
+                const char * const counterNames[Counters::COUNTER_COUNT] = {
+                    "config_cache_hits",
+                    "config_cache_misses",
+                    "config_cache_evictions",
+                    "xml_bytes_parsed",
+                    "eval_calls",
+                    "expand_calls",
+                    "tokens",
+                    "environment_lookups",
+                    "file_system_stats",
+                    "file_system_readdirs",
+                    "files_copied",
+                    "bytes_copied",
+                    "files_hashed",
+                    "bytes_hashed",
+                    "bytes_downloaded",
+                    "source_lookups",
+                    "allocations"
+                };
+
+                // There are only a few dozen functions. Should
+                // the table fill up, new names are not counted.
+                const std::size_t MAX_FUNCTIONS = 256;
+                const std::size_t MAX_FUNCTION_NAME_LENGTH = 64;
+
+                enum {
+                    SLOT_FREE,
+                    SLOT_BUSY,
+                    SLOT_READY
+                };
+
+                struct FunctionSlot {
+                    std::atomic<util::ui32> state;
+                    char name[MAX_FUNCTION_NAME_LENGTH];
+                    std::atomic<util::ui64> count;
+                };
+
+                FunctionSlot functions[MAX_FUNCTIONS];
+
+                FunctionSlot *FindFunction (
+                        const std::string &name,
+                        bool create) {
+                    std::string key = name.substr (0, MAX_FUNCTION_NAME_LENGTH - 1);
+                    std::size_t hash = std::hash<std::string> () (key);
+                    for (std::size_t i = 0; i < MAX_FUNCTIONS; ++i) {
+                        FunctionSlot &slot = functions[(hash + i) % MAX_FUNCTIONS];
+                        util::ui32 state = slot.state.load (std::memory_order_acquire);
+                        if (state == SLOT_FREE) {
+                            if (!create) {
+                                return 0;
+                            }
+                            if (slot.state.compare_exchange_strong (
+                                    state, SLOT_BUSY, std::memory_order_acquire)) {
+                                strcpy (slot.name, key.c_str ());
+                                slot.state.store (SLOT_READY, std::memory_order_release);
+                                return &slot;
+                            }
+                        }
+                        // Another thread is in the middle of claiming
+                        // this slot. It's only copying the name.
+                        while (state == SLOT_BUSY) {
+                            std::this_thread::yield ();
+                            state = slot.state.load (std::memory_order_acquire);
+                        }
+                        if (key == slot.name) {
+                            return &slot;
+                        }
+                    }
+                    return 0;
+                }
+
+                void DumpCounters () {
+                    std::string path = util::GetEnvironmentVariable ("THEKOGANS_MAKE_COUNTERS");
+                    if (path == "-") {
+                        Counters::Dump (std::cerr);
+                    }
+                    else {
+                        std::ofstream countersFile (path.c_str (), std::ios::out | std::ios::trunc);
+                        if (countersFile.is_open ()) {
+                            const std::string JSON_EXT = ".json";
+                            if (path.size () > JSON_EXT.size () &&
+                                    path.compare (path.size () - JSON_EXT.size (), JSON_EXT.size (), JSON_EXT) == 0) {
+                                Counters::DumpJSON (countersFile);
+                            }
+                            else {
+                                Counters::Dump (countersFile);
+                            }
+                        }
+                    }
+                }
+
+                struct AtExit {
+                    AtExit () {
+                        if (!util::GetEnvironmentVariable ("THEKOGANS_MAKE_COUNTERS").empty ()) {
+                            std::atexit (DumpCounters);
+                        }
+                    }
+                } atExit;
+            }
+
+            const char *Counters::GetName (Counter counter) {
+                return counter < COUNTER_COUNT ? counterNames[counter] : "";
+            }
+
+            void Counters::Increment (
+                    Counter counter,
+                    util::ui64 value) {
+                if (counter < COUNTER_COUNT) {
+                    counters[counter].fetch_add (value, std::memory_order_relaxed);
+                }
+            }
+
+            util::ui64 Counters::Get (Counter counter) {
+                return counter < COUNTER_COUNT ?
+                    counters[counter].load (std::memory_order_relaxed) : 0;
+            }
+
+            void Counters::IncrementFunction (const std::string &name) {
+                FunctionSlot *slot = FindFunction (name, true);
+                if (slot != 0) {
+                    slot->count.fetch_add (1, std::memory_order_relaxed);
+                }
+            }
+
+            util::ui64 Counters::GetFunction (const std::string &name) {
+                FunctionSlot *slot = FindFunction (name, false);
+                return slot != 0 ? slot->count.load (std::memory_order_relaxed) : 0;
+            }
+
+            void Counters::GetFunctions (std::map<std::string, util::ui64> &functions_) {
+                for (std::size_t i = 0; i < MAX_FUNCTIONS; ++i) {
+                    if (functions[i].state.load (std::memory_order_acquire) == SLOT_READY) {
+                        functions_[functions[i].name] =
+                            functions[i].count.load (std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            void Counters::Reset () {
+                for (std::size_t i = 0; i < COUNTER_COUNT; ++i) {
+                    counters[i].store (0, std::memory_order_relaxed);
+                }
+                for (std::size_t i = 0; i < MAX_FUNCTIONS; ++i) {
+                    functions[i].count.store (0, std::memory_order_relaxed);
+                }
+            }
+
+            void Counters::Dump (std::ostream &stream) {
+                for (std::size_t i = 0; i < COUNTER_COUNT; ++i) {
+                    stream << counterNames[i] << " " <<
+                        counters[i].load (std::memory_order_relaxed) << "\n";
+                }
+                std::map<std::string, util::ui64> functions_;
+                GetFunctions (functions_);
+                for (std::map<std::string, util::ui64>::const_iterator
+                        it = functions_.begin (),
+                        end = functions_.end (); it != end; ++it) {
+                    stream << "function_calls." << it->first << " " << it->second << "\n";
+                }
+                stream.flush ();
+            }
+
+            void Counters::DumpJSON (std::ostream &stream) {
+                // Counter and function names are identifiers,
+                // there's nothing to escape.
+                stream << "{";
+                for (std::size_t i = 0; i < COUNTER_COUNT; ++i) {
+                    stream << (i > 0 ? ",\n" : "\n") << "\"" << counterNames[i] << "\": " <<
+                        counters[i].load (std::memory_order_relaxed);
+                }
+                std::map<std::string, util::ui64> functions_;
+                GetFunctions (functions_);
+                for (std::map<std::string, util::ui64>::const_iterator
+                        it = functions_.begin (),
+                        end = functions_.end (); it != end; ++it) {
+                    stream << ",\n\"function_calls." << it->first << "\": " << it->second;
+                }
+                stream << "\n}\n";
+                stream.flush ();
+            }
+
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
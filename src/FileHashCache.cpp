@@ -0,0 +1,263 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#include "thekogans/util/Environment.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <ctime>
+#include <cstdio>
+#include <random>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include "thekogans/util/Path.h"
+#include "thekogans/util/StringUtils.h"
+#include "thekogans/util/SHA2.h"
+#include "thekogans/util/Exception.h"
+#include "thekogans/make/core/Counters.h"
+#include "thekogans/make/core/Utils.h"
+#include "thekogans/make/core/FileHashCache.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+
+            namespace {
+                const char * const FILE_HASH_CACHE = ".thekogans_make_file_hashes";
+                // Files modified this recently might still be changing
+                // within the file system timestamp granularity. Hash
+                // them, but don't remember the result.
+                const time_t RACY_INTERVAL = 2;
+                // Don't bother compacting small files.
+                const std::size_t MIN_COMPACT_RECORDS = 1024;
+
+                bool GetFileIdentity (
+                        const std::string &filePath,
+                        std::string &key,
+                        util::ui64 &size,
+                        util::ui64 &mtime,
+                        util::ui64 &ctime,
+                        time_t &mtimeSeconds) {
+                    Counters::Increment (Counters::FILE_SYSTEM_STATS);
+                #if defined (TOOLCHAIN_OS_Windows)
+                    struct __stat64 fileStat;
+                    if (_stat64 (filePath.c_str (), &fileStat) != 0) {
+                        return false;
+                    }
+                    // No inodes here. The path will have to do.
+                    key = util::StringToLower (filePath.c_str ());
+                    mtime = (util::ui64)fileStat.st_mtime * 1000000000ULL;
+                    ctime = (util::ui64)fileStat.st_ctime * 1000000000ULL;
+                #else // defined (TOOLCHAIN_OS_Windows)
+                    struct stat fileStat;
+                    if (stat (filePath.c_str (), &fileStat) != 0) {
+                        return false;
+                    }
+                    key = util::ui64Tostring ((util::ui64)fileStat.st_dev) + ":" +
+                        util::ui64Tostring ((util::ui64)fileStat.st_ino);
+                #if defined (TOOLCHAIN_OS_OSX)
+                    const struct timespec &mtimespec = fileStat.st_mtimespec;
+                    const struct timespec &ctimespec = fileStat.st_ctimespec;
+                #else // defined (TOOLCHAIN_OS_OSX)
+                    const struct timespec &mtimespec = fileStat.st_mtim;
+                    const struct timespec &ctimespec = fileStat.st_ctim;
+                #endif // defined (TOOLCHAIN_OS_OSX)
+                    mtime = (util::ui64)mtimespec.tv_sec * 1000000000ULL + mtimespec.tv_nsec;
+                    ctime = (util::ui64)ctimespec.tv_sec * 1000000000ULL + ctimespec.tv_nsec;
+                #endif // defined (TOOLCHAIN_OS_Windows)
+                    size = (util::ui64)fileStat.st_size;
+                    mtimeSeconds = fileStat.st_mtime;
+                    return true;
+                }
+
+                // Record format: size mtime ctime hash key
+                std::string FormatRecord (
+                        const std::string &key,
+                        util::ui64 size,
+                        util::ui64 mtime,
+                        util::ui64 ctime,
+                        const std::string &hash) {
+                    std::ostringstream record;
+                    record << size << " " << mtime << " " <<
+                        ctime << " " << hash << " " << key << "\n";
+                    return record.str ();
+                }
+
+                std::string HashFile (const std::string &filePath) {
+                    util::Hash::Digest digest;
+                    util::SHA2 hasher;
+                    hasher.FromFile (filePath, util::SHA2::DIGEST_SIZE_256, digest);
+                    return util::Hash::DigestTostring (digest);
+                }
+            }
+
+            std::string FileHashCache::GetDefaultPath () {
+                std::string path = util::GetEnvironmentVariable ("THEKOGANS_MAKE_FILE_HASH_CACHE");
+                return !path.empty () ? path :
+                    !_TOOLCHAIN_ROOT.empty () ?
+                        ToSystemPath (MakePath (_TOOLCHAIN_ROOT, FILE_HASH_CACHE)) :
+                        std::string ();
+            }
+
+            std::string FileHashCache::GetHash (const std::string &filePath) {
+                std::string key;
+                Entry entry;
+                time_t mtimeSeconds = 0;
+                if (!GetFileIdentity (filePath, key, entry.size, entry.mtime, entry.ctime, mtimeSeconds)) {
+                    // Let the hasher report the error.
+                    return HashFile (filePath);
+                }
+                {
+                    std::lock_guard<std::mutex> guard (mutex);
+                    if (!loaded) {
+                        Load ();
+                    }
+                    std::unordered_map<std::string, Entry>::const_iterator it = entries.find (key);
+                    if (it != entries.end () && it->second.Matches (entry)) {
+                        return it->second.hash;
+                    }
+                }
+                entry.hash = HashFile (filePath);
+                Counters::Increment (Counters::FILES_HASHED);
+                Counters::Increment (Counters::BYTES_HASHED, entry.size);
+                if (mtimeSeconds + RACY_INTERVAL < time (0)) {
+                    {
+                        std::lock_guard<std::mutex> guard (mutex);
+                        entries[key] = entry;
+                        ++records;
+                    }
+                    Append (FormatRecord (key, entry.size, entry.mtime, entry.ctime, entry.hash));
+                }
+                return entry.hash;
+            }
+
+            void FileHashCache::GetHashes (
+                    const std::vector<std::string> &filePaths,
+                    std::vector<std::string> &hashes,
+                    util::ui32 workerCount) {
+                hashes.assign (filePaths.size (), std::string ());
+                if (workerCount == 0) {
+                    workerCount = std::max (1u, std::thread::hardware_concurrency ());
+                }
+                std::size_t threadCount =
+                    std::min<std::size_t> (filePaths.size (), workerCount);
+                if (threadCount < 2) {
+                    for (std::size_t i = 0, count = filePaths.size (); i < count; ++i) {
+                        hashes[i] = GetHash (filePaths[i]);
+                    }
+                }
+                else {
+                    // Files are handed out one at a time so that a few
+                    // large files don't leave the other workers idle.
+                    std::atomic<std::size_t> next (0);
+                    std::vector<std::exception_ptr> exceptions (filePaths.size ());
+                    std::vector<std::thread> threads;
+                    for (std::size_t i = 0; i < threadCount; ++i) {
+                        threads.push_back (
+                            std::thread (
+                                [&] () {
+                                    for (std::size_t j = next++; j < filePaths.size (); j = next++) {
+                                        try {
+                                            hashes[j] = GetHash (filePaths[j]);
+                                        }
+                                        catch (...) {
+                                            exceptions[j] = std::current_exception ();
+                                        }
+                                    }
+                                }));
+                    }
+                    for (std::size_t i = 0; i < threadCount; ++i) {
+                        threads[i].join ();
+                    }
+                    for (std::size_t i = 0, count = exceptions.size (); i < count; ++i) {
+                        if (exceptions[i]) {
+                            std::rethrow_exception (exceptions[i]);
+                        }
+                    }
+                }
+            }
+
+            void FileHashCache::Load () {
+                loaded = true;
+                if (path.empty () || !util::Path (path).Exists ()) {
+                    return;
+                }
+                // Record format: see FormatRecord.
+                std::ifstream file (path.c_str ());
+                std::string line;
+                while (std::getline (file, line)) {
+                    std::istringstream record (line);
+                    Entry entry;
+                    std::string key;
+                    if (record >> entry.size >> entry.mtime >> entry.ctime >> entry.hash &&
+                            std::getline (record >> std::ws, key) && !key.empty ()) {
+                        // Later records supersede earlier ones.
+                        entries[key] = entry;
+                    }
+                    ++records;
+                }
+                if (records > MIN_COMPACT_RECORDS && records > entries.size () * 2) {
+                    Compact ();
+                }
+            }
+
+            void FileHashCache::Compact () {
+                std::random_device random;
+                std::string tempPath = path + EXT_SEPARATOR + "tmp" + util::ui32Tostring (random ());
+                {
+                    std::ofstream file (tempPath.c_str (), std::ios::out | std::ios::trunc);
+                    if (!file.is_open ()) {
+                        return;
+                    }
+                    for (std::unordered_map<std::string, Entry>::const_iterator
+                            it = entries.begin (),
+                            end = entries.end (); it != end; ++it) {
+                        file << FormatRecord (
+                            it->first,
+                            it->second.size,
+                            it->second.mtime,
+                            it->second.ctime,
+                            it->second.hash);
+                    }
+                }
+                if (std::rename (tempPath.c_str (), path.c_str ()) == 0) {
+                    records = entries.size ();
+                }
+                else {
+                    util::Path (tempPath).Delete ();
+                }
+            }
+
+            void FileHashCache::Append (const std::string &record) {
+                if (!path.empty ()) {
+                    // One short write per record keeps concurrent
+                    // appenders (other threads and processes) from
+                    // interleaving.
+                    std::ofstream file (path.c_str (), std::ios::out | std::ios::app);
+                    if (file.is_open ()) {
+                        file << record;
+                        file.flush ();
+                    }
+                }
+            }
+
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
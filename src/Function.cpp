@@ -19,6 +19,8 @@
 #include <iostream>
 #include "thekogans/util/Exception.h"
 #include "thekogans/make/core/thekogans_make.h"
+#include "thekogans/make/core/Counters.h"
+#include "thekogans/make/core/Profiler.h"
 #include "thekogans/make/core/Utils.h"
 #include "thekogans/make/core/Function.h"
 
@@ -292,6 +294,8 @@ namespace thekogans {
                 {
                     SharedPtr function = CreateType (identifier.first.c_str ());
                     if (function != nullptr) {
+                        Counters::IncrementFunction (identifier.first);
+                        THEKOGANS_MAKE_CORE_PROFILE_EXPRESSION ("function", identifier.first);
                         result = function->Exec (config, parameters);
                     }
                     else if (parameters.empty ()) {
@@ -18,8 +18,11 @@
 #include <string>
 #include <list>
 #include <set>
+#include <unordered_set>
+#include <vector>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include "thekogans/util/Environment.h"
 #include "thekogans/util/Path.h"
 #include "thekogans/util/Plugins.h"
@@ -30,6 +33,7 @@
 #include "thekogans/make/core/Manifest.h"
 #include "thekogans/make/core/Project.h"
 #include "thekogans/make/core/Toolchain.h"
+#include "thekogans/make/core/Trace.h"
 #include "thekogans/make/core/Installer.h"
 
 namespace thekogans {
@@ -37,6 +41,38 @@ namespace thekogans {
         namespace core {
 
             namespace {
+                void WriteConfigFile (
+                        const std::string &config_file,
+                        const std::string &contents) {
+                    std::string configFilePath = ToSystemPath (config_file);
+                    if (util::Path (configFilePath).Exists ()) {
+                        std::ifstream existingFile (
+                            configFilePath.c_str (),
+                            std::ios::in | std::ios::binary);
+                        std::stringstream existingContents;
+                        existingContents << existingFile.rdbuf ();
+                        if (existingContents.str () == contents) {
+                            std::cout << "Up to date " << config_file << "\n";
+                            std::cout.flush ();
+                            return;
+                        }
+                    }
+                    std::cout << "Creating " << config_file << "\n";
+                    std::cout.flush ();
+                    util::Directory::Create (util::Path (configFilePath).GetDirectory ());
+                    std::fstream configFile (
+                        configFilePath.c_str (),
+                        std::fstream::out | std::fstream::trunc);
+                    if (configFile.is_open ()) {
+                        configFile << contents;
+                    }
+                    else {
+                        THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                            "Unable to open: %s",
+                            configFilePath.c_str ());
+                    }
+                }
+
                 void GetCommonFeatures (
                         const thekogans_make &DebugShared,
                         const thekogans_make &DebugStatic,
@@ -94,17 +130,14 @@ namespace thekogans {
                     }
                 }
 
-                bool ContainsDependency (
-                        const thekogans_make &config,
-                        const thekogans_make::Dependency &dependency) {
+                void GetDependencyKeys (
+                        const std::list<thekogans_make::Dependency::Ptr> &dependencies,
+                        std::unordered_set<std::string> &keys) {
                     for (std::list<thekogans_make::Dependency::Ptr>::const_iterator
-                            it = config.dependencies.begin (),
-                            end = config.dependencies.end (); it != end; ++it) {
-                        if ((*it)->EquivalentTo (dependency)) {
-                            return true;
-                        }
+                            it = dependencies.begin (),
+                            end = dependencies.end (); it != end; ++it) {
+                        keys.insert ((*it)->GetEquivalenceKey ());
                     }
-                    return false;
                 }
 
                 void GetCommonDependencies (
@@ -113,30 +146,24 @@ namespace thekogans {
                         const thekogans_make &ReleaseShared,
                         const thekogans_make &ReleaseStatic,
                         std::list<thekogans_make::Dependency *> &commonDependencies) {
+                    std::unordered_set<std::string> DebugStaticKeys;
+                    GetDependencyKeys (DebugStatic.dependencies, DebugStaticKeys);
+                    std::unordered_set<std::string> ReleaseSharedKeys;
+                    GetDependencyKeys (ReleaseShared.dependencies, ReleaseSharedKeys);
+                    std::unordered_set<std::string> ReleaseStaticKeys;
+                    GetDependencyKeys (ReleaseStatic.dependencies, ReleaseStaticKeys);
                     for (std::list<thekogans_make::Dependency::Ptr>::const_iterator
                             it = DebugShared.dependencies.begin (),
                             end = DebugShared.dependencies.end (); it != end; ++it) {
-                        if (ContainsDependency (DebugStatic, **it) &&
-                                ContainsDependency (ReleaseShared, **it) &&
-                                ContainsDependency (ReleaseStatic, **it)) {
+                        std::string key = (*it)->GetEquivalenceKey ();
+                        if (DebugStaticKeys.find (key) != DebugStaticKeys.end () &&
+                                ReleaseSharedKeys.find (key) != ReleaseSharedKeys.end () &&
+                                ReleaseStaticKeys.find (key) != ReleaseStaticKeys.end ()) {
                             commonDependencies.push_back ((*it).get ());
                         }
                     }
                 }
 
-                bool DoesNotContainDependency (
-                        const std::list<thekogans_make::Dependency *> &commonDependencies,
-                        const thekogans_make::Dependency &dependency) {
-                    for (std::list<thekogans_make::Dependency *>::const_iterator
-                            it = commonDependencies.begin (),
-                            end = commonDependencies.end (); it != end; ++it) {
-                        if ((*it)->EquivalentTo (dependency)) {
-                            return false;
-                        }
-                    }
-                    return true;
-                }
-
                 void GetUniqueDependencies (
                         const thekogans_make &DebugShared,
                         const thekogans_make &DebugStatic,
@@ -147,31 +174,37 @@ namespace thekogans {
                         std::list<thekogans_make::Dependency *> &DebugStaticDependencies,
                         std::list<thekogans_make::Dependency *> &ReleaseSharedDependencies,
                         std::list<thekogans_make::Dependency *> &ReleaseStaticDependencies) {
+                    std::unordered_set<std::string> commonKeys;
+                    for (std::list<thekogans_make::Dependency *>::const_iterator
+                            it = commonDependencies.begin (),
+                            end = commonDependencies.end (); it != end; ++it) {
+                        commonKeys.insert ((*it)->GetEquivalenceKey ());
+                    }
                     for (std::list<thekogans_make::Dependency::Ptr>::const_iterator
                             it = DebugShared.dependencies.begin (),
                             end = DebugShared.dependencies.end (); it != end; ++it) {
-                        if (DoesNotContainDependency (commonDependencies, **it)) {
+                        if (commonKeys.find ((*it)->GetEquivalenceKey ()) == commonKeys.end ()) {
                             DebugSharedDependencies.push_back ((*it).get ());
                         }
                     }
                     for (std::list<thekogans_make::Dependency::Ptr>::const_iterator
                             it = DebugStatic.dependencies.begin (),
                             end = DebugStatic.dependencies.end (); it != end; ++it) {
-                        if (DoesNotContainDependency (commonDependencies, **it)) {
+                        if (commonKeys.find ((*it)->GetEquivalenceKey ()) == commonKeys.end ()) {
                             DebugStaticDependencies.push_back ((*it).get ());
                         }
                     }
                     for (std::list<thekogans_make::Dependency::Ptr>::const_iterator
                             it = ReleaseShared.dependencies.begin (),
                             end = ReleaseShared.dependencies.end (); it != end; ++it) {
-                        if (DoesNotContainDependency (commonDependencies, **it)) {
+                        if (commonKeys.find ((*it)->GetEquivalenceKey ()) == commonKeys.end ()) {
                             ReleaseSharedDependencies.push_back ((*it).get ());
                         }
                     }
                     for (std::list<thekogans_make::Dependency::Ptr>::const_iterator
                             it = ReleaseStatic.dependencies.begin (),
                             end = ReleaseStatic.dependencies.end (); it != end; ++it) {
-                        if (DoesNotContainDependency (commonDependencies, **it)) {
+                        if (commonKeys.find ((*it)->GetEquivalenceKey ()) == commonKeys.end ()) {
                             ReleaseStaticDependencies.push_back ((*it).get ());
                         }
                     }
@@ -245,8 +278,10 @@ namespace thekogans {
             }
 
             void Installer::InstallLibrary (const std::string &project_root) {
+                thekogans_make::TrimPoint trimPoint;
                 if (installedProjects.find (project_root) == installedProjects.end ()) {
                     installedProjects.insert (project_root);
+                    THEKOGANS_MAKE_CORE_TRACE_SPAN ("install", project_root);
                     std::string install_config = config;
                     if (install_config.empty ()) {
                         install_config =
@@ -301,18 +336,12 @@ namespace thekogans {
                             ReleaseStatic);
                     }
                     else if (!install_config.empty ()) {
-                        BuildProject (
-                            project_root,
-                            install_config,
-                            TYPE_SHARED,
-                            MODE_INSTALL,
-                            hide_commands,
-                            parallel_build,
-                            TARGET_ALL);
-                        BuildProject (
+                        std::list<BuildVariant> variants;
+                        variants.push_back (BuildVariant (install_config, TYPE_SHARED));
+                        variants.push_back (BuildVariant (install_config, TYPE_STATIC));
+                        BuildProjectVariants (
                             project_root,
-                            install_config,
-                            TYPE_STATIC,
+                            variants,
                             MODE_INSTALL,
                             hide_commands,
                             parallel_build,
@@ -348,18 +377,12 @@ namespace thekogans {
                         InstallLibrary (DebugShared, DebugStatic, ReleaseShared, ReleaseStatic);
                     }
                     else if (!install_type.empty ()) {
-                        BuildProject (
-                            project_root,
-                            CONFIG_DEBUG,
-                            install_type,
-                            MODE_INSTALL,
-                            hide_commands,
-                            parallel_build,
-                            TARGET_ALL);
-                        BuildProject (
+                        std::list<BuildVariant> variants;
+                        variants.push_back (BuildVariant (CONFIG_DEBUG, install_type));
+                        variants.push_back (BuildVariant (CONFIG_RELEASE, install_type));
+                        BuildProjectVariants (
                             project_root,
-                            CONFIG_RELEASE,
-                            install_type,
+                            variants,
                             MODE_INSTALL,
                             hide_commands,
                             parallel_build,
@@ -399,34 +422,14 @@ namespace thekogans {
                             ReleaseStatic);
                     }
                     else {
-                        BuildProject (
+                        std::list<BuildVariant> variants;
+                        variants.push_back (BuildVariant (CONFIG_DEBUG, TYPE_SHARED));
+                        variants.push_back (BuildVariant (CONFIG_DEBUG, TYPE_STATIC));
+                        variants.push_back (BuildVariant (CONFIG_RELEASE, TYPE_SHARED));
+                        variants.push_back (BuildVariant (CONFIG_RELEASE, TYPE_STATIC));
+                        BuildProjectVariants (
                             project_root,
-                            CONFIG_DEBUG,
-                            TYPE_SHARED,
-                            MODE_INSTALL,
-                            hide_commands,
-                            parallel_build,
-                            TARGET_ALL);
-                        BuildProject (
-                            project_root,
-                            CONFIG_DEBUG,
-                            TYPE_STATIC,
-                            MODE_INSTALL,
-                            hide_commands,
-                            parallel_build,
-                            TARGET_ALL);
-                        BuildProject (
-                            project_root,
-                            CONFIG_RELEASE,
-                            TYPE_SHARED,
-                            MODE_INSTALL,
-                            hide_commands,
-                            parallel_build,
-                            TARGET_ALL);
-                        BuildProject (
-                            project_root,
-                            CONFIG_RELEASE,
-                            TYPE_STATIC,
+                            variants,
                             MODE_INSTALL,
                             hide_commands,
                             parallel_build,
@@ -469,8 +472,10 @@ namespace thekogans {
             }
 
             void Installer::InstallProgram (const std::string &project_root) {
+                thekogans_make::TrimPoint trimPoint;
                 if (installedProjects.find (project_root) == installedProjects.end ()) {
                     installedProjects.insert (project_root);
+                    THEKOGANS_MAKE_CORE_TRACE_SPAN ("install", project_root);
                     std::string install_config = config;
                     if (install_config.empty ()) {
                         install_config =
@@ -525,11 +530,13 @@ namespace thekogans {
                         }
                     }
                     // Uninstall old version
-                    UninstallProgram (
-                        config.organization,
-                        config.project,
-                        config.GetVersion (),
-                        false);
+                    if (!incremental) {
+                        UninstallProgram (
+                            config.organization,
+                            config.project,
+                            config.GetVersion (),
+                            false);
+                    }
                     std::cout << "Installing " << project_root << std::endl;
                     std::cout.flush ();
                     // install = "yes"
@@ -541,10 +548,15 @@ namespace thekogans {
                                 config.GetProjectGoal (),
                                 config.GetToolchainGoal ()));
                     }
-                    for (std::set<InstallPaths>::const_iterator
-                            it = installPaths.begin (),
-                            end = installPaths.end (); it != end; ++it) {
-                        CopyFile ((*it).first, (*it).second);
+                    if (incremental) {
+                        SyncInstall (
+                            config.organization,
+                            config.project,
+                            config.GetVersion (),
+                            std::vector<CopyPaths> (installPaths.begin (), installPaths.end ()));
+                    }
+                    else {
+                        CopyFiles (std::vector<CopyPaths> (installPaths.begin (), installPaths.end ()));
                     }
                     CopyDependencies (
                         project_root,
@@ -560,14 +572,10 @@ namespace thekogans {
                                 std::string (),
                                 config.GetVersion (),
                                 XML_EXT));
-                    std::cout << "Creating " << config_file << "\n";
-                    std::cout.flush ();
-                    std::string configFilePath = ToSystemPath (config_file);
-                    util::Directory::Create (util::Path (configFilePath).GetDirectory ());
-                    std::fstream configFile (
-                        configFilePath.c_str (),
-                        std::fstream::out | std::fstream::trunc);
-                    if (configFile.is_open ()) {
+                    // Build the config in memory. If it did not change, the installed
+                    // file (and its timestamp) is left alone.
+                    std::stringstream configFile;
+                    {
                         util::Attributes attributes;
                         attributes.push_back (
                             util::Attribute (
@@ -691,17 +699,15 @@ namespace thekogans {
                         }
                         configFile << util::CloseTag (0, thekogans_make::TAG_THEKOGANS_MAKE);
                     }
-                    else {
-                        THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
-                            "Unable to open: %s",
-                            configFilePath.c_str ());
-                    }
+                    WriteConfigFile (config_file, configFile.str ());
                 }
             }
 
             void Installer::InstallPlugin (const std::string &project_root) {
+                thekogans_make::TrimPoint trimPoint;
                 if (installedProjects.find (project_root) == installedProjects.end ()) {
                     installedProjects.insert (project_root);
+                    THEKOGANS_MAKE_CORE_TRACE_SPAN ("install", project_root);
                     std::string install_config = config;
                     if (install_config.empty ()) {
                         install_config =
@@ -805,6 +811,7 @@ namespace thekogans {
             }
 
             void Installer::InstallPluginHosts (const std::string &project_root) {
+                thekogans_make::TrimPoint trimPoint;
                 const thekogans_make &plugin_config =
                     thekogans_make::GetConfig (
                         project_root,
@@ -933,11 +940,13 @@ namespace thekogans {
                     }
                 }
                 // Uninstall old version
-                UninstallLibrary (
-                    DebugShared.organization,
-                    DebugShared.project,
-                    DebugShared.GetVersion (),
-                    false);
+                if (!incremental) {
+                    UninstallLibrary (
+                        DebugShared.organization,
+                        DebugShared.project,
+                        DebugShared.GetVersion (),
+                        false);
+                }
                 std::cout << "Installing " << DebugShared.project_root << std::endl;
                 std::cout.flush ();
                 // install = "yes"
@@ -982,10 +991,15 @@ namespace thekogans {
                             ReleaseStatic.GetProjectGoal (),
                             ReleaseStatic.GetToolchainGoal ()));
                 }
-                for (std::set<InstallPaths>::const_iterator
-                        it = installPaths.begin (),
-                        end = installPaths.end (); it != end; ++it) {
-                    CopyFile ((*it).first, (*it).second);
+                if (incremental) {
+                    SyncInstall (
+                        DebugShared.organization,
+                        DebugShared.project,
+                        DebugShared.GetVersion (),
+                        std::vector<CopyPaths> (installPaths.begin (), installPaths.end ()));
+                }
+                else {
+                    CopyFiles (std::vector<CopyPaths> (installPaths.begin (), installPaths.end ()));
                 }
                 std::string config_file =
                     MakePath (
@@ -996,14 +1010,10 @@ namespace thekogans {
                             std::string (),
                             DebugShared.GetVersion (),
                             XML_EXT));
-                std::cout << "Creating " << config_file << "\n";
-                std::cout.flush ();
-                std::string configFilePath = ToSystemPath (config_file);
-                util::Directory::Create (util::Path (configFilePath).GetDirectory ());
-                std::fstream configFile (
-                    configFilePath.c_str (),
-                    std::fstream::out | std::fstream::trunc);
-                if (configFile.is_open ()) {
+                // Build the config in memory. If it did not change, the installed
+                // file (and its timestamp) is left alone.
+                std::stringstream configFile;
+                {
                     util::Attributes attributes;
                     attributes.push_back (
                         util::Attribute (
@@ -1772,13 +1782,28 @@ namespace thekogans {
                         }
                         configFile << util::CloseTag (1, thekogans_make::TAG_DEPENDENCIES);
                     }
+                    // closures
+                    {
+                        const thekogans_make *variants[] = {
+                            &DebugShared,
+                            &DebugStatic,
+                            &ReleaseShared,
+                            &ReleaseStatic
+                        };
+                        // build_config/build_type projects install the same variant four times.
+                        std::set<std::pair<std::string, std::string>> closureVariants;
+                        for (std::size_t i = 0; i < 4; ++i) {
+                            if (closureVariants.insert (
+                                    std::make_pair (variants[i]->config, variants[i]->type)).second) {
+                                thekogans_make::Closure closure;
+                                variants[i]->GetToolchainClosure (closure);
+                                configFile << closure.ToString (1, variants[i]->config, variants[i]->type);
+                            }
+                        }
+                    }
                     configFile << util::CloseTag (0, thekogans_make::TAG_THEKOGANS_MAKE);
                 }
-                else {
-                    THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
-                        "Unable to open: %s",
-                        configFilePath.c_str ());
-                }
+                WriteConfigFile (config_file, configFile.str ());
             }
 
             void Installer::InstallDependency (const thekogans_make &dependency) {
@@ -15,13 +15,30 @@
 // You should have received a copy of the GNU General Public License
 // along with libthekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
 
+#include "thekogans/util/Environment.h"
+#if defined (TOOLCHAIN_OS_Windows)
+    #include <io.h>
+    #include <fcntl.h>
+    #include <sys/locking.h>
+    #include <sys/stat.h>
+#else // defined (TOOLCHAIN_OS_Windows)
+    #include <sys/file.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif // defined (TOOLCHAIN_OS_Windows)
+#include <cerrno>
+#include <cstdio>
+#include <random>
 #include <fstream>
+#include <sstream>
 #include "thekogans/util/Path.h"
 #include "thekogans/util/File.h"
 #include "thekogans/util/Buffer.h"
 #include "thekogans/util/StringUtils.h"
 #include "thekogans/util/XMLUtils.h"
 #include "thekogans/util/Exception.h"
+#include "thekogans/make/core/Utils.h"
+#include "thekogans/make/core/Trace.h"
 #include "thekogans/make/core/Manifest.h"
 
 namespace thekogans {
@@ -30,56 +47,194 @@ namespace thekogans {
 
             namespace {
                 const char * const TAG_MANIFEST = "manifest";
-                const char * const ATTR_SCHEMA_VERSION = "schema_version";
 
                 const char * const TAG_FILE = "file";
                 const char * const ATTR_NAME = "name";
                 const char * const TAG_DEPENDENT = "dependent";
 
-                const util::ui32 MANIFEST_XML_SCHEMA_VERSION = 1;
+                const char * const JOURNAL_EXT = "journal";
+                const char * const LOCK_EXT = "lock";
+                const char RECORD_ADD = '+';
+                const char RECORD_DELETE = '-';
+                const char RECORD_SEPARATOR = '\t';
+                // Don't bother compacting small journals.
+                const std::size_t MIN_COMPACT_RECORDS = 1024;
+
+                std::string GetJournalPath (const std::string &path) {
+                    std::string::size_type separator = path.find_last_of (EXT_SEPARATOR_CHAR);
+                    std::string::size_type directory = path.find_last_of ("/\\");
+                    return (separator != std::string::npos &&
+                        (directory == std::string::npos || separator > directory) ?
+                            path.substr (0, separator) : path) + EXT_SEPARATOR + JOURNAL_EXT;
+                }
+
+                // Names can contain the record (\t) and line (\n)
+                // separators, so those (and the escape itself) are escaped.
+                void AppendField (
+                        const std::string &field,
+                        std::string &records) {
+                    for (std::size_t i = 0, count = field.size (); i < count; ++i) {
+                        switch (field[i]) {
+                            case '\\':
+                                records += "\\\\";
+                                break;
+                            case '\t':
+                                records += "\\t";
+                                break;
+                            case '\n':
+                                records += "\\n";
+                                break;
+                            case '\r':
+                                records += "\\r";
+                                break;
+                            default:
+                                records += field[i];
+                                break;
+                        }
+                    }
+                }
+
+                std::string UnescapeField (const std::string &field) {
+                    std::string result;
+                    result.reserve (field.size ());
+                    for (std::size_t i = 0, count = field.size (); i < count; ++i) {
+                        if (field[i] == '\\' && i + 1 < count) {
+                            switch (field[++i]) {
+                                case 't':
+                                    result += '\t';
+                                    break;
+                                case 'n':
+                                    result += '\n';
+                                    break;
+                                case 'r':
+                                    result += '\r';
+                                    break;
+                                default:
+                                    result += field[i];
+                                    break;
+                            }
+                        }
+                        else {
+                            result += field[i];
+                        }
+                    }
+                    return result;
+                }
+
+                void FormatRecord (
+                        char type,
+                        const std::string &file,
+                        const std::string &dependent,
+                        std::string &records) {
+                    records += type;
+                    records += RECORD_SEPARATOR;
+                    AppendField (file, records);
+                    records += RECORD_SEPARATOR;
+                    AppendField (dependent, records);
+                    records += '\n';
+                }
+
+                std::string ReadFile (const std::string &path) {
+                    std::ifstream file (path.c_str (), std::ios::in | std::ios::binary);
+                    std::ostringstream contents;
+                    contents << file.rdbuf ();
+                    return contents.str ();
+                }
+
+                bool TruncateFile (
+                        const std::string &path,
+                        std::size_t size) {
+                #if defined (TOOLCHAIN_OS_Windows)
+                    int fd = _open (path.c_str (), _O_RDWR | _O_BINARY);
+                    if (fd == -1) {
+                        return false;
+                    }
+                    bool result = _chsize_s (fd, (__int64)size) == 0;
+                    _close (fd);
+                    return result;
+                #else // defined (TOOLCHAIN_OS_Windows)
+                    return truncate (path.c_str (), (off_t)size) == 0;
+                #endif // defined (TOOLCHAIN_OS_Windows)
+                }
+
+                // Serializes journal writers (Save and Compact) across
+                // processes. Readers don't need it; they only accept newline
+                // terminated records, and Compact replaces the journal
+                // atomically. The lock file itself is never deleted, as that
+                // would race with the next locker.
+                struct JournalLock {
+                    std::string path;
+                    int fd;
+
+                    explicit JournalLock (const std::string &journalPath) :
+                            path (journalPath + EXT_SEPARATOR + LOCK_EXT),
+                            fd (-1) {
+                        int result = -1;
+                    #if defined (TOOLCHAIN_OS_Windows)
+                        fd = _open (path.c_str (), _O_RDWR | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+                        if (fd != -1) {
+                            // _LK_LOCK gives up after 10 one second tries.
+                            do {
+                                result = _locking (fd, _LK_LOCK, 1);
+                            } while (result != 0 && errno == EDEADLOCK);
+                        }
+                    #else // defined (TOOLCHAIN_OS_Windows)
+                        fd = open (path.c_str (), O_RDWR | O_CREAT, 0644);
+                        if (fd != -1) {
+                            do {
+                                result = flock (fd, LOCK_EX);
+                            } while (result != 0 && errno == EINTR);
+                        }
+                    #endif // defined (TOOLCHAIN_OS_Windows)
+                        if (result != 0) {
+                            Close ();
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                "Unable to lock: %s.",
+                                path.c_str ());
+                        }
+                    }
+                    ~JournalLock () {
+                    #if defined (TOOLCHAIN_OS_Windows)
+                        _lseek (fd, 0, SEEK_SET);
+                        _locking (fd, _LK_UNLCK, 1);
+                    #else // defined (TOOLCHAIN_OS_Windows)
+                        flock (fd, LOCK_UN);
+                    #endif // defined (TOOLCHAIN_OS_Windows)
+                        Close ();
+                    }
+
+                private:
+                    void Close () {
+                        if (fd != -1) {
+                        #if defined (TOOLCHAIN_OS_Windows)
+                            _close (fd);
+                        #else // defined (TOOLCHAIN_OS_Windows)
+                            close (fd);
+                        #endif // defined (TOOLCHAIN_OS_Windows)
+                            fd = -1;
+                        }
+                    }
+
+                    THEKOGANS_UTIL_DISALLOW_COPY_AND_ASSIGN (JournalLock)
+                };
             }
 
             Manifest::Manifest (
                     const std::string &path_,
                     util::ui64 maxManifestFileSize) :
                     path (path_),
+                    journalPath (GetJournalPath (path_)),
+                    liveRecords (0),
+                    journalRecords (0),
+                    legacy (false),
                     modified (false) {
-                if (util::Path (path).Exists ()) {
-                    util::ReadOnlyFile file (util::HostEndian, path);
-                    // Protect yourself.
-                    util::ui64 fileSize = file.GetSize ();
-                    if (fileSize > maxManifestFileSize) {
-                        THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
-                            "'%s' is bigger (%u) than expected. (" THEKOGANS_UTIL_UI64_FORMAT ")",
-                            path.c_str (),
-                            fileSize,
-                            maxManifestFileSize);
-                    }
-                    util::Buffer buffer (util::HostEndian, (util::ui32)fileSize);
-                    if (buffer.AdvanceWriteOffset (
-                            file.Read (
-                                buffer.GetWritePtr (),
-                                (util::ui32)fileSize)) != (util::ui32)fileSize) {
-                        THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
-                            "Unable to read %u bytes from '%s'.",
-                            fileSize,
-                            path.c_str ());
-                    }
-                    pugi::xml_document document;
-                    pugi::xml_parse_result result =
-                        document.load_buffer (
-                            buffer.GetReadPtr (),
-                            buffer.GetDataAvailableForReading ());
-                    if (!result) {
-                        THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
-                            "Unable to parse %s (%s)",
-                            path.c_str (),
-                            result.description ());
-                    }
-                    pugi::xml_node node = document.document_element ();
-                    if (std::string (node.name ()) == TAG_MANIFEST) {
-                        ParseManifest (node);
-                    }
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("manifest", "Load " + path);
+                if (util::Path (journalPath).Exists ()) {
+                    LoadJournal ();
+                }
+                else if (util::Path (path).Exists ()) {
+                    LoadXML (maxManifestFileSize);
+                    legacy = true;
                 }
             }
 
@@ -104,6 +259,9 @@ namespace thekogans {
                 Dependents::iterator jt = it->second.find (dependent);
                 if (jt == it->second.end ()) {
                     it->second.insert (dependent);
+                    FormatRecord (RECORD_ADD, file, dependent, pendingRecords);
+                    ++liveRecords;
+                    ++journalRecords;
                     modified = true;
                     return true;
                 }
@@ -123,6 +281,9 @@ namespace thekogans {
                             files.erase (it);
                             returnCode = true;
                         }
+                        FormatRecord (RECORD_DELETE, file, dependent, pendingRecords);
+                        --liveRecords;
+                        ++journalRecords;
                         modified = true;
                     }
                 }
@@ -131,45 +292,169 @@ namespace thekogans {
 
             void Manifest::Save () {
                 if (modified) {
-                    std::fstream manifestFile (
-                        path.c_str (),
-                        std::fstream::out | std::fstream::trunc);
-                    if (manifestFile.is_open ()) {
-                        util::Attributes attributes;
-                        attributes.push_back (
-                            util::Attribute (
-                                ATTR_SCHEMA_VERSION,
-                                util::ui32Tostring (MANIFEST_XML_SCHEMA_VERSION)));
-                        manifestFile << util::OpenTag (0, TAG_MANIFEST, attributes, false, true);
-                        for (Files::const_iterator
-                                 it = files.begin (),
-                                 end = files.end (); it != end; ++it) {
-                            util::Attributes attributes;
-                            attributes.push_back (
-                                util::Attribute (
-                                    ATTR_NAME,
-                                    util::EncodeXMLCharEntities (it->first)));
-                            manifestFile << util::OpenTag (1, TAG_FILE, attributes, false, true);
-                            for (Dependents::const_iterator
-                                     jt = it->second.begin (),
-                                     end = it->second.end (); jt != end; ++jt) {
-                                manifestFile <<
-                                    util::OpenTag (2, TAG_DEPENDENT,
-                                        util::Attributes (), false, false) <<
-                                    util::EncodeXMLCharEntities (*jt) <<
-                                    util::CloseTag (0, TAG_DEPENDENT);
+                    THEKOGANS_MAKE_CORE_TRACE_SPAN ("manifest", "Save " + path);
+                    if (legacy ||
+                            (journalRecords > MIN_COMPACT_RECORDS &&
+                                journalRecords > liveRecords * 2)) {
+                        Compact ();
+                    }
+                    else {
+                        JournalLock lock (journalPath);
+                        // A writer that died mid append leaves a torn record
+                        // at the end. Appending after it would glue our first
+                        // record to it, so cut it off first.
+                        std::string journal = ReadFile (journalPath);
+                        if (!journal.empty () && journal[journal.size () - 1] != '\n') {
+                            std::string::size_type end = journal.find_last_of ('\n');
+                            if (!TruncateFile (journalPath, end != std::string::npos ? end + 1 : 0)) {
+                                THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                    "Unable to truncate: %s.",
+                                    journalPath.c_str ());
                             }
-                            manifestFile << util::CloseTag (1, TAG_FILE);
                         }
-                        manifestFile << util::CloseTag (0, TAG_MANIFEST);
-                        modified = false;
+                        // One write per Save keeps concurrent
+                        // readers from seeing partial records.
+                        std::ofstream journalFile (
+                            journalPath.c_str (),
+                            std::ios::out | std::ios::app | std::ios::binary);
+                        if (!journalFile.is_open ()) {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                "Unable to open: %s.",
+                                journalPath.c_str ());
+                        }
+                        journalFile << pendingRecords;
+                        journalFile.flush ();
                     }
-                    else {
+                    pendingRecords.clear ();
+                    modified = false;
+                }
+            }
+
+            void Manifest::LoadJournal () {
+                ReplayRecords (ReadFile (journalPath));
+            }
+
+            void Manifest::ReplayRecords (const std::string &records) {
+                // Only newline terminated records are complete. Anything
+                // after the last newline is a torn (partially written) one.
+                for (std::string::size_type begin = 0,
+                        end = records.find ('\n');
+                        end != std::string::npos;
+                        begin = end + 1, end = records.find ('\n', begin)) {
+                    ++journalRecords;
+                    std::string record = records.substr (begin, end - begin);
+                    std::string::size_type fileSeparator = record.find (RECORD_SEPARATOR);
+                    std::string::size_type dependentSeparator =
+                        fileSeparator != std::string::npos ?
+                            record.find (RECORD_SEPARATOR, fileSeparator + 1) : std::string::npos;
+                    if (fileSeparator != 1 || dependentSeparator == std::string::npos) {
+                        continue;
+                    }
+                    std::string file = UnescapeField (
+                        record.substr (fileSeparator + 1, dependentSeparator - fileSeparator - 1));
+                    std::string dependent = UnescapeField (record.substr (dependentSeparator + 1));
+                    if (record[0] == RECORD_ADD) {
+                        if (files[file].insert (dependent).second) {
+                            ++liveRecords;
+                        }
+                    }
+                    else if (record[0] == RECORD_DELETE) {
+                        Files::iterator it = files.find (file);
+                        if (it != files.end () && it->second.erase (dependent) != 0) {
+                            if (it->second.empty ()) {
+                                files.erase (it);
+                            }
+                            --liveRecords;
+                        }
+                    }
+                }
+            }
+
+            void Manifest::LoadXML (util::ui64 maxManifestFileSize) {
+                util::ReadOnlyFile file (util::HostEndian, path);
+                // Protect yourself.
+                util::ui64 fileSize = file.GetSize ();
+                if (fileSize > maxManifestFileSize) {
+                    THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                        "'%s' is bigger (%u) than expected. (" THEKOGANS_UTIL_UI64_FORMAT ")",
+                        path.c_str (),
+                        fileSize,
+                        maxManifestFileSize);
+                }
+                util::Buffer buffer (util::HostEndian, (util::ui32)fileSize);
+                if (buffer.AdvanceWriteOffset (
+                        file.Read (
+                            buffer.GetWritePtr (),
+                            (util::ui32)fileSize)) != (util::ui32)fileSize) {
+                    THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                        "Unable to read %u bytes from '%s'.",
+                        fileSize,
+                        path.c_str ());
+                }
+                pugi::xml_document document;
+                pugi::xml_parse_result result =
+                    document.load_buffer (
+                        buffer.GetReadPtr (),
+                        buffer.GetDataAvailableForReading ());
+                if (!result) {
+                    THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                        "Unable to parse %s (%s)",
+                        path.c_str (),
+                        result.description ());
+                }
+                pugi::xml_node node = document.document_element ();
+                if (std::string (node.name ()) == TAG_MANIFEST) {
+                    ParseManifest (node);
+                }
+            }
+
+            void Manifest::Compact () {
+                JournalLock lock (journalPath);
+                // Other processes might have appended to (or compacted) the
+                // journal since it was loaded. Start from what's on disk now
+                // and reapply our changes on top, so that theirs survive the
+                // rename.
+                if (util::Path (journalPath).Exists ()) {
+                    files.clear ();
+                    liveRecords = 0;
+                    LoadJournal ();
+                    ReplayRecords (pendingRecords);
+                }
+                std::random_device random;
+                std::string tempPath =
+                    journalPath + EXT_SEPARATOR + "tmp" + util::ui32Tostring (random ());
+                {
+                    std::ofstream journalFile (
+                        tempPath.c_str (),
+                        std::ios::out | std::ios::trunc | std::ios::binary);
+                    if (!journalFile.is_open ()) {
                         THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
                             "Unable to open: %s.",
-                            path.c_str ());
+                            tempPath.c_str ());
+                    }
+                    std::string records;
+                    for (Files::const_iterator
+                             it = files.begin (),
+                             end = files.end (); it != end; ++it) {
+                        for (Dependents::const_iterator
+                                 jt = it->second.begin (),
+                                 end = it->second.end (); jt != end; ++jt) {
+                            FormatRecord (RECORD_ADD, it->first, *jt, records);
+                        }
                     }
+                    journalFile << records;
+                }
+                if (std::rename (tempPath.c_str (), journalPath.c_str ()) != 0) {
+                    util::Path (tempPath).Delete ();
+                    THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                        "Unable to move %s to %s.",
+                        tempPath.c_str (),
+                        journalPath.c_str ());
                 }
+                journalRecords = liveRecords;
+                // The journal takes precedence over the xml manifest from
+                // now on. The xml file is left for older tools to read.
+                legacy = false;
             }
 
             void Manifest::ParseManifest (pugi::xml_node &node) {
@@ -197,8 +482,9 @@ namespace thekogans {
                                 if (childName == TAG_DEPENDENT) {
                                     std::string dependent =
                                         util::Decodestring (util::TrimSpaces (child.text ().get ()));
-                                    if (!dependent.empty ()) {
-                                        result.first->second.insert (dependent);
+                                    if (!dependent.empty () &&
+                                            result.first->second.insert (dependent).second) {
+                                        ++liveRecords;
                                     }
                                 }
                             }
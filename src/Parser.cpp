@@ -21,6 +21,7 @@
 #include "thekogans/util/Version.h"
 #include "thekogans/make/core/thekogans_make.h"
 #include "thekogans/make/core/Utils.h"
+#include "thekogans/make/core/Counters.h"
 #include "thekogans/make/core/Function.h"
 #include "thekogans/make/core/Parser.h"
 
@@ -32,11 +33,13 @@ namespace thekogans {
                     const char *expression_,
                     const core::thekogans_make &config_) :
                     expression (expression_),
+                    end (0),
                     config (config_) {
                 if (expression == 0) {
                     THEKOGANS_UTIL_THROW_ERROR_CODE_EXCEPTION (
                         THEKOGANS_UTIL_OS_ERROR_CODE_EINVAL);
                 }
+                end = expression + strlen (expression);
             }
 
             Tokenizer::Token Tokenizer::GetToken () {
@@ -46,6 +49,7 @@ namespace thekogans {
                     return token;
                 }
                 else {
+                    Counters::Increment (Counters::TOKENS);
                     while (*expression != 0 && isspace (*expression)) {
                         ++expression;
                     }
@@ -130,7 +134,7 @@ namespace thekogans {
                                     case '$': {
                                         ++expression;
                                         util::TenantReadBuffer buffer (
-                                            util::HostEndian, expression, strlen (expression));
+                                            util::HostEndian, expression, end - expression);
                                         value += Function::ParseAndExec (config, buffer).ToString ();
                                         expression += buffer.readOffset;
                                         break;
@@ -153,7 +157,7 @@ namespace thekogans {
                         case '$': {
                             ++expression;
                             util::TenantReadBuffer buffer (
-                                util::HostEndian, expression, strlen (expression));
+                                util::HostEndian, expression, end - expression);
                             Value value = Function::ParseAndExec (config, buffer);
                             expression += buffer.readOffset;
                             return Token (Token::VALUE, value);
@@ -0,0 +1,233 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#include "thekogans/util/Environment.h"
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+#include <iomanip>
+#include <fstream>
+#include "thekogans/util/LockGuard.h"
+#include "thekogans/util/StringUtils.h"
+#include "thekogans/make/core/Counters.h"
+#include "thekogans/make/core/Profiler.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+
+            namespace {
+                util::ui64 GetSteadyTime () {
+                    return (util::ui64)std::chrono::duration_cast<std::chrono::nanoseconds> (
+                        std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+                }
+
+                util::ui64 GetExpressions () {
+                    return
+                        Counters::Get (Counters::EVAL_CALLS) +
+                        Counters::Get (Counters::EXPAND_CALLS);
+                }
+
+                // Innermost element being profiled on this thread.
+                thread_local pugi::xml_node_struct *currentElement = 0;
+
+                bool CompareEntries (
+                        const Profiler::Entry &entry1,
+                        const Profiler::Entry &entry2) {
+                    return entry1.time > entry2.time;
+                }
+            }
+
+            Profiler::Scope::Scope (
+                    const std::string &file,
+                    const pugi::xml_node &node) :
+                    enabled (ToolchainProfiler::Instance ()->IsEnabled ()),
+                    kind ("element"),
+                    start (0),
+                    expressions (0),
+                    allocations (0),
+                    previousElement (currentElement) {
+                if (enabled && node.internal_object () == currentElement) {
+                    enabled = false;
+                }
+                if (enabled) {
+                    currentElement = node.internal_object ();
+                    location = file + ":" + util::ui32Tostring (
+                        ToolchainProfiler::Instance ()->GetLine (file, node.offset_debug ()));
+                    name = std::string ("<") + node.name () + ">";
+                    expressions = GetExpressions ();
+                    allocations = Counters::Get (Counters::ALLOCATIONS);
+                    start = GetSteadyTime ();
+                }
+            }
+
+            Profiler::Scope::Scope (
+                    const char *kind_,
+                    const std::string &name_) :
+                    enabled (ToolchainProfiler::Instance ()->IsEnabled ()),
+                    kind (kind_),
+                    name (name_),
+                    start (0),
+                    expressions (0),
+                    allocations (0),
+                    previousElement (currentElement) {
+                if (enabled) {
+                    expressions = GetExpressions ();
+                    allocations = Counters::Get (Counters::ALLOCATIONS);
+                    start = GetSteadyTime ();
+                }
+            }
+
+            Profiler::Scope::~Scope () {
+                if (enabled) {
+                    util::ui64 time = GetSteadyTime () - start;
+                    currentElement = previousElement;
+                    ToolchainProfiler::Instance ()->Add (
+                        kind,
+                        location,
+                        name,
+                        time,
+                        GetExpressions () - expressions,
+                        Counters::Get (Counters::ALLOCATIONS) - allocations);
+                }
+            }
+
+            Profiler::Profiler () :
+                    enabled (false),
+                    path (util::GetEnvironmentVariable ("THEKOGANS_MAKE_PROFILE")) {
+                if (!path.empty ()) {
+                    enabled = true;
+                    std::atexit (WriteReport);
+                }
+            }
+
+            void Profiler::AddFile (
+                    const std::string &file,
+                    const char *buffer,
+                    std::size_t length) {
+                if (enabled) {
+                    std::vector<std::ptrdiff_t> lines;
+                    lines.push_back (0);
+                    for (std::size_t i = 0; i < length; ++i) {
+                        if (buffer[i] == '\n') {
+                            lines.push_back ((std::ptrdiff_t)i + 1);
+                        }
+                    }
+                    util::LockGuard<util::SpinLock> guard (spinLock);
+                    files[file].swap (lines);
+                }
+            }
+
+            util::ui32 Profiler::GetLine (
+                    const std::string &file,
+                    std::ptrdiff_t offset) const {
+                if (offset >= 0) {
+                    util::LockGuard<util::SpinLock> guard (spinLock);
+                    std::unordered_map<std::string, std::vector<std::ptrdiff_t>>::const_iterator
+                        it = files.find (file);
+                    if (it != files.end ()) {
+                        return (util::ui32)(std::upper_bound (
+                            it->second.begin (), it->second.end (), offset) - it->second.begin ());
+                    }
+                }
+                return 0;
+            }
+
+            void Profiler::Add (
+                    const char *kind,
+                    const std::string &location,
+                    const std::string &name,
+                    util::ui64 time,
+                    util::ui64 expressions,
+                    util::ui64 allocations) {
+                std::string key = std::string (kind) + "\n" + location + "\n" + name;
+                util::LockGuard<util::SpinLock> guard (spinLock);
+                Entry &entry = entries[key];
+                if (entry.calls++ == 0) {
+                    entry.kind = kind;
+                    entry.location = location;
+                    entry.name = name;
+                }
+                entry.time += time;
+                entry.expressions += expressions;
+                entry.allocations += allocations;
+            }
+
+            void Profiler::GetEntries (std::vector<Entry> &entries_) const {
+                {
+                    util::LockGuard<util::SpinLock> guard (spinLock);
+                    entries_.reserve (entries_.size () + entries.size ());
+                    for (std::unordered_map<std::string, Entry>::const_iterator
+                            it = entries.begin (),
+                            end = entries.end (); it != end; ++it) {
+                        entries_.push_back (it->second);
+                    }
+                }
+                std::stable_sort (entries_.begin (), entries_.end (), CompareEntries);
+            }
+
+            void Profiler::Report (
+                    std::ostream &stream,
+                    std::size_t count) const {
+                std::vector<Entry> entries_;
+                GetEntries (entries_);
+                if (count == 0 || count > entries_.size ()) {
+                    count = entries_.size ();
+                }
+                stream <<
+                    std::setw (12) << "total(us)" <<
+                    std::setw (10) << "calls" <<
+                    std::setw (12) << "avg(us)" <<
+                    std::setw (12) << "exprs" <<
+                    std::setw (12) << "allocs" <<
+                    "  kind      where\n";
+                for (std::size_t i = 0; i < count; ++i) {
+                    const Entry &entry = entries_[i];
+                    stream <<
+                        std::setw (12) << entry.time / 1000 <<
+                        std::setw (10) << entry.calls <<
+                        std::setw (12) << entry.time / entry.calls / 1000 <<
+                        std::setw (12) << entry.expressions <<
+                        std::setw (12) << entry.allocations <<
+                        "  " << std::left << std::setw (10) << entry.kind << std::right;
+                    if (!entry.location.empty ()) {
+                        stream << entry.location << " ";
+                    }
+                    // Keep the report one entry per line.
+                    std::string name = entry.name;
+                    std::replace (name.begin (), name.end (), '\n', ' ');
+                    stream << name << "\n";
+                }
+                stream.flush ();
+            }
+
+            void Profiler::WriteReport () {
+                const Profiler &profiler = *ToolchainProfiler::Instance ();
+                if (profiler.path == "-") {
+                    profiler.Report (std::cerr);
+                }
+                else {
+                    std::ofstream reportFile (profiler.path.c_str (), std::ios::out | std::ios::trunc);
+                    if (reportFile.is_open ()) {
+                        profiler.Report (reportFile);
+                    }
+                }
+            }
+
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
@@ -15,16 +15,29 @@
 // You should have received a copy of the GNU General Public License
 // along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
 
+#include <cstring>
 #include <vector>
+#include <set>
+#if defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
+    #include <algorithm>
+    #include <atomic>
+    #include <thread>
+    #include <mutex>
+    #include <iostream>
+    #include "pugixml/pugixml.hpp"
+#endif // defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
 #include "thekogans/util/Types.h"
 #include "thekogans/util/Version.h"
 #include "thekogans/util/Path.h"
 #include "thekogans/util/Directory.h"
+#include "thekogans/util/LoggerMgr.h"
 #if defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
+    #include "thekogans/make/core/SourceCache.h"
     #include "thekogans/make/core/Sources.h"
 #endif // defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
 #include "thekogans/make/core/thekogans_make.h"
 #include "thekogans/make/core/Utils.h"
+#include "thekogans/make/core/Trace.h"
 #include "thekogans/make/core/Project.h"
 
 namespace thekogans {
@@ -335,6 +348,255 @@ namespace thekogans {
                 return MakePath (components, true);
             }
 
+        #if defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
+            namespace {
+                struct ProjectReference {
+                    std::string organization;
+                    std::string name;
+                    std::string branch;
+                    std::string version;
+
+                    ProjectReference (
+                        const std::string &organization_,
+                        const std::string &name_,
+                        const std::string &branch_,
+                        const std::string &version_) :
+                        organization (organization_),
+                        name (name_),
+                        branch (branch_),
+                        version (version_) {}
+                };
+
+                inline bool IsLiteral (const char *value) {
+                    return strstr (value, "$(") == 0;
+                }
+
+                // Collect the unconditional project dependencies of the given
+                // project without evaluating its thekogans_make.xml.
+                void GetProjectReferences (
+                        const std::string &project_root,
+                        std::list<ProjectReference> &references) {
+                    std::string configPath =
+                        ToSystemPath (MakePath (project_root, THEKOGANS_MAKE_XML));
+                    pugi::xml_document document;
+                    if (util::Path (configPath).Exists () && document.load_file (configPath.c_str ())) {
+                        pugi::xml_node root = document.document_element ();
+                        for (pugi::xml_node dependencies = root.child (thekogans_make::TAG_DEPENDENCIES);
+                                !dependencies.empty ();
+                                dependencies = dependencies.next_sibling (thekogans_make::TAG_DEPENDENCIES)) {
+                            for (pugi::xml_node child = dependencies.first_child ();
+                                    !child.empty (); child = child.next_sibling ()) {
+                                if (child.type () == pugi::node_element) {
+                                    std::string childName = child.name ();
+                                    if (childName == thekogans_make::TAG_PROJECT ||
+                                            childName == thekogans_make::TAG_DEPENDENCY) {
+                                        const char *organization =
+                                            child.attribute (thekogans_make::ATTR_ORGANIZATION).value ();
+                                        const char *name =
+                                            child.attribute (thekogans_make::ATTR_NAME).value ();
+                                        const char *branch =
+                                            child.attribute (thekogans_make::ATTR_BRANCH).value ();
+                                        const char *version =
+                                            child.attribute (thekogans_make::ATTR_VERSION).value ();
+                                        const char *example =
+                                            child.attribute (thekogans_make::ATTR_EXAMPLE).value ();
+                                        if (*name != '\0' && *example == '\0' &&
+                                                IsLiteral (organization) && IsLiteral (name) &&
+                                                IsLiteral (branch) && IsLiteral (version)) {
+                                            references.push_back (
+                                                ProjectReference (
+                                                    *organization != '\0' ?
+                                                        std::string (organization) :
+                                                        _TOOLCHAIN_DEFAULT_ORGANIZATION,
+                                                    name,
+                                                    // <dependency> is branchless.
+                                                    childName == thekogans_make::TAG_PROJECT ?
+                                                        branch : "",
+                                                    version));
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+
+                // Mirror Project::Find. If the project is installed, or
+                // can't be found in the sources, there's nothing to fetch.
+                bool ResolveReference (
+                        Sources &sources,
+                        ProjectReference &reference) {
+                    if (reference.organization.empty () ||
+                            Project::IsInstalled (
+                                reference.organization,
+                                reference.name,
+                                reference.branch,
+                                reference.version,
+                                std::string ())) {
+                        return false;
+                    }
+                    if (reference.branch.empty ()) {
+                        std::string branch =
+                            GetDefaultBranch (reference.organization, reference.name);
+                        if (!branch.empty ()) {
+                            reference.branch = branch;
+                            if (Project::IsInstalled (
+                                    reference.organization,
+                                    reference.name,
+                                    reference.branch,
+                                    reference.version,
+                                    std::string ())) {
+                                return false;
+                            }
+                        }
+                    }
+                    if (reference.version.empty ()) {
+                        reference.version =
+                            GetDefaultVersion (reference.organization, reference.name);
+                        if (reference.version.empty ()) {
+                            util::Version localVersion (
+                                Project::GetLatestVersion (
+                                    reference.organization,
+                                    reference.name,
+                                    reference.branch));
+                            util::Version sourceVersion (
+                                sources.GetSourceProjectLatestVersion (
+                                    reference.organization,
+                                    reference.name,
+                                    reference.branch));
+                            if (localVersion < sourceVersion) {
+                                reference.version = sourceVersion.ToString ();
+                            }
+                            else {
+                                // Either nothing to fetch, or the latest
+                                // version is already installed.
+                                if (localVersion != util::Version ()) {
+                                    reference.version = localVersion.ToString ();
+                                }
+                                return false;
+                            }
+                        }
+                        if (Project::IsInstalled (
+                                reference.organization,
+                                reference.name,
+                                reference.branch,
+                                reference.version,
+                                std::string ())) {
+                            return false;
+                        }
+                    }
+                    return sources.IsSourceProject (
+                        reference.organization,
+                        reference.name,
+                        reference.branch,
+                        reference.version);
+                }
+            }
+
+            void Project::Prefetch (const std::string &project_root) {
+                // Roots walked, or fetched, by this call. Failed fetches
+                // are left out so that the next call (or Project::Find)
+                // tries them again. Only this thread touches it.
+                std::set<std::string> visited;
+                visited.insert (project_root);
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("dependencies", "Prefetch " + project_root);
+                // Create the singletons before any worker threads get to them.
+                Sources &sources = *ToolchainSources::Instance ();
+                // Archives looked up by one worker must not be evicted
+                // by another's Commit. Trim once everyone is done.
+                SourceCache::DeferTrim deferTrim (*ToolchainSourceCache::Instance ());
+                std::list<std::string> level (1, project_root);
+                while (!level.empty ()) {
+                    std::list<std::string> nextLevel;
+                    std::vector<ProjectReference> missing;
+                    std::set<std::string> missingRoots;
+                    for (std::list<std::string>::const_iterator
+                            it = level.begin (),
+                            end = level.end (); it != end; ++it) {
+                        std::list<ProjectReference> references;
+                        GetProjectReferences (*it, references);
+                        for (std::list<ProjectReference>::iterator
+                                jt = references.begin (),
+                                end = references.end (); jt != end; ++jt) {
+                            if (ResolveReference (sources, *jt)) {
+                                std::string root = GetRoot (
+                                    jt->organization, jt->name, jt->branch, jt->version, std::string ());
+                                if (visited.find (root) == visited.end () &&
+                                        missingRoots.insert (root).second) {
+                                    missing.push_back (*jt);
+                                }
+                            }
+                            else {
+                                std::string root = GetRoot (
+                                    jt->organization, jt->name, jt->branch, jt->version, std::string ());
+                                if (IsInstalled (jt->organization, jt->name, jt->branch, jt->version, std::string ()) &&
+                                        visited.insert (root).second) {
+                                    nextLevel.push_back (root);
+                                }
+                            }
+                        }
+                    }
+                    if (!missing.empty ()) {
+                        std::cout << "Prefetching " << missing.size () << " source project(s)" << std::endl;
+                        std::cout.flush ();
+                        std::vector<bool> fetched (missing.size (), false);
+                        std::atomic<std::size_t> next (0);
+                        std::mutex mutex;
+                        std::size_t threadCount = std::min<std::size_t> (
+                            missing.size (),
+                            std::max (1u, std::thread::hardware_concurrency ()));
+                        std::vector<std::thread> threads;
+                        for (std::size_t i = 0; i < threadCount; ++i) {
+                            threads.push_back (
+                                std::thread (
+                                    [&] () {
+                                        for (std::size_t j = next++; j < missing.size (); j = next++) {
+                                            THEKOGANS_UTIL_TRY {
+                                                sources.GetSourceProject (
+                                                    missing[j].organization,
+                                                    missing[j].name,
+                                                    missing[j].branch,
+                                                    missing[j].version);
+                                                std::lock_guard<std::mutex> guard (mutex);
+                                                fetched[j] = true;
+                                            }
+                                            THEKOGANS_UTIL_CATCH (util::Exception) {
+                                                // Project::Find will try again and report the error.
+                                                THEKOGANS_UTIL_LOG_WARNING (
+                                                    "Unable to prefetch %s (%s).\n",
+                                                    GetRoot (
+                                                        missing[j].organization,
+                                                        missing[j].name,
+                                                        missing[j].branch,
+                                                        missing[j].version,
+                                                        std::string ()).c_str (),
+                                                    exception.what ());
+                                            }
+                                        }
+                                    }));
+                        }
+                        for (std::size_t i = 0; i < threadCount; ++i) {
+                            threads[i].join ();
+                        }
+                        for (std::size_t i = 0, count = missing.size (); i < count; ++i) {
+                            if (fetched[i]) {
+                                std::string root = GetRoot (
+                                    missing[i].organization,
+                                    missing[i].name,
+                                    missing[i].branch,
+                                    missing[i].version,
+                                    std::string ());
+                                if (visited.insert (root).second) {
+                                    nextLevel.push_back (root);
+                                }
+                            }
+                        }
+                    }
+                    level.swap (nextLevel);
+                }
+            }
+        #endif // defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
+
         } // namespace core
     } // namespace make
 } // namespace thekogans
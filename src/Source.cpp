@@ -31,9 +31,9 @@
 #include "thekogans/util/Directory.h"
 #include "thekogans/util/LoggerMgr.h"
 #include "thekogans/util/ChildProcess.h"
-#include "thekogans/util/SHA2.h"
 #include "thekogans/util/XMLUtils.h"
 #include "thekogans/make/core/Utils.h"
+#include "thekogans/make/core/Counters.h"
 #include "thekogans/make/core/Version.h"
 #include "thekogans/make/core/Source.h"
 
@@ -77,6 +77,8 @@ namespace thekogans {
             const char * const Source::ATTR_VERSION = "version";
             const char * const Source::ATTR_FILE = "file";
             const char * const Source::ATTR_SHA2_256 = "SHA2-256";
+            const char * const Source::ATTR_ETAG = "etag";
+            const char * const Source::ATTR_LAST_MODIFIED = "last_modified";
 
             const char * const Source::TAG_SOURCE = "source";
             const char * const Source::TAG_PROJECT = "project";
@@ -210,6 +212,7 @@ namespace thekogans {
                     const std::string &name,
                     const std::string &branch,
                     const std::string &version) const {
+                Counters::Increment (Counters::SOURCE_LOOKUPS);
                 for (std::list<Project::Ptr>::const_iterator
                         it = projects.begin (),
                         end = projects.end (); it != end; ++it) {
@@ -234,6 +237,7 @@ namespace thekogans {
             void Source::GetProjectBranches (
                     const std::string &name,
                     std::set<std::string> &branches) const {
+                Counters::Increment (Counters::SOURCE_LOOKUPS);
                 for (std::list<Project::Ptr>::const_iterator
                         it = projects.begin (),
                         end = projects.end (); it != end; ++it) {
@@ -247,6 +251,7 @@ namespace thekogans {
                     const std::string &name,
                     const std::string &branch,
                     std::set<std::string> &versions) const {
+                Counters::Increment (Counters::SOURCE_LOOKUPS);
                 for (std::list<Project::Ptr>::const_iterator
                         it = projects.begin (),
                         end = projects.end (); it != end; ++it) {
@@ -259,6 +264,7 @@ namespace thekogans {
             std::string Source::GetProjectLatestVersion (
                     const std::string &name,
                     const std::string &branch) const {
+                Counters::Increment (Counters::SOURCE_LOOKUPS);
                 util::Version latestVersion (0);
                 for (std::list<Project::Ptr>::const_iterator
                         it = projects.begin (),
@@ -355,6 +361,7 @@ namespace thekogans {
             Source::Toolchain *Source::GetToolchain (
                     const std::string &name,
                     const std::string &version) const {
+                Counters::Increment (Counters::SOURCE_LOOKUPS);
                 for (std::list<Toolchain::Ptr>::const_iterator
                         it = toolchain.begin (),
                         end = toolchain.end (); it != end; ++it) {
@@ -377,6 +384,7 @@ namespace thekogans {
             void Source::GetToolchainVersions (
                     const std::string &name,
                     std::set<std::string> &versions) const {
+                Counters::Increment (Counters::SOURCE_LOOKUPS);
                 for (std::list<Toolchain::Ptr>::const_iterator
                         it = toolchain.begin (),
                         end = toolchain.end (); it != end; ++it) {
@@ -388,6 +396,7 @@ namespace thekogans {
 
             std::string Source::GetToolchainLatestVersion (
                     const std::string &name) const {
+                Counters::Increment (Counters::SOURCE_LOOKUPS);
                 util::Version latestVersion (0);
                 for (std::list<Toolchain::Ptr>::const_iterator
                         it = toolchain.begin (),
@@ -539,6 +548,8 @@ namespace thekogans {
                 if (schema_version.empty ()) {
                     schema_version = util::ui32Tostring (SOURCE_XML_SCHEMA_VERSION);
                 }
+                etag = node.attribute (ATTR_ETAG).value ();
+                last_modified = node.attribute (ATTR_LAST_MODIFIED).value ();
                 if (util::stringToui32 (schema_version.c_str ()) <= SOURCE_XML_SCHEMA_VERSION) {
                     for (pugi::xml_node child = node.first_child ();
                             !child.empty (); child = child.next_sibling ()) {
@@ -637,6 +648,14 @@ namespace thekogans {
                     util::Attribute (ATTR_URL, url));
                 attributes.push_back (
                     util::Attribute (ATTR_SCHEMA_VERSION, schema_version));
+                if (!etag.empty ()) {
+                    attributes.push_back (
+                        util::Attribute (ATTR_ETAG, util::EncodeXMLCharEntities (etag)));
+                }
+                if (!last_modified.empty ()) {
+                    attributes.push_back (
+                        util::Attribute (ATTR_LAST_MODIFIED, util::EncodeXMLCharEntities (last_modified)));
+                }
                 sourceFile << util::OpenTag (indentationLevel, TAG_SOURCE, attributes, false, true);
                 for (std::list<Source::Project::Ptr>::const_iterator
                         it = projects.begin (),
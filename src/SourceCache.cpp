@@ -0,0 +1,299 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#include "thekogans/util/Environment.h"
+#if defined (TOOLCHAIN_OS_Windows)
+    #include <sys/utime.h>
+#else // defined (TOOLCHAIN_OS_Windows)
+    #include <unistd.h>
+    #include <utime.h>
+#endif // defined (TOOLCHAIN_OS_Windows)
+#include <cctype>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "thekogans/util/Path.h"
+#include "thekogans/util/Directory.h"
+#include "thekogans/util/StringUtils.h"
+#include "thekogans/util/Exception.h"
+#include "thekogans/util/LoggerMgr.h"
+#include "thekogans/make/core/Utils.h"
+#include "thekogans/make/core/SourceCache.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+
+            const util::ui64 SourceCache::DEFAULT_MAX_SIZE = 4ULL * 1024 * 1024 * 1024;
+
+            namespace {
+                const char * const CACHE_DIR = "cache";
+                const char * const VIEWS_DIR = "views";
+
+                std::string NormalizeHash (const std::string &SHA2_256) {
+                    std::string hash = SHA2_256;
+                    for (std::size_t i = 0, count = hash.size (); i < count; ++i) {
+                        hash[i] = (char)tolower ((unsigned char)hash[i]);
+                    }
+                    return hash;
+                }
+
+                void Touch (const std::string &path) {
+                #if defined (TOOLCHAIN_OS_Windows)
+                    _utime (path.c_str (), 0);
+                #else // defined (TOOLCHAIN_OS_Windows)
+                    utime (path.c_str (), 0);
+                #endif // defined (TOOLCHAIN_OS_Windows)
+                }
+
+                struct Archive {
+                    std::string path;
+                    std::string hash;
+                    util::Directory::Entry entry;
+                    util::ui64 size;
+
+                    Archive (
+                        const std::string &path_,
+                        const std::string &hash_,
+                        const util::Directory::Entry &entry_,
+                        util::ui64 size_) :
+                        path (path_),
+                        hash (hash_),
+                        entry (entry_),
+                        size (size_) {}
+
+                    bool operator < (const Archive &archive) const {
+                        return entry.lastModifiedDate < archive.entry.lastModifiedDate;
+                    }
+                };
+            }
+
+            std::string SourceCache::GetDefaultPath () {
+                std::string path = util::GetEnvironmentVariable ("THEKOGANS_MAKE_SOURCE_CACHE");
+                return !path.empty () ?
+                    path : MakePath (MakePath (_TOOLCHAIN_ROOT, SOURCES_DIR), CACHE_DIR);
+            }
+
+            util::ui64 SourceCache::GetDefaultMaxSize () {
+                std::string maxSize =
+                    util::TrimSpaces (
+                        util::GetEnvironmentVariable ("THEKOGANS_MAKE_SOURCE_CACHE_MAX_SIZE").c_str ());
+                return !maxSize.empty () ? ParseSize (maxSize) : DEFAULT_MAX_SIZE;
+            }
+
+            std::string SourceCache::GetArchivePath (const std::string &SHA2_256) const {
+                std::string hash = NormalizeHash (SHA2_256);
+                if (hash.size () != 64 ||
+                        hash.find_first_not_of ("0123456789abcdef") != std::string::npos) {
+                    THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                        "Invalid SHA2-256: '%s'.",
+                        SHA2_256.c_str ());
+                }
+                return MakePath (
+                    MakePath (path, hash.substr (0, 2)),
+                    hash + EXT_SEPARATOR + TAR_GZ_EXT);
+            }
+
+            std::string SourceCache::GetTempPath (const std::string &SHA2_256) const {
+                std::random_device random;
+                return GetArchivePath (SHA2_256) + EXT_SEPARATOR + "tmp" +
+                    util::ui32Tostring (random ());
+            }
+
+            std::string SourceCache::Lookup (const std::string &SHA2_256) const {
+                std::string archivePath = ToSystemPath (GetArchivePath (SHA2_256));
+                std::lock_guard<std::mutex> guard (mutex);
+                if (util::Path (archivePath).Exists ()) {
+                    // Mark as most recently used.
+                    Touch (archivePath);
+                    return archivePath;
+                }
+                return std::string ();
+            }
+
+            std::string SourceCache::Commit (
+                    const std::string &tempPath,
+                    const std::string &SHA2_256,
+                    bool verify) {
+                std::string tempFilePath = ToSystemPath (tempPath);
+                if (verify) {
+                    std::string hash = GetFileHash (tempFilePath);
+                    if (NormalizeHash (hash) != NormalizeHash (SHA2_256)) {
+                        util::Path (tempFilePath).Delete ();
+                        THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                            "SHA2-256 mismatch (expected: %s, got: %s).",
+                            SHA2_256.c_str (),
+                            hash.c_str ());
+                    }
+                }
+                std::string archivePath = ToSystemPath (GetArchivePath (SHA2_256));
+                {
+                    std::lock_guard<std::mutex> guard (mutex);
+                    if (std::rename (tempFilePath.c_str (), archivePath.c_str ()) != 0) {
+                        // Lost a race with another process populating
+                        // the same archive. Theirs is just as good.
+                        util::Path (tempFilePath).Delete ();
+                        if (!util::Path (archivePath).Exists ()) {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                "Unable to move %s to %s.",
+                                tempFilePath.c_str (),
+                                archivePath.c_str ());
+                        }
+                    }
+                    else if (sizeKnown) {
+                        size += util::Directory::Entry (archivePath).size;
+                    }
+                }
+                Trim (SHA2_256);
+                return archivePath;
+            }
+
+            std::string SourceCache::Insert (
+                    const std::string &filePath,
+                    const std::string &SHA2_256) {
+                std::string archivePath = Lookup (SHA2_256);
+                if (archivePath.empty ()) {
+                    std::string tempPath = GetTempPath (SHA2_256);
+                    CopyFile (filePath, tempPath);
+                    archivePath = Commit (tempPath, SHA2_256);
+                }
+                return archivePath;
+            }
+
+            std::string SourceCache::GetURL (
+                    const std::string &SHA2_256,
+                    const std::string &organization,
+                    const std::string &archiveName) const {
+                std::string viewRoot = MakePath (MakePath (path, VIEWS_DIR), NormalizeHash (SHA2_256));
+                std::string viewPath = ToSystemPath (
+                    MakePath (MakePath (viewRoot, organization), archiveName));
+                std::lock_guard<std::mutex> guard (mutex);
+                if (!util::Path (viewPath).Exists ()) {
+                    std::string archivePath = ToSystemPath (GetArchivePath (SHA2_256));
+                    util::Directory::Create (util::Path (viewPath).GetDirectory ());
+                #if !defined (TOOLCHAIN_OS_Windows)
+                    if (link (archivePath.c_str (), viewPath.c_str ()) != 0)
+                #endif // !defined (TOOLCHAIN_OS_Windows)
+                    {
+                        CopyFile (archivePath, viewPath);
+                    }
+                }
+                return "file://" + ToSystemPath (viewRoot);
+            }
+
+            void SourceCache::Trim (const std::string &SHA2_256) {
+                std::string cachePath = ToSystemPath (path);
+                std::lock_guard<std::mutex> guard (mutex);
+                if (trimHolds > 0) {
+                    trimPending = true;
+                    if (!SHA2_256.empty ()) {
+                        trimKeep.insert (NormalizeHash (SHA2_256));
+                    }
+                    return;
+                }
+                std::set<std::string> keep;
+                keep.swap (trimKeep);
+                if (!SHA2_256.empty ()) {
+                    keep.insert (NormalizeHash (SHA2_256));
+                }
+                if (maxSize == 0 || (sizeKnown && size <= maxSize) ||
+                        !util::Path (cachePath).Exists ()) {
+                    return;
+                }
+                std::vector<Archive> archives;
+                util::ui64 totalSize = 0;
+                util::Directory directory (cachePath);
+                util::Directory::Entry entry;
+                for (bool gotEntry = directory.GetFirstEntry (entry);
+                        gotEntry; gotEntry = directory.GetNextEntry (entry)) {
+                    if (entry.type == util::Directory::Entry::Folder &&
+                            !util::IsDotOrDotDot (entry.name.c_str ()) &&
+                            entry.name != VIEWS_DIR) {
+                        std::string bucketPath = MakePath (cachePath, entry.name);
+                        util::Directory bucket (bucketPath);
+                        util::Directory::Entry archiveEntry;
+                        for (bool gotArchiveEntry = bucket.GetFirstEntry (archiveEntry);
+                                gotArchiveEntry; gotArchiveEntry = bucket.GetNextEntry (archiveEntry)) {
+                            std::string::size_type separator =
+                                archiveEntry.name.find (EXT_SEPARATOR_CHAR);
+                            // Skip in flight (temporary) files.
+                            if (archiveEntry.type == util::Directory::Entry::File &&
+                                    separator != std::string::npos &&
+                                    archiveEntry.name.substr (separator + 1) == TAR_GZ_EXT) {
+                                archives.push_back (
+                                    Archive (
+                                        MakePath (bucketPath, archiveEntry.name),
+                                        archiveEntry.name.substr (0, separator),
+                                        archiveEntry,
+                                        archiveEntry.size));
+                                totalSize += archiveEntry.size;
+                            }
+                        }
+                    }
+                }
+                if (totalSize > maxSize) {
+                    std::sort (archives.begin (), archives.end ());
+                    for (std::size_t i = 0, count = archives.size ();
+                            totalSize > maxSize && i < count; ++i) {
+                        if (keep.find (archives[i].hash) == keep.end ()) {
+                            THEKOGANS_UTIL_LOG_DEBUG ("Evicting %s\n", archives[i].path.c_str ());
+                            util::Path (archives[i].path).Delete ();
+                            std::string viewRoot =
+                                MakePath (MakePath (cachePath, VIEWS_DIR), archives[i].hash);
+                            if (util::Path (viewRoot).Exists ()) {
+                                // Views are directories (organization/archive).
+                                util::Directory::Delete (viewRoot);
+                            }
+                            totalSize -= archives[i].size;
+                        }
+                    }
+                }
+                size = totalSize;
+                sizeKnown = true;
+            }
+
+            SourceCache::DeferTrim::DeferTrim (SourceCache &cache_) :
+                    cache (cache_) {
+                std::lock_guard<std::mutex> guard (cache.mutex);
+                ++cache.trimHolds;
+            }
+
+            SourceCache::DeferTrim::~DeferTrim () {
+                bool trim = false;
+                {
+                    std::lock_guard<std::mutex> guard (cache.mutex);
+                    if (--cache.trimHolds == 0) {
+                        trim = cache.trimPending;
+                        cache.trimPending = false;
+                    }
+                }
+                if (trim) {
+                    THEKOGANS_UTIL_TRY {
+                        cache.Trim ();
+                    }
+                    THEKOGANS_UTIL_CATCH (util::Exception) {
+                        THEKOGANS_UTIL_LOG_WARNING (
+                            "Unable to trim the source cache (%s).\n",
+                            exception.what ());
+                    }
+                }
+            }
+
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
@@ -18,9 +18,18 @@
 #include "thekogans/util/Environment.h"
 #if !defined (TOOLCHAIN_OS_Windows)
     #include <sys/stat.h>
+    #include <sys/wait.h>
     #include <fcntl.h>
+    #include <pthread.h>
+    #include <signal.h>
 #endif // !defined (TOOLCHAIN_OS_Windows)
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <random>
 #include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <vector>
 #include <iostream>
 #include <fstream>
@@ -28,6 +37,7 @@
     #include <curl/curl.h>
 #endif // defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
 #include "thekogans/util/ByteSwap.h"
+#include "thekogans/util/StringUtils.h"
 #include "thekogans/util/Path.h"
 #include "thekogans/util/File.h"
 #include "thekogans/util/Directory.h"
@@ -36,7 +46,11 @@
 #include "thekogans/util/SHA2.h"
 #include "thekogans/util/XMLUtils.h"
 #include "thekogans/make/core/Utils.h"
+#include "thekogans/make/core/Counters.h"
 #include "thekogans/make/core/Version.h"
+#include "thekogans/make/core/Project.h"
+#include "thekogans/make/core/SourceCache.h"
+#include "thekogans/make/core/Trace.h"
 #include "thekogans/make/core/Sources.h"
 
 namespace thekogans {
@@ -57,6 +71,11 @@ namespace thekogans {
 
             Sources::Sources (const std::string &sourcesFilePath_) :
                     sourcesFilePath (sourcesFilePath_) {
+            #if defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
+                // curl_easy_init will do this lazily, but not in a thread
+                // safe manner. Project::Prefetch fetches from many threads.
+                curl_global_init (CURL_GLOBAL_DEFAULT);
+            #endif // defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
                 if (util::Path (sourcesFilePath).Exists ()) {
                     util::ReadOnlyFile sourcesFile (util::HostEndian, sourcesFilePath);
                     // Protect yourself.
@@ -142,7 +161,9 @@ namespace thekogans {
             }
 
         #if defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
-            void Sources::UpdateSources (const std::string &organization) {
+            void Sources::UpdateSources (
+                    const std::string &organization,
+                    util::ui32 maxConnections) {
                 if (!sources.empty ()) {
                     if (!organization.empty ()) {
                         Source *source = GetSource (organization);
@@ -153,20 +174,15 @@ namespace thekogans {
                         }
                     }
                     else {
+                        std::list<Source *> sources_;
                         for (std::list<Source::Ptr>::iterator
                                 it = sources.begin (),
                                 end = sources.end (); it != end; ++it) {
-                            THEKOGANS_UTIL_TRY {
-                                std::cout << "Updating " << **it << std::endl;
-                                std::cout.flush ();
-                                UpdateSource (**it);
-                            }
-                            THEKOGANS_UTIL_CATCH (util::Exception) {
-                                std::cout << "Unable to update " << **it <<
-                                    "(" << exception.what () << "), skipping.\n";
-                                std::cout.flush ();
-                            }
+                            std::cout << "Updating " << **it << std::endl;
+                            sources_.push_back ((*it).get ());
                         }
+                        std::cout.flush ();
+                        UpdateSources (sources_, maxConnections);
                     }
                     Save ();
                 }
@@ -193,6 +209,11 @@ namespace thekogans {
                 Source *source = GetSource (organization);
                 if (source != 0) {
                     std::cout << "Updating " << *source << " -> " << url << std::endl;
+                    if (source->url != url) {
+                        // Validators belong to the old url.
+                        source->etag.clear ();
+                        source->last_modified.clear ();
+                    }
                     source->url = url;
                 }
                 else {
@@ -293,6 +314,9 @@ namespace thekogans {
                 if (source != 0) {
                     const Source::Project *project = source->GetProject (name, branch, version);
                     if (project != 0) {
+                    #if defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
+                        FetchSourceProject (*source, *project);
+                    #else // defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
                         util::ChildProcess shellProcess (ToSystemPath (_TOOLCHAIN_SHELL));
                         std::list<std::string> components;
                         components.push_back (_TOOLCHAIN_ROOT);
@@ -301,7 +325,16 @@ namespace thekogans {
                         components.push_back ("gettoolchainsourceproject");
                         shellProcess.AddArgument (MakePath (components, false));
                         shellProcess.AddArgument ("-o:" + source->organization);
-                        shellProcess.AddArgument ("-u:" + source->url);
+                        shellProcess.AddArgument ("-u:" +
+                            GetArchiveURL (
+                                *source,
+                                GetFileName (
+                                    source->organization,
+                                    project->name,
+                                    project->branch,
+                                    project->version,
+                                    TAR_GZ_EXT),
+                                project->SHA2_256));
                         shellProcess.AddArgument ("-p:" + project->name);
                         if (!project->branch.empty ()) {
                             shellProcess.AddArgument ("-b:" + project->branch);
@@ -315,6 +348,7 @@ namespace thekogans {
                                 "Unable to execute: '%s'.",
                                 shellProcess.BuildCommandLine ().c_str ());
                         }
+                    #endif // defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
                     }
                     else {
                         THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
@@ -373,18 +407,39 @@ namespace thekogans {
                         void *data,
                         std::size_t elementSize,
                         std::size_t elementCount) = 0;
+
+                    /// \brief
+                    /// If HandleData failed, return why.
+                    virtual std::string GetError () const {
+                        return std::string ();
+                    }
                 };
 
+                // Number of live CURLHandles. Progress bars are only drawn
+                // when there's one (Project::Prefetch downloads in parallel).
+                std::atomic<std::size_t> &GetActiveDownloads () {
+                    static std::atomic<std::size_t> activeDownloads (0);
+                    return activeDownloads;
+                }
+
+                std::mutex &GetProgressMutex () {
+                    static std::mutex progressMutex;
+                    return progressMutex;
+                }
+
                 struct CURLHandle {
                     CURL *curl;
                     DataSink &dataSink;
+                    bool drewProgress;
 
                     CURLHandle (
                             const std::string &url,
                             DataSink &dataSink_) :
                             curl (curl_easy_init ()),
-                            dataSink (dataSink_) {
+                            dataSink (dataSink_),
+                            drewProgress (false) {
                         if (curl != 0) {
+                            ++GetActiveDownloads ();
                             curl_easy_setopt (curl, CURLOPT_URL, url.c_str ());
                             curl_easy_setopt (curl, CURLOPT_FOLLOWLOCATION, 1L);
                             curl_easy_setopt (curl, CURLOPT_WRITEFUNCTION, Callback);
@@ -392,6 +447,7 @@ namespace thekogans {
                             curl_easy_setopt (curl, CURLOPT_USERAGENT, "thekogans_make-agent/1.0");
                             curl_easy_setopt (curl, CURLOPT_NOPROGRESS, 0L);
                             curl_easy_setopt (curl, CURLOPT_XFERINFOFUNCTION, ProgressBar);
+                            curl_easy_setopt (curl, CURLOPT_XFERINFODATA, (void *)this);
                             curl_easy_setopt (curl, CURLOPT_FAILONERROR, 1L);
                             curl_easy_setopt (curl, CURLOPT_SSL_VERIFYPEER, 0);
                         }
@@ -402,14 +458,21 @@ namespace thekogans {
                     }
                     ~CURLHandle () {
                         curl_easy_cleanup (curl);
-                        std::cout << std::endl;
+                        --GetActiveDownloads ();
+                        if (drewProgress) {
+                            std::lock_guard<std::mutex> guard (GetProgressMutex ());
+                            std::cout << std::endl;
+                        }
                     }
 
                     void GetURL () {
                         CURLcode code = curl_easy_perform (curl);
                         if (code != CURLE_OK) {
+                            // A sink failure is more informative than curl's
+                            // generic 'Failed writing received data'.
+                            std::string error = dataSink.GetError ();
                             THEKOGANS_UTIL_THROW_STRING_EXCEPTION ("%s",
-                                curl_easy_strerror (code));
+                                !error.empty () ? error.c_str () : curl_easy_strerror (code));
                         }
                     }
 
@@ -420,19 +483,26 @@ namespace thekogans {
                             size_t elementCount,
                             void *userData) {
                         CURLHandle *curlHandle = (CURLHandle *)userData;
+                        Counters::Increment (Counters::BYTES_DOWNLOADED, elementSize * elementCount);
                         return curlHandle->dataSink.HandleData (data, elementSize, elementCount);
                     }
 
                     static int ProgressBar (
-                            void * /*clientp*/,
+                            void *clientp,
                             curl_off_t dltotal,
                             curl_off_t dlnow,
                             curl_off_t /*ultotal*/,
                             curl_off_t /*ulnow*/) {
+                        if (dltotal <= 0 || GetActiveDownloads () != 1) {
+                            return 0;
+                        }
+                        CURLHandle *curlHandle = (CURLHandle *)clientp;
                         double fraction = (double)dlnow / (double)dltotal;
                         const int MAX_BARWIDTH =  79;
                         int count = (int)((MAX_BARWIDTH - 7) * fraction);
                         if (count > 0) {
+                            std::lock_guard<std::mutex> guard (GetProgressMutex ());
+                            curlHandle->drewProgress = true;
                             std::cout << "\r";
                             std::cout.width (MAX_BARWIDTH);
                             std::cout << std::left << std::string (count, '#') << (int)(fraction * 100.0) << "%";
@@ -441,6 +511,447 @@ namespace thekogans {
                         return 0;
                     }
                 };
+
+                struct FileDataSink : public DataSink {
+                    util::File file;
+
+                    explicit FileDataSink (const std::string &path) :
+                        #if defined (TOOLCHAIN_OS_Windows)
+                            file (
+                                util::HostEndian,
+                                path,
+                                GENERIC_READ | GENERIC_WRITE,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                CREATE_ALWAYS) {}
+                        #else // defined (TOOLCHAIN_OS_Windows)
+                            file (
+                                util::HostEndian,
+                                path,
+                                O_RDWR | O_CREAT | O_TRUNC,
+                                S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) {}
+                        #endif // defined (TOOLCHAIN_OS_Windows)
+
+                    virtual std::size_t HandleData (
+                            void *data,
+                            std::size_t elementSize,
+                            std::size_t elementCount) {
+                        std::size_t size = elementSize * elementCount;
+                        return size != 0 ? (std::size_t)file.Write (data, (util::ui32)size) : 0;
+                    }
+                };
+
+            #if !defined (TOOLCHAIN_OS_Windows)
+                // Writing to a pipe whose reader exited raises SIGPIPE,
+                // which kills the process. While alive, SIGPIPE is blocked
+                // on this thread (such writes fail with EPIPE instead), and
+                // any SIGPIPE raised in the mean time is consumed.
+                struct BlockSIGPIPE {
+                    sigset_t oldMask;
+                    bool wasPending;
+
+                    BlockSIGPIPE () :
+                            wasPending (IsPending ()) {
+                        sigset_t mask;
+                        sigemptyset (&mask);
+                        sigaddset (&mask, SIGPIPE);
+                        pthread_sigmask (SIG_BLOCK, &mask, &oldMask);
+                    }
+                    ~BlockSIGPIPE () {
+                        if (!wasPending && IsPending ()) {
+                            sigset_t mask;
+                            sigemptyset (&mask);
+                            sigaddset (&mask, SIGPIPE);
+                            int sig;
+                            sigwait (&mask, &sig);
+                        }
+                        pthread_sigmask (SIG_SETMASK, &oldMask, 0);
+                    }
+
+                private:
+                    static bool IsPending () {
+                        sigset_t pending;
+                        sigemptyset (&pending);
+                        return sigpending (&pending) == 0 && sigismember (&pending, SIGPIPE) == 1;
+                    }
+                };
+            #endif // !defined (TOOLCHAIN_OS_Windows)
+
+                // Describe a pclose status.
+                std::string GetTarStatus (int status) {
+                #if defined (TOOLCHAIN_OS_Windows)
+                    return "tar exited with " + util::i32Tostring (status);
+                #else // defined (TOOLCHAIN_OS_Windows)
+                    if (status == -1) {
+                        return std::string ("unable to wait for tar: ") + strerror (errno);
+                    }
+                    if (WIFSIGNALED (status)) {
+                        return "tar was killed by signal " + util::i32Tostring (WTERMSIG (status));
+                    }
+                    return "tar exited with " + util::i32Tostring (WEXITSTATUS (status));
+                #endif // defined (TOOLCHAIN_OS_Windows)
+                }
+
+                // Quote a path for the shell popen runs the command with.
+                std::string QuoteShellArgument (const std::string &argument) {
+                #if defined (TOOLCHAIN_OS_Windows)
+                    // cmd.exe has no escape for % inside quotes, and "
+                    // can't appear in a file name.
+                    if (argument.find_first_of ("\"%") != std::string::npos) {
+                        THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                            "Unsupported character in path: '%s'.",
+                            argument.c_str ());
+                    }
+                    // A trailing backslash would escape the closing quote.
+                    std::string::size_type end = argument.find_last_not_of ('\\');
+                    std::string::size_type backslashes = end == std::string::npos ?
+                        argument.size () : argument.size () - end - 1;
+                    return "\"" + argument + std::string (backslashes, '\\') + "\"";
+                #else // defined (TOOLCHAIN_OS_Windows)
+                    // Nothing is special inside single quotes, and a
+                    // single quote is written as '\''.
+                    std::string quoted = "'";
+                    for (std::size_t i = 0, count = argument.size (); i < count; ++i) {
+                        if (argument[i] == '\'') {
+                            quoted += "'\\''";
+                        }
+                        else {
+                            quoted += argument[i];
+                        }
+                    }
+                    return quoted + "'";
+                #endif // defined (TOOLCHAIN_OS_Windows)
+                }
+
+                // Streams an archive through a SHA2-256 hasher and in to
+                // 'tar -xz' running in the staging directory. If a cache
+                // path is given, the archive is also written there.
+                struct ExtractDataSink : public DataSink {
+                #if !defined (TOOLCHAIN_OS_Windows)
+                    // Must outlive (be declared before) tar.
+                    BlockSIGPIPE blockSIGPIPE;
+                #endif // !defined (TOOLCHAIN_OS_Windows)
+                    util::SHA2 hasher;
+                    std::FILE *tar;
+                    std::unique_ptr<FileDataSink> cacheFile;
+                    std::string error;
+
+                    ExtractDataSink (
+                            const std::string &stagingRoot,
+                            const std::string &cachePath) :
+                            tar (0) {
+                        hasher.Init (util::SHA2::DIGEST_SIZE_256);
+                        std::string command = "tar -xzf - -C " + QuoteShellArgument (stagingRoot);
+                    #if defined (TOOLCHAIN_OS_Windows)
+                        tar = _popen (command.c_str (), "wb");
+                    #else // defined (TOOLCHAIN_OS_Windows)
+                        tar = popen (command.c_str (), "w");
+                    #endif // defined (TOOLCHAIN_OS_Windows)
+                        if (tar == 0) {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                "Unable to execute: '%s'.",
+                                command.c_str ());
+                        }
+                        if (!cachePath.empty ()) {
+                            cacheFile.reset (new FileDataSink (cachePath));
+                        }
+                    }
+                    ~ExtractDataSink () {
+                        Close ();
+                    }
+
+                    virtual std::size_t HandleData (
+                            void *data,
+                            std::size_t elementSize,
+                            std::size_t elementCount) {
+                        std::size_t size = elementSize * elementCount;
+                        if (size != 0) {
+                            if (!error.empty ()) {
+                                return 0;
+                            }
+                            hasher.Update (data, size);
+                            if (cacheFile.get () != 0 &&
+                                    cacheFile->HandleData (data, 1, size) != size) {
+                                error = "Unable to write the source cache archive.";
+                                return 0;
+                            }
+                            if (std::fwrite (data, 1, size, tar) != size) {
+                                // Most likely tar exited early (bad archive,
+                                // disk full...). Let it tell us why.
+                                int errorCode = errno;
+                                error = std::string ("Unable to write to tar (") +
+                                    strerror (errorCode) + "), " + GetTarStatus (Close ()) + ".";
+                                return 0;
+                            }
+                        }
+                        return size;
+                    }
+
+                    virtual std::string GetError () const {
+                        return error;
+                    }
+
+                    /// \brief
+                    /// Wait for tar to finish and return the archive hash.
+                    std::string Finish () {
+                        cacheFile.reset ();
+                        if (!error.empty ()) {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION ("%s", error.c_str ());
+                        }
+                        int status = Close ();
+                        if (status != 0) {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                "tar failed to extract the archive (%s).",
+                                GetTarStatus (status).c_str ());
+                        }
+                        util::Hash::Digest digest;
+                        hasher.Final (digest);
+                        return util::Hash::DigestTostring (digest);
+                    }
+
+                private:
+                    int Close () {
+                        int status = 0;
+                        if (tar != 0) {
+                        #if defined (TOOLCHAIN_OS_Windows)
+                            status = _pclose (tar);
+                        #else // defined (TOOLCHAIN_OS_Windows)
+                            status = pclose (tar);
+                        #endif // defined (TOOLCHAIN_OS_Windows)
+                            tar = 0;
+                        }
+                        return status;
+                    }
+                };
+
+                // Some archives contain a single top level directory,
+                // others contain the project files. Return the directory
+                // that holds the project.
+                std::string GetStagedRoot (const std::string &stagingRoot) {
+                    std::string root;
+                    std::size_t entryCount = 0;
+                    util::Directory directory (stagingRoot);
+                    util::Directory::Entry entry;
+                    for (bool gotEntry = directory.GetFirstEntry (entry);
+                            gotEntry; gotEntry = directory.GetNextEntry (entry)) {
+                        if (!util::IsDotOrDotDot (entry.name.c_str ())) {
+                            if (entry.type == util::Directory::Entry::Folder) {
+                                root = MakePath (stagingRoot, entry.name);
+                            }
+                            ++entryCount;
+                        }
+                    }
+                    return entryCount == 1 && !root.empty () &&
+                        !util::Path (MakePath (stagingRoot, THEKOGANS_MAKE_XML)).Exists () ?
+                        root : stagingRoot;
+                }
+
+                std::string TrimHeaderValue (const std::string &value) {
+                    std::string::size_type first = value.find_first_not_of (" \t\r\n");
+                    if (first == std::string::npos) {
+                        return std::string ();
+                    }
+                    std::string::size_type last = value.find_last_not_of (" \t\r\n");
+                    return value.substr (first, last - first + 1);
+                }
+
+                struct SourceTransfer {
+                    using Ptr = std::unique_ptr<SourceTransfer>;
+
+                    Source &source;
+                    std::string url;
+                    CURL *curl;
+                    curl_slist *headers;
+                    std::vector<util::ui8> buffer;
+                    std::string etag;
+                    std::string last_modified;
+                    CURLcode code;
+                    long responseCode;
+
+                    enum {
+                        /// \brief
+                        /// Initial body buffer size. If the server tells us
+                        /// the content length, we reserve that instead.
+                        DEFAULT_BUFFER_SIZE = 64 * 1024
+                    };
+
+                    explicit SourceTransfer (Source &source_) :
+                            source (source_),
+                            url (MakePath (MakePath (source.url, source.organization), SOURCE_XML)),
+                            curl (curl_easy_init ()),
+                            headers (0),
+                            code (CURLE_OK),
+                            responseCode (0) {
+                        if (curl != 0) {
+                            curl_easy_setopt (curl, CURLOPT_URL, url.c_str ());
+                            curl_easy_setopt (curl, CURLOPT_FOLLOWLOCATION, 1L);
+                            curl_easy_setopt (curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+                            curl_easy_setopt (curl, CURLOPT_WRITEDATA, (void *)this);
+                            curl_easy_setopt (curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+                            curl_easy_setopt (curl, CURLOPT_HEADERDATA, (void *)this);
+                            curl_easy_setopt (curl, CURLOPT_PRIVATE, (void *)this);
+                            curl_easy_setopt (curl, CURLOPT_USERAGENT, "thekogans_make-agent/1.0");
+                            curl_easy_setopt (curl, CURLOPT_FAILONERROR, 1L);
+                            curl_easy_setopt (curl, CURLOPT_SSL_VERIFYPEER, 0);
+                            // Only ask for the body if it changed since the last update.
+                            if (!source.etag.empty ()) {
+                                headers = curl_slist_append (headers,
+                                    ("If-None-Match: " + source.etag).c_str ());
+                            }
+                            if (!source.last_modified.empty ()) {
+                                headers = curl_slist_append (headers,
+                                    ("If-Modified-Since: " + source.last_modified).c_str ());
+                            }
+                            if (headers != 0) {
+                                curl_easy_setopt (curl, CURLOPT_HTTPHEADER, headers);
+                            }
+                            buffer.reserve (DEFAULT_BUFFER_SIZE);
+                        }
+                        else {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION ("%s",
+                                "curl_easy_init failed.");
+                        }
+                    }
+                    ~SourceTransfer () {
+                        curl_slist_free_all (headers);
+                        curl_easy_cleanup (curl);
+                    }
+
+                    void Perform () {
+                        code = curl_easy_perform (curl);
+                        Done (code);
+                    }
+
+                    void Done (CURLcode code_) {
+                        code = code_;
+                        curl_easy_getinfo (curl, CURLINFO_RESPONSE_CODE, &responseCode);
+                    }
+
+                    bool IsNotModified () const {
+                        return code == CURLE_OK && responseCode == 304;
+                    }
+
+                private:
+                    static size_t WriteCallback (
+                            void *data,
+                            size_t elementSize,
+                            size_t elementCount,
+                            void *userData) {
+                        SourceTransfer *transfer = (SourceTransfer *)userData;
+                        std::size_t size = elementSize * elementCount;
+                        Counters::Increment (Counters::BYTES_DOWNLOADED, size);
+                        if (size != 0) {
+                            if (transfer->buffer.empty ()) {
+                                curl_off_t contentLength = -1;
+                                if (curl_easy_getinfo (transfer->curl,
+                                        CURLINFO_CONTENT_LENGTH_DOWNLOAD_T,
+                                        &contentLength) == CURLE_OK &&
+                                        contentLength > (curl_off_t)transfer->buffer.capacity ()) {
+                                    transfer->buffer.reserve ((std::size_t)contentLength);
+                                }
+                            }
+                            const util::ui8 *begin = (const util::ui8 *)data;
+                            transfer->buffer.insert (transfer->buffer.end (), begin, begin + size);
+                        }
+                        return size;
+                    }
+
+                    static size_t HeaderCallback (
+                            char *data,
+                            size_t elementSize,
+                            size_t elementCount,
+                            void *userData) {
+                        SourceTransfer *transfer = (SourceTransfer *)userData;
+                        std::size_t size = elementSize * elementCount;
+                        std::string header (data, size);
+                        if (header.compare (0, 5, "HTTP/") == 0) {
+                            // A new response (redirect). Forget validators
+                            // belonging to the previous one.
+                            transfer->etag.clear ();
+                            transfer->last_modified.clear ();
+                        }
+                        else {
+                            std::string::size_type colon = header.find (':');
+                            if (colon != std::string::npos) {
+                                std::string name = util::StringToUpper (
+                                    TrimHeaderValue (header.substr (0, colon)).c_str ());
+                                if (name == "ETAG") {
+                                    transfer->etag = TrimHeaderValue (header.substr (colon + 1));
+                                }
+                                else if (name == "LAST-MODIFIED") {
+                                    transfer->last_modified = TrimHeaderValue (header.substr (colon + 1));
+                                }
+                            }
+                        }
+                        return size;
+                    }
+
+                    THEKOGANS_UTIL_DISALLOW_COPY_AND_ASSIGN (SourceTransfer)
+                };
+
+                struct CURLMultiHandle {
+                    CURLM *multi;
+                    std::list<CURL *> handles;
+
+                    explicit CURLMultiHandle (util::ui32 maxConnections) :
+                            multi (curl_multi_init ()) {
+                        if (multi != 0) {
+                            if (maxConnections == 0) {
+                                maxConnections = 1;
+                            }
+                            curl_multi_setopt (multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)maxConnections);
+                            curl_multi_setopt (multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)maxConnections);
+                        }
+                        else {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION ("%s",
+                                "curl_multi_init failed.");
+                        }
+                    }
+                    ~CURLMultiHandle () {
+                        for (std::list<CURL *>::const_iterator
+                                it = handles.begin (),
+                                end = handles.end (); it != end; ++it) {
+                            curl_multi_remove_handle (multi, *it);
+                        }
+                        curl_multi_cleanup (multi);
+                    }
+
+                    void Perform (std::list<SourceTransfer::Ptr> &transfers) {
+                        for (std::list<SourceTransfer::Ptr>::const_iterator
+                                it = transfers.begin (),
+                                end = transfers.end (); it != end; ++it) {
+                            CURLMcode code = curl_multi_add_handle (multi, (*it)->curl);
+                            if (code != CURLM_OK) {
+                                THEKOGANS_UTIL_THROW_STRING_EXCEPTION ("%s",
+                                    curl_multi_strerror (code));
+                            }
+                            handles.push_back ((*it)->curl);
+                        }
+                        int running = 0;
+                        do {
+                            CURLMcode code = curl_multi_perform (multi, &running);
+                            if (code == CURLM_OK && running != 0) {
+                                code = curl_multi_poll (multi, 0, 0, 1000, 0);
+                            }
+                            if (code != CURLM_OK) {
+                                THEKOGANS_UTIL_THROW_STRING_EXCEPTION ("%s",
+                                    curl_multi_strerror (code));
+                            }
+                            CURLMsg *message;
+                            int messagesLeft;
+                            while ((message = curl_multi_info_read (multi, &messagesLeft)) != 0) {
+                                if (message->msg == CURLMSG_DONE) {
+                                    char *transfer = 0;
+                                    curl_easy_getinfo (message->easy_handle, CURLINFO_PRIVATE, &transfer);
+                                    if (transfer != 0) {
+                                        ((SourceTransfer *)transfer)->Done (message->data.result);
+                                    }
+                                }
+                            }
+                        } while (running != 0);
+                    }
+
+                    THEKOGANS_UTIL_DISALLOW_COPY_AND_ASSIGN (CURLMultiHandle)
+                };
             }
         #endif // defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
 
@@ -476,7 +987,18 @@ namespace thekogans {
                         components.push_back ("installtoolchainsourcetoolchain");
                         shellProcess.AddArgument (MakePath (components, false));
                         shellProcess.AddArgument ("-o:" + source->organization);
-                        shellProcess.AddArgument ("-u:" + source->url);
+                        shellProcess.AddArgument ("-u:" +
+                            GetArchiveURL (
+                                *source,
+                                toolchain->file.empty () ?
+                                    GetFileName (
+                                        source->organization,
+                                        toolchain->name,
+                                        std::string (),
+                                        toolchain->version,
+                                        TAR_GZ_EXT) :
+                                    toolchain->file + EXT_SEPARATOR + TAR_GZ_EXT,
+                                toolchain->SHA2_256));
                         shellProcess.AddArgument ("-p:" + toolchain->name);
                         shellProcess.AddArgument ("-v:" + toolchain->version);
                         if (!toolchain->file.empty ()) {
@@ -505,6 +1027,159 @@ namespace thekogans {
                 }
             }
 
+            std::string Sources::GetArchiveURL (
+                    const Source &source,
+                    const std::string &archiveName,
+                    const std::string &SHA2_256) const {
+                std::string tempPath;
+                THEKOGANS_UTIL_TRY {
+                    SourceCache &cache = *ToolchainSourceCache::Instance ();
+                    std::string archivePath = cache.Lookup (SHA2_256);
+                #if defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
+                    if (archivePath.empty ()) {
+                        tempPath = ToSystemPath (cache.GetTempPath (SHA2_256));
+                        util::Directory::Create (util::Path (tempPath).GetDirectory ());
+                        {
+                            std::string archiveUrl =
+                                MakePath (MakePath (source.url, source.organization), archiveName);
+                            std::cout << "Downloading " << archiveUrl << std::endl;
+                            std::cout.flush ();
+                            THEKOGANS_MAKE_CORE_TRACE_SPAN ("download", archiveUrl);
+                            FileDataSink fileDataSink (tempPath);
+                            CURLHandle curlHandle (archiveUrl, fileDataSink);
+                            curlHandle.GetURL ();
+                        }
+                        archivePath = cache.Commit (tempPath, SHA2_256);
+                    }
+                #endif // defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
+                    if (!archivePath.empty ()) {
+                        return cache.GetURL (SHA2_256, source.organization, archiveName);
+                    }
+                }
+                THEKOGANS_UTIL_CATCH (util::Exception) {
+                    if (!tempPath.empty () && util::Path (tempPath).Exists ()) {
+                        util::Path (tempPath).Delete ();
+                    }
+                    THEKOGANS_UTIL_LOG_WARNING (
+                        "Unable to use the source cache for %s (%s), "
+                        "falling back to %s.\n",
+                        archiveName.c_str (),
+                        exception.what (),
+                        source.url.c_str ());
+                }
+                return source.url;
+            }
+
+        #if defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
+            void Sources::FetchSourceProject (
+                    const Source &source,
+                    const Source::Project &project) const {
+                std::string projectRoot =
+                    ToSystemPath (
+                        Project::GetRoot (
+                            source.organization,
+                            project.name,
+                            project.branch,
+                            project.version,
+                            std::string ()));
+                if (util::Path (projectRoot).Exists ()) {
+                    return;
+                }
+                std::string archiveName =
+                    GetFileName (
+                        source.organization,
+                        project.name,
+                        project.branch,
+                        project.version,
+                        TAR_GZ_EXT);
+                std::random_device random;
+                std::string stagingRoot =
+                    projectRoot + EXT_SEPARATOR + "staging" + util::ui32Tostring (random ());
+                SourceCache &cache = *ToolchainSourceCache::Instance ();
+                // Keep a concurrent Trim from evicting the archive while
+                // it's being extracted.
+                SourceCache::DeferTrim deferTrim (cache);
+                std::string archivePath = cache.Lookup (project.SHA2_256);
+                std::string tempPath;
+                THEKOGANS_UTIL_TRY {
+                    util::Directory::Create (stagingRoot);
+                    if (archivePath.empty ()) {
+                        tempPath = ToSystemPath (cache.GetTempPath (project.SHA2_256));
+                        util::Directory::Create (util::Path (tempPath).GetDirectory ());
+                    }
+                    std::string hash;
+                    {
+                        // Download, hash and extract all happen as the bytes arrive.
+                        ExtractDataSink extractDataSink (stagingRoot, tempPath);
+                        if (!archivePath.empty ()) {
+                            std::cout << "Extracting " << archivePath << std::endl;
+                            std::cout.flush ();
+                            THEKOGANS_MAKE_CORE_TRACE_SPAN ("download", "Extract " + archivePath);
+                            util::ReadOnlyFile archiveFile (util::HostEndian, archivePath);
+                            const std::size_t BUFFER_SIZE = 1024 * 1024;
+                            std::vector<util::ui8> buffer (BUFFER_SIZE);
+                            for (std::size_t count = archiveFile.Read (&buffer[0], BUFFER_SIZE);
+                                    count != 0;
+                                    count = archiveFile.Read (&buffer[0], BUFFER_SIZE)) {
+                                if (extractDataSink.HandleData (&buffer[0], 1, count) != count) {
+                                    THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                        "Unable to extract %s (%s)",
+                                        archivePath.c_str (),
+                                        extractDataSink.GetError ().c_str ());
+                                }
+                            }
+                        }
+                        else {
+                            // NOTE: curl handles both http(s):// and file:// urls.
+                            std::string archiveUrl =
+                                MakePath (MakePath (source.url, source.organization), archiveName);
+                            std::cout << "Downloading " << archiveUrl << std::endl;
+                            std::cout.flush ();
+                            THEKOGANS_MAKE_CORE_TRACE_SPAN ("download", archiveUrl);
+                            CURLHandle curlHandle (archiveUrl, extractDataSink);
+                            curlHandle.GetURL ();
+                        }
+                        hash = extractDataSink.Finish ();
+                    }
+                    if (util::StringToUpper (hash.c_str ()) !=
+                            util::StringToUpper (project.SHA2_256.c_str ())) {
+                        THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                            "%s SHA2-256 mismatch (expected: %s, got: %s).",
+                            archiveName.c_str (),
+                            project.SHA2_256.c_str (),
+                            hash.c_str ());
+                    }
+                    if (!tempPath.empty ()) {
+                        // Already verified above.
+                        cache.Commit (tempPath, project.SHA2_256, false);
+                        tempPath.clear ();
+                    }
+                    // Commit the project.
+                    std::string stagedRoot = GetStagedRoot (stagingRoot);
+                    util::Directory::Create (util::Path (projectRoot).GetDirectory ());
+                    if (std::rename (stagedRoot.c_str (), projectRoot.c_str ()) != 0) {
+                        THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                            "Unable to move %s to %s.",
+                            stagedRoot.c_str (),
+                            projectRoot.c_str ());
+                    }
+                    if (stagedRoot != stagingRoot) {
+                        util::Path (stagingRoot).Delete ();
+                    }
+                }
+                THEKOGANS_UTIL_CATCH (util::Exception) {
+                    if (util::Path (stagingRoot).Exists ()) {
+                        // Might hold a partial extraction.
+                        util::Directory::Delete (stagingRoot);
+                    }
+                    if (!tempPath.empty () && util::Path (tempPath).Exists ()) {
+                        util::Path (tempPath).Delete ();
+                    }
+                    throw;
+                }
+            }
+        #endif // defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
+
             Source *Sources::GetSource (const std::string &organization) const {
                 for (std::list<Source::Ptr>::const_iterator
                         it = sources.begin (),
@@ -518,33 +1193,71 @@ namespace thekogans {
 
         #if defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
             void Sources::UpdateSource (Source &source) {
-                struct BufferDataSink : public DataSink {
-                    std::vector<util::ui8> buffer;
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("download", "Update " + source.organization);
+                SourceTransfer transfer (source);
+                transfer.Perform ();
+                if (transfer.code != CURLE_OK) {
+                    THEKOGANS_UTIL_THROW_STRING_EXCEPTION ("%s",
+                        curl_easy_strerror (transfer.code));
+                }
+                if (!transfer.IsNotModified ()) {
+                    ParseSource (source, transfer.url, transfer.buffer);
+                    source.etag = transfer.etag;
+                    source.last_modified = transfer.last_modified;
+                }
+            }
 
-                    virtual std::size_t HandleData (
-                            void *data,
-                            std::size_t elementSize,
-                            std::size_t elementCount) {
-                        std::size_t size = elementSize * elementCount;
-                        if (size != 0) {
-                            std::size_t oldSize = buffer.size ();
-                            buffer.resize (oldSize + size);
-                            memcpy (&buffer[oldSize], data, size);
+            void Sources::UpdateSources (
+                    const std::list<Source *> &sources_,
+                    util::ui32 maxConnections) {
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("download",
+                    "Update " + util::ui64Tostring (sources_.size ()) + " sources");
+                std::list<SourceTransfer::Ptr> transfers;
+                for (std::list<Source *>::const_iterator
+                        it = sources_.begin (),
+                        end = sources_.end (); it != end; ++it) {
+                    transfers.push_back (SourceTransfer::Ptr (new SourceTransfer (**it)));
+                }
+                {
+                    CURLMultiHandle multiHandle (maxConnections);
+                    multiHandle.Perform (transfers);
+                }
+                for (std::list<SourceTransfer::Ptr>::const_iterator
+                        it = transfers.begin (),
+                        end = transfers.end (); it != end; ++it) {
+                    SourceTransfer &transfer = **it;
+                    THEKOGANS_UTIL_TRY {
+                        if (transfer.code != CURLE_OK) {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION ("%s",
+                                curl_easy_strerror (transfer.code));
+                        }
+                        if (transfer.IsNotModified ()) {
+                            std::cout << transfer.source << " is up to date.\n";
+                        }
+                        else {
+                            ParseSource (transfer.source, transfer.url, transfer.buffer);
+                            transfer.source.etag = transfer.etag;
+                            transfer.source.last_modified = transfer.last_modified;
+                            std::cout << "Updated " << transfer.source << std::endl;
                         }
-                        return size;
                     }
-                } bufferDataSink;
-                std::string sourceUrl =
-                    MakePath (MakePath (source.url, source.organization), SOURCE_XML);
-                CURLHandle curlHandle (sourceUrl, bufferDataSink);
-                curlHandle.GetURL ();
+                    THEKOGANS_UTIL_CATCH (util::Exception) {
+                        std::cout << "Unable to update " << transfer.source <<
+                            "(" << exception.what () << "), skipping.\n";
+                    }
+                }
+                std::cout.flush ();
+            }
+
+            void Sources::ParseSource (
+                    Source &source,
+                    const std::string &sourceUrl,
+                    const std::vector<util::ui8> &buffer) {
                 source.Clear ();
-                if (!bufferDataSink.buffer.empty ()) {
+                if (!buffer.empty ()) {
                     pugi::xml_document document;
                     pugi::xml_parse_result result =
-                        document.load_buffer (
-                            &bufferDataSink.buffer[0],
-                            bufferDataSink.buffer.size ());
+                        document.load_buffer (&buffer[0], buffer.size ());
                     if (!result) {
                         THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
                             "Unable to parse: %s (%s)",
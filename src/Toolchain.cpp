@@ -21,6 +21,7 @@
 #if defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
     #include "thekogans/make/core/Sources.h"
 #endif // defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
+#include "thekogans/make/core/Counters.h"
 #include "thekogans/make/core/thekogans_make.h"
 #include "thekogans/make/core/Utils.h"
 #include "thekogans/make/core/Toolchain.h"
@@ -71,6 +72,7 @@ namespace thekogans {
                     const std::string &organization,
                     const std::string &project,
                     const std::string &version) {
+                Counters::Increment (Counters::FILE_SYSTEM_STATS);
                 return util::Path (ToSystemPath (GetConfig (organization, project, version))).Exists ();
             }
 
@@ -82,6 +84,7 @@ namespace thekogans {
                 if (util::Path (path).Exists ()) {
                     util::Directory directory (path);
                     util::Directory::Entry entry;
+                    Counters::Increment (Counters::FILE_SYSTEM_READDIRS);
                     for (bool gotEntry = directory.GetFirstEntry (entry);
                             gotEntry; gotEntry = directory.GetNextEntry (entry)) {
                         if (entry.type == util::Directory::Entry::File) {
@@ -117,6 +120,7 @@ namespace thekogans {
                 if (util::Path (path).Exists ()) {
                     util::Directory directory (path);
                     util::Directory::Entry entry;
+                    Counters::Increment (Counters::FILE_SYSTEM_READDIRS);
                     for (bool gotEntry = directory.GetFirstEntry (entry);
                             gotEntry; gotEntry = directory.GetNextEntry (entry)) {
                         if (entry.type == util::Directory::Entry::File) {
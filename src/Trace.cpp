@@ -0,0 +1,232 @@
+// Copyright 2011 Boris Kogan (boris@thekogans.net)
+//
+// This file is part of thekogans_make_core.
+//
+// thekogans_make_core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// thekogans_make_core is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
+
+#include "thekogans/util/Environment.h"
+#if defined (TOOLCHAIN_OS_Windows)
+    #include <process.h>
+#else // defined (TOOLCHAIN_OS_Windows)
+    #include <unistd.h>
+#endif // defined (TOOLCHAIN_OS_Windows)
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <fstream>
+#include "thekogans/util/LockGuard.h"
+#include "thekogans/util/StringUtils.h"
+#include "thekogans/util/Exception.h"
+#include "thekogans/util/LoggerMgr.h"
+#include "thekogans/make/core/Trace.h"
+
+namespace thekogans {
+    namespace make {
+        namespace core {
+
+            namespace {
+                util::ui64 GetSteadyTime () {
+                    return (util::ui64)std::chrono::duration_cast<std::chrono::microseconds> (
+                        std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+                }
+
+                util::ui64 GetThreadId () {
+                    return (util::ui64)std::hash<std::thread::id> () (std::this_thread::get_id ());
+                }
+
+                util::ui64 GetProcessId () {
+                #if defined (TOOLCHAIN_OS_Windows)
+                    return (util::ui64)_getpid ();
+                #else // defined (TOOLCHAIN_OS_Windows)
+                    return (util::ui64)getpid ();
+                #endif // defined (TOOLCHAIN_OS_Windows)
+                }
+
+                void FlushTrace () {
+                    ToolchainTrace::Instance ()->Flush ();
+                }
+
+                std::string EscapeJSON (const std::string &value) {
+                    std::string escaped;
+                    for (std::size_t i = 0, count = value.size (); i < count; ++i) {
+                        unsigned char ch = (unsigned char)value[i];
+                        switch (ch) {
+                            case '"':
+                                escaped += "\\\"";
+                                break;
+                            case '\\':
+                                escaped += "\\\\";
+                                break;
+                            case '\n':
+                                escaped += "\\n";
+                                break;
+                            case '\r':
+                                escaped += "\\r";
+                                break;
+                            case '\t':
+                                escaped += "\\t";
+                                break;
+                            default:
+                                if (ch < 0x20) {
+                                    escaped += util::FormatString ("\\u%04x", ch);
+                                }
+                                else {
+                                    escaped += (char)ch;
+                                }
+                                break;
+                        }
+                    }
+                    return escaped;
+                }
+            }
+
+            Trace::Span::Span (
+                    const char *category_,
+                    const std::string &name_) :
+                    enabled (ToolchainTrace::Instance ()->IsEnabled ()),
+                    category (category_),
+                    name (name_),
+                    start (enabled ? ToolchainTrace::Instance ()->Now () : 0) {}
+
+            Trace::Span::~Span () {
+                if (enabled) {
+                    Trace &trace = *ToolchainTrace::Instance ();
+                    Event event;
+                    event.category = category;
+                    event.name = name;
+                    event.start = start;
+                    event.duration = trace.Now () - start;
+                    event.threadId = GetThreadId ();
+                    trace.Emit (event);
+                }
+            }
+
+            Trace::Trace () :
+                    enabled (false),
+                    epoch (GetSteadyTime ()) {
+                std::string path = util::GetEnvironmentVariable ("THEKOGANS_MAKE_TRACE");
+                if (!path.empty ()) {
+                    AddSink (new ChromeTraceSink (path));
+                    std::atexit (FlushTrace);
+                }
+            }
+
+            Trace::~Trace () {
+                Flush ();
+                for (std::size_t i = 0, count = sinks.size (); i < count; ++i) {
+                    delete sinks[i];
+                }
+            }
+
+            void Trace::AddSink (Sink *sink) {
+                if (sink != 0) {
+                    util::LockGuard<util::SpinLock> guard (spinLock);
+                    sinks.push_back (sink);
+                    enabled = true;
+                }
+                else {
+                    THEKOGANS_UTIL_THROW_ERROR_CODE_EXCEPTION (
+                        THEKOGANS_UTIL_OS_ERROR_CODE_EINVAL);
+                }
+            }
+
+            util::ui64 Trace::Now () const {
+                return GetSteadyTime () - epoch;
+            }
+
+            void Trace::Emit (const Event &event) {
+                util::LockGuard<util::SpinLock> guard (spinLock);
+                for (std::size_t i = 0, count = sinks.size (); i < count; ++i) {
+                    sinks[i]->OnEvent (event);
+                }
+            }
+
+            void Trace::Emit (
+                    const char *category,
+                    const std::string &name) {
+                if (IsEnabled ()) {
+                    Event event;
+                    event.category = category;
+                    event.name = name;
+                    event.start = Now ();
+                    event.threadId = GetThreadId ();
+                    event.instant = true;
+                    Emit (event);
+                }
+            }
+
+            void Trace::Flush () {
+                util::LockGuard<util::SpinLock> guard (spinLock);
+                for (std::size_t i = 0, count = sinks.size (); i < count; ++i) {
+                    // Flush runs from atexit and ~Trace, where an exception
+                    // would end in std::terminate. A sink that can't write
+                    // shouldn't take the build (or the other sinks) down.
+                    try {
+                        sinks[i]->Flush ();
+                    }
+                    catch (const std::exception &exception) {
+                        THEKOGANS_UTIL_LOG_WARNING (
+                            "Unable to flush trace sink (%s).\n",
+                            exception.what ());
+                    }
+                    catch (...) {
+                        THEKOGANS_UTIL_LOG_WARNING ("%s\n",
+                            "Unable to flush trace sink.");
+                    }
+                }
+            }
+
+            void ChromeTraceSink::OnEvent (const Trace::Event &event) {
+                util::LockGuard<util::SpinLock> guard (spinLock);
+                events.push_back (event);
+            }
+
+            void ChromeTraceSink::Flush () {
+                util::LockGuard<util::SpinLock> guard (spinLock);
+                std::ofstream traceFile (path.c_str (), std::ios::out | std::ios::trunc);
+                if (!traceFile.is_open ()) {
+                    THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                        "Unable to open: %s.",
+                        path.c_str ());
+                }
+                // Complete ('X') and instant ('i') events, in the
+                // JSON object format understood by chrome://tracing
+                // and Perfetto.
+                util::ui64 processId = GetProcessId ();
+                traceFile << "{\"traceEvents\":[";
+                for (std::size_t i = 0, count = events.size (); i < count; ++i) {
+                    const Trace::Event &event = events[i];
+                    traceFile << (i > 0 ? ",\n" : "\n") <<
+                        "{\"name\":\"" << EscapeJSON (event.name) <<
+                        "\",\"cat\":\"" << EscapeJSON (event.category) <<
+                        "\",\"ph\":\"" << (event.instant ? "i" : "X") <<
+                        "\",\"ts\":" << event.start;
+                    if (event.instant) {
+                        traceFile << ",\"s\":\"t\"";
+                    }
+                    else {
+                        traceFile << ",\"dur\":" << event.duration;
+                    }
+                    traceFile << ",\"pid\":" << processId <<
+                        ",\"tid\":" << event.threadId << "}";
+                }
+                traceFile << "\n],\"displayTimeUnit\":\"ms\"}\n";
+            }
+
+        } // namespace core
+    } // namespace make
+} // namespace thekogans
@@ -16,33 +16,59 @@
 // along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
 
 #include "thekogans/util/Environment.h"
-#if !defined (TOOLCHAIN_OS_Windows)
+#if defined (TOOLCHAIN_OS_Windows)
+    #include <sys/types.h>
+    #include <sys/stat.h>
+    #include <sys/utime.h>
+#else // defined (TOOLCHAIN_OS_Windows)
+    #include <sys/types.h>
+    #include <sys/stat.h>
     #include <fcntl.h>
-#endif // !defined (TOOLCHAIN_OS_Windows)
+    #include <unistd.h>
+    #include <climits>
+    #if defined (TOOLCHAIN_OS_Linux)
+        #include <sys/ioctl.h>
+        #include <sys/sendfile.h>
+        #include <linux/fs.h>
+    #endif // defined (TOOLCHAIN_OS_Linux)
+#endif // defined (TOOLCHAIN_OS_Windows)
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
 #include <cstdio>
+#include <vector>
+#include <limits>
+#include <map>
+#include <set>
+#include <memory>
 #include <unordered_set>
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include <iostream>
 #include <fstream>
-#include "thekogans/util/FixedArray.h"
 #include "thekogans/util/Path.h"
 #include "thekogans/util/File.h"
 #include "thekogans/util/Directory.h"
 #include "thekogans/util/StringUtils.h"
 #include "thekogans/util/Version.h"
 #include "thekogans/util/Plugins.h"
-#include "thekogans/util/SHA2.h"
 #include "thekogans/util/ChildProcess.h"
 #if defined (TOOLCHAIN_OS_Windows)
     #include "thekogans/util/os/windows/WindowsUtils.h"
 #endif // defined (TOOLCHAIN_OS_Windows)
 #include "thekogans/make/core/thekogans_make.h"
+#include "thekogans/make/core/Counters.h"
 #include "thekogans/make/core/Function.h"
+#include "thekogans/make/core/FileHashCache.h"
 #if defined (TOOLCHAIN_OS_Windows)
     #include "thekogans/make/core/CygwinMountTable.h"
 #endif // defined (TOOLCHAIN_OS_Windows)
 #include "thekogans/make/core/Manifest.h"
+#include "thekogans/make/core/Trace.h"
 #include "thekogans/make/core/Generator.h"
 #include "thekogans/make/core/Project.h"
 #include "thekogans/make/core/Toolchain.h"
@@ -481,49 +507,392 @@ namespace thekogans {
                 return path;
             }
 
+            _LIB_THEKOGANS_MAKE_CORE_DECL std::string _LIB_THEKOGANS_MAKE_CORE_API GetCanonicalPath (
+                    const std::string &path) {
+            #if defined (TOOLCHAIN_OS_Windows)
+                char canonicalPath[_MAX_PATH];
+                if (_fullpath (canonicalPath, path.c_str (), _MAX_PATH) != 0) {
+                    return canonicalPath;
+                }
+            #else // defined (TOOLCHAIN_OS_Windows)
+                char *canonicalPath = realpath (path.c_str (), 0);
+                if (canonicalPath != 0) {
+                    std::string result = canonicalPath;
+                    free (canonicalPath);
+                    return result;
+                }
+                std::string directory = util::Path (path).GetDirectory ();
+                if (!directory.empty () && directory != path) {
+                    return MakePath (
+                        GetCanonicalPath (directory),
+                        util::Path (path).GetFullFileName ());
+                }
+            #endif // defined (TOOLCHAIN_OS_Windows)
+                return path;
+            }
+
+            _LIB_THEKOGANS_MAKE_CORE_DECL util::ui64 _LIB_THEKOGANS_MAKE_CORE_API ParseSize (
+                    const std::string &size) {
+                std::string value = util::TrimSpaces (size.c_str ());
+                if (!value.empty () && isdigit ((unsigned char)value[0])) {
+                    char *end = 0;
+                    errno = 0;
+                    util::ui64 bytes = strtoull (value.c_str (), &end, 10);
+                    if (errno == 0) {
+                        std::string suffix = util::TrimSpaces (end);
+                        if (suffix.empty ()) {
+                            return bytes;
+                        }
+                        if (suffix.size () == 1) {
+                            const char * const SUFFIXES = "KMG";
+                            const char *multiplier =
+                                strchr (SUFFIXES, toupper ((unsigned char)suffix[0]));
+                            if (multiplier != 0) {
+                                util::ui32 shift = 10 * (util::ui32)(multiplier - SUFFIXES + 1);
+                                if (bytes <= (std::numeric_limits<util::ui64>::max () >> shift)) {
+                                    return bytes << shift;
+                                }
+                            }
+                        }
+                    }
+                }
+                THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                    "Invalid size: '%s' (expected bytes with an optional K, M or G suffix).",
+                    size.c_str ());
+            }
+
             _LIB_THEKOGANS_MAKE_CORE_DECL std::string _LIB_THEKOGANS_MAKE_CORE_API GetFileHash (
                     const std::string &path) {
-                util::Hash::Digest digest;
-                util::SHA2 hasher;
-                hasher.FromFile (ToSystemPath (path), util::SHA2::DIGEST_SIZE_256, digest);
-                return util::Hash::DigestTostring (digest);
+                return ToolchainFileHashCache::Instance ()->GetHash (ToSystemPath (path));
             }
 
-            _LIB_THEKOGANS_MAKE_CORE_DECL bool _LIB_THEKOGANS_MAKE_CORE_API CopyFile (
-                    const std::string &from,
-                    const std::string &to) {
-                std::string fromPath = ToSystemPath (from);
-                std::string toPath = ToSystemPath (to);
-                if (!util::Path (toPath).Exists () ||
-                        util::Directory::Entry (toPath).lastModifiedDate <
-                        util::Directory::Entry (fromPath).lastModifiedDate) {
-                    std::cout << "Copying " << from << " -> " << to << std::endl;
-                    std::cout.flush ();
-                    util::Directory::Create (util::Path (toPath).GetDirectory ());
-                    util::ReadOnlyFile fromFile (util::HostEndian, fromPath);
+            _LIB_THEKOGANS_MAKE_CORE_DECL void _LIB_THEKOGANS_MAKE_CORE_API GetFileHashes (
+                    const std::vector<std::string> &paths,
+                    std::vector<std::string> &hashes) {
+                std::vector<std::string> systemPaths;
+                systemPaths.reserve (paths.size ());
+                for (std::size_t i = 0, count = paths.size (); i < count; ++i) {
+                    systemPaths.push_back (ToSystemPath (paths[i]));
+                }
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("hash", "Hash " + util::ui64Tostring (paths.size ()) + " files");
+                ToolchainFileHashCache::Instance ()->GetHashes (systemPaths, hashes);
+            }
+
+            _LIB_THEKOGANS_MAKE_CORE_DECL CopyMode _LIB_THEKOGANS_MAKE_CORE_API GetDependenciesCopyMode () {
+                std::string mode = util::StringToLower (
+                    util::TrimSpaces (
+                        util::GetEnvironmentVariable ("THEKOGANS_MAKE_LINK_DEPENDENCIES").c_str ()).c_str ());
+                return mode == "hardlink" ? COPY_MODE_HARDLINK :
+                    mode == "symlink" ? COPY_MODE_SYMLINK : COPY_MODE_COPY;
+            }
+
+            namespace {
+                const std::size_t COPY_BUFFER_SIZE = 1024 * 1024;
+
+            #if !defined (TOOLCHAIN_OS_Windows)
+                struct FileDescriptor {
+                    int fd;
+
+                    explicit FileDescriptor (int fd_) :
+                        fd (fd_) {}
+                    ~FileDescriptor () {
+                        if (fd != -1) {
+                            close (fd);
+                        }
+                    }
+                };
+
+                void CopyFileContents (
+                        const std::string &fromPath,
+                        int from,
+                        const std::string &toPath,
+                        int to,
+                        util::ui64 size) {
+                    util::ui64 copied = 0;
+                #if defined (TOOLCHAIN_OS_Linux)
+                    // Ask the file system to share the extents (btrfs, xfs...).
+                    if (ioctl (to, FICLONE, from) == 0) {
+                        return;
+                    }
+                    // In kernel copy. Both file offsets are advanced,
+                    // so whatever follows picks up where this left off.
+                    while (copied < size) {
+                        ssize_t count = copy_file_range (from, 0, to, 0, size - copied, 0);
+                        if (count > 0) {
+                            copied += count;
+                        }
+                        else if (count < 0 && errno == EINTR) {
+                            continue;
+                        }
+                        else {
+                            break;
+                        }
+                    }
+                    while (copied < size) {
+                        ssize_t count = sendfile (to, from, 0, size - copied);
+                        if (count > 0) {
+                            copied += count;
+                        }
+                        else if (count < 0 && errno == EINTR) {
+                            continue;
+                        }
+                        else {
+                            break;
+                        }
+                    }
+                #endif // defined (TOOLCHAIN_OS_Linux)
+                    if (copied < size) {
+                        std::vector<util::ui8> buffer (COPY_BUFFER_SIZE);
+                        for (;;) {
+                            ssize_t count = read (from, buffer.data (), COPY_BUFFER_SIZE);
+                            if (count == 0) {
+                                break;
+                            }
+                            if (count < 0) {
+                                if (errno == EINTR) {
+                                    continue;
+                                }
+                                THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                    "Unable to read '%s' (%s).",
+                                    fromPath.c_str (),
+                                    strerror (errno));
+                            }
+                            for (ssize_t written = 0; written < count;) {
+                                ssize_t result = write (to, buffer.data () + written, count - written);
+                                if (result < 0) {
+                                    if (errno == EINTR) {
+                                        continue;
+                                    }
+                                    THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                        "Unable to write '%s' (%s).",
+                                        toPath.c_str (),
+                                        strerror (errno));
+                                }
+                                written += result;
+                            }
+                        }
+                    }
+                }
+            #endif // !defined (TOOLCHAIN_OS_Windows)
+
+                bool LinkFile (
+                        const std::string &fromPath,
+                        const std::string &toPath,
+                        CopyMode mode) {
                 #if defined (TOOLCHAIN_OS_Windows)
-                    util::File toFile (
-                        util::HostEndian,
-                        toPath,
-                        GENERIC_READ | GENERIC_WRITE,
-                        FILE_SHARE_READ | FILE_SHARE_WRITE,
-                        CREATE_ALWAYS);
+                    // Symbolic links need elevated privileges on Windows.
+                    return mode == COPY_MODE_HARDLINK &&
+                        CreateHardLinkA (toPath.c_str (), fromPath.c_str (), 0) != FALSE;
                 #else // defined (TOOLCHAIN_OS_Windows)
-                    util::File toFile (
-                        util::HostEndian,
-                        toPath,
-                        O_RDWR | O_CREAT | O_TRUNC,
-                        util::Directory::Entry (fromPath).mode);
+                    if (mode == COPY_MODE_HARDLINK) {
+                        return link (fromPath.c_str (), toPath.c_str ()) == 0;
+                    }
+                    if (mode == COPY_MODE_SYMLINK) {
+                        // Make the link immune to changes in the current directory.
+                        std::string target = fromPath;
+                        if (!target.empty () && target[0] != '/') {
+                            char cwd[PATH_MAX];
+                            if (getcwd (cwd, PATH_MAX) != 0) {
+                                target = MakePath (cwd, target);
+                            }
+                        }
+                        return symlink (target.c_str (), toPath.c_str ()) == 0;
+                    }
+                    return false;
                 #endif // defined (TOOLCHAIN_OS_Windows)
-                    util::FixedArray<util::ui8, 4096> buffer;
-                    for (std::size_t count = fromFile.Read (buffer.array, 4096);
-                            count != 0;
-                            count = fromFile.Read (buffer.array, 4096)) {
-                        toFile.Write (buffer.array, count);
+                }
+            }
+
+            _LIB_THEKOGANS_MAKE_CORE_DECL std::string _LIB_THEKOGANS_MAKE_CORE_API GetTestsType (
+                    const std::string &type) {
+                return util::StringToLower (
+                    util::TrimSpaces (
+                        util::GetEnvironmentVariable ("THEKOGANS_MAKE_TESTS_LINKAGE").c_str ()).c_str ()) ==
+                    "configured" ? type : TYPE_STATIC;
+            }
+
+            namespace {
+                bool CopyFileHelper (
+                        const std::string &from,
+                        const std::string &to,
+                        CopyMode mode,
+                        bool preserveTimes,
+                        bool compareContents,
+                        bool verbose,
+                        bool createDirectory) {
+                    std::string fromPath = ToSystemPath (from);
+                    std::string toPath = ToSystemPath (to);
+                    bool outOfDate = !util::Path (toPath).Exists ();
+                    Counters::Increment (Counters::FILE_SYSTEM_STATS);
+                    if (!outOfDate) {
+                        if (compareContents) {
+                            outOfDate = GetFileHash (toPath) != GetFileHash (fromPath);
+                        }
+                        else {
+                            Counters::Increment (Counters::FILE_SYSTEM_STATS, 2);
+                            outOfDate =
+                                util::Directory::Entry (toPath).lastModifiedDate <
+                                    util::Directory::Entry (fromPath).lastModifiedDate;
+                        }
                     }
-                    return true;
+                    if (outOfDate) {
+                        if (verbose) {
+                            std::cout << (mode == COPY_MODE_COPY ? "Copying " : "Linking ") <<
+                                from << " -> " << to << std::endl;
+                            std::cout.flush ();
+                        }
+                        if (createDirectory) {
+                            util::Directory::Create (util::Path (toPath).GetDirectory ());
+                        }
+                        // Never write through an existing file. It might be a
+                        // link to the source (see COPY_MODE_HARDLINK) or a
+                        // running executable.
+                        if (util::Path (toPath).Exists ()) {
+                            util::Path (toPath).Delete ();
+                        }
+                        if (mode != COPY_MODE_COPY && LinkFile (fromPath, toPath, mode)) {
+                            return true;
+                        }
+                    #if defined (TOOLCHAIN_OS_Windows)
+                        {
+                            util::ReadOnlyFile fromFile (util::HostEndian, fromPath);
+                            util::File toFile (
+                                util::HostEndian,
+                                toPath,
+                                GENERIC_READ | GENERIC_WRITE,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                CREATE_ALWAYS);
+                            std::vector<util::ui8> buffer (COPY_BUFFER_SIZE);
+                            for (std::size_t count = fromFile.Read (buffer.data (), COPY_BUFFER_SIZE);
+                                    count != 0;
+                                    count = fromFile.Read (buffer.data (), COPY_BUFFER_SIZE)) {
+                                toFile.Write (buffer.data (), count);
+                                Counters::Increment (Counters::BYTES_COPIED, count);
+                            }
+                        }
+                        Counters::Increment (Counters::FILES_COPIED);
+                        if (preserveTimes) {
+                            struct __stat64 fromStat;
+                            if (_stat64 (fromPath.c_str (), &fromStat) == 0) {
+                                struct __utimbuf64 times;
+                                times.actime = fromStat.st_atime;
+                                times.modtime = fromStat.st_mtime;
+                                _utime64 (toPath.c_str (), &times);
+                            }
+                        }
+                    #else // defined (TOOLCHAIN_OS_Windows)
+                        FileDescriptor fromFile (open (fromPath.c_str (), O_RDONLY));
+                        struct stat fromStat;
+                        if (fromFile.fd == -1 || fstat (fromFile.fd, &fromStat) != 0) {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                "Unable to open '%s' (%s).",
+                                fromPath.c_str (),
+                                strerror (errno));
+                        }
+                        FileDescriptor toFile (
+                            open (toPath.c_str (), O_WRONLY | O_CREAT | O_TRUNC, fromStat.st_mode & 07777));
+                        if (toFile.fd == -1) {
+                            THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
+                                "Unable to create '%s' (%s).",
+                                toPath.c_str (),
+                                strerror (errno));
+                        }
+                        CopyFileContents (fromPath, fromFile.fd, toPath, toFile.fd, fromStat.st_size);
+                        Counters::Increment (Counters::FILES_COPIED);
+                        Counters::Increment (Counters::BYTES_COPIED, (util::ui64)fromStat.st_size);
+                        if (preserveTimes) {
+                            struct timespec times[2];
+                        #if defined (TOOLCHAIN_OS_OSX)
+                            times[0] = fromStat.st_atimespec;
+                            times[1] = fromStat.st_mtimespec;
+                        #else // defined (TOOLCHAIN_OS_OSX)
+                            times[0] = fromStat.st_atim;
+                            times[1] = fromStat.st_mtim;
+                        #endif // defined (TOOLCHAIN_OS_OSX)
+                            futimens (toFile.fd, times);
+                        }
+                    #endif // defined (TOOLCHAIN_OS_Windows)
+                        return true;
+                    }
+                    return false;
                 }
-                return false;
+            }
+
+            _LIB_THEKOGANS_MAKE_CORE_DECL bool _LIB_THEKOGANS_MAKE_CORE_API CopyFile (
+                    const std::string &from,
+                    const std::string &to,
+                    CopyMode mode,
+                    bool preserveTimes) {
+                return CopyFileHelper (from, to, mode, preserveTimes, false, true, true);
+            }
+
+            _LIB_THEKOGANS_MAKE_CORE_DECL std::size_t _LIB_THEKOGANS_MAKE_CORE_API CopyFiles (
+                    const std::vector<CopyPaths> &paths,
+                    CopyMode mode,
+                    bool preserveTimes,
+                    bool compareContents) {
+                if (paths.empty ()) {
+                    return 0;
+                }
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("copy", "Copy " + util::ui64Tostring (paths.size ()) + " files");
+                std::cout << "Copying " << paths.size () << " files" << std::endl;
+                std::cout.flush ();
+                // Create each destination directory once, up front.
+                {
+                    std::set<std::string> directories;
+                    for (std::size_t i = 0, count = paths.size (); i < count; ++i) {
+                        directories.insert (util::Path (ToSystemPath (paths[i].second)).GetDirectory ());
+                    }
+                    for (std::set<std::string>::const_iterator
+                            it = directories.begin (),
+                            end = directories.end (); it != end; ++it) {
+                        util::Directory::Create (*it);
+                    }
+                }
+                // Copying is bound by per file syscall latency, not cpu. Keep
+                // a few more requests in flight than there are cores.
+                std::size_t threadCount = std::min<std::size_t> (
+                    paths.size (),
+                    std::max (4u, 2 * std::thread::hardware_concurrency ()));
+                std::atomic<std::size_t> next (0);
+                std::atomic<std::size_t> copied (0);
+                std::vector<std::exception_ptr> exceptions (paths.size ());
+                std::vector<std::thread> threads;
+                for (std::size_t i = 0; i < threadCount; ++i) {
+                    threads.push_back (
+                        std::thread (
+                            [&] () {
+                                for (std::size_t j = next++; j < paths.size (); j = next++) {
+                                    try {
+                                        if (CopyFileHelper (
+                                                paths[j].first,
+                                                paths[j].second,
+                                                mode,
+                                                preserveTimes,
+                                                compareContents,
+                                                false,
+                                                false)) {
+                                            ++copied;
+                                        }
+                                    }
+                                    catch (...) {
+                                        exceptions[j] = std::current_exception ();
+                                    }
+                                }
+                            }));
+                }
+                for (std::size_t i = 0; i < threadCount; ++i) {
+                    threads[i].join ();
+                }
+                for (std::size_t i = 0, count = exceptions.size (); i < count; ++i) {
+                    if (exceptions[i]) {
+                        std::rethrow_exception (exceptions[i]);
+                    }
+                }
+                std::cout << "Copied " << copied << " files (" <<
+                    paths.size () - copied << " up to date)" << std::endl;
+                std::cout.flush ();
+                return copied;
             }
 
             _LIB_THEKOGANS_MAKE_CORE_DECL bool _LIB_THEKOGANS_MAKE_CORE_API DeleteFile (const std::string &file) {
@@ -543,6 +912,7 @@ namespace thekogans {
                         const std::string &folderName) {
                     util::Directory directory (ToSystemPath (path));
                     util::Directory::Entry entry;
+                    Counters::Increment (Counters::FILE_SYSTEM_READDIRS);
                     for (bool gotEntry = directory.GetFirstEntry (entry);
                             gotEntry; gotEntry = directory.GetNextEntry (entry)) {
                         if (entry.type == util::Directory::Entry::Folder &&
@@ -560,6 +930,48 @@ namespace thekogans {
                     }
                 }
 
+                void GetFiles (
+                        const std::string &path,
+                        std::set<std::string> &files) {
+                    util::Directory directory (path);
+                    util::Directory::Entry entry;
+                    Counters::Increment (Counters::FILE_SYSTEM_READDIRS);
+                    for (bool gotEntry = directory.GetFirstEntry (entry);
+                            gotEntry; gotEntry = directory.GetNextEntry (entry)) {
+                        if (!util::IsDotOrDotDot (entry.name.c_str ())) {
+                            if (entry.type == util::Directory::Entry::Folder) {
+                                GetFiles (MakePath (path, entry.name), files);
+                            }
+                            else {
+                                files.insert (MakePath (path, entry.name));
+                            }
+                        }
+                    }
+                }
+
+                // Collect the files in every folder called folderName
+                // (the same folders DeleteFolders would delete).
+                void GetFolderFiles (
+                        const std::string &path,
+                        const std::string &folderName,
+                        std::set<std::string> &files) {
+                    util::Directory directory (path);
+                    util::Directory::Entry entry;
+                    Counters::Increment (Counters::FILE_SYSTEM_READDIRS);
+                    for (bool gotEntry = directory.GetFirstEntry (entry);
+                            gotEntry; gotEntry = directory.GetNextEntry (entry)) {
+                        if (entry.type == util::Directory::Entry::Folder &&
+                                !util::IsDotOrDotDot (entry.name.c_str ())) {
+                            if (entry.name == folderName) {
+                                GetFiles (MakePath (path, entry.name), files);
+                            }
+                            else {
+                                GetFolderFiles (MakePath (path, entry.name), folderName, files);
+                            }
+                        }
+                    }
+                }
+
                 void UninstallDependencies (
                         const std::string &project_root,
                         const std::string &config_file,
@@ -593,6 +1005,30 @@ namespace thekogans {
                 }
             }
 
+            _LIB_THEKOGANS_MAKE_CORE_DECL void _LIB_THEKOGANS_MAKE_CORE_API SyncInstall (
+                    const std::string &organization,
+                    const std::string &project,
+                    const std::string &version,
+                    const std::vector<CopyPaths> &paths) {
+                std::set<std::string> staleFiles;
+                std::string toolchainDir = ToSystemPath (_TOOLCHAIN_DIR);
+                if (util::Path (toolchainDir).Exists ()) {
+                    GetFolderFiles (
+                        toolchainDir,
+                        GetFileName (organization, project, std::string (), version, std::string ()),
+                        staleFiles);
+                }
+                for (std::size_t i = 0, count = paths.size (); i < count; ++i) {
+                    staleFiles.erase (ToSystemPath (paths[i].second));
+                }
+                for (std::set<std::string>::const_iterator
+                        it = staleFiles.begin (),
+                        end = staleFiles.end (); it != end; ++it) {
+                    DeleteFile (*it);
+                }
+                CopyFiles (paths, COPY_MODE_COPY, false, true);
+            }
+
             _LIB_THEKOGANS_MAKE_CORE_DECL void _LIB_THEKOGANS_MAKE_CORE_API Uninstall (
                     const std::string &organization,
                     const std::string &project,
@@ -675,6 +1111,7 @@ namespace thekogans {
                         }
                     }
                     std::string configFilePath = MakePath (project_root, config_file);
+                    THEKOGANS_MAKE_CORE_TRACE_SPAN ("install", "Uninstall " + configFilePath);
                     std::cout << "Uninstalling " << configFilePath << std::endl;
                     std::cout.flush ();
                     DeleteFolders (
@@ -792,7 +1229,9 @@ namespace thekogans {
                     const std::string &project_root,
                     const std::string &config_,
                     const std::string &type,
-                    const std::string &destination) {
+                    const std::string &destination,
+                    CopyMode mode) {
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("copy", "Copy dependencies " + project_root);
                 const thekogans_make &config = thekogans_make::GetConfig (
                     project_root,
                     THEKOGANS_MAKE_XML,
@@ -813,7 +1252,7 @@ namespace thekogans {
                     std::string fromDirectory = util::Path (*it).GetDirectory ();
                     std::string fromFileName = util::Path (*it).GetFullFileName ();
                     std::string sharedLibrary = MakePath (toDirectory, fromFileName);
-                    CopyFile (*it, sharedLibrary);
+                    CopyFile (*it, sharedLibrary, mode);
                     manifest.AddFile (fromFileName, goalFileName);
                     std::string fromPluginsPath = ToSystemPath (*it + EXT_SEPARATOR + PLUGINS_EXT);
                     std::string toPluginsPath = ToSystemPath (sharedLibrary + EXT_SEPARATOR + PLUGINS_EXT);
@@ -841,14 +1280,16 @@ namespace thekogans {
                                         end = added.end (); jt != end; ++jt) {
                                     CopyFile (
                                         MakePath (fromDirectory, (*jt)->path),
-                                        MakePath (toDirectory, (*jt)->path));
+                                        MakePath (toDirectory, (*jt)->path),
+                                        mode);
                                     manifest.AddFile ((*jt)->path, goalFileName);
                                     for (util::Plugins::Plugin::Dependencies::const_iterator
                                             kt = (*jt)->dependencies.begin (),
                                             end = (*jt)->dependencies.end (); kt != end; ++kt) {
                                         CopyFile (
                                             MakePath (fromDirectory, *kt),
-                                            MakePath (toDirectory, *kt));
+                                            MakePath (toDirectory, *kt),
+                                            mode);
                                         manifest.AddFile (*kt, (*jt)->path);
                                     }
                                     toPlugins.AddPlugin (
@@ -877,7 +1318,8 @@ namespace thekogans {
                                         end = modified.end (); jt != end; ++jt) {
                                     CopyFile (
                                         MakePath (fromDirectory, (*jt).first->path),
-                                        MakePath (toDirectory, (*jt).first->path));
+                                        MakePath (toDirectory, (*jt).first->path),
+                                        mode);
                                     for (util::Plugins::Plugin::Dependencies::const_iterator
                                             kt = (*jt).first->dependencies.begin (),
                                             end = (*jt).first->dependencies.end (); kt != end; ++kt) {
@@ -890,7 +1332,8 @@ namespace thekogans {
                                             end = (*jt).second->dependencies.end (); kt != end; ++kt) {
                                         CopyFile (
                                             MakePath (fromDirectory, *kt),
-                                            MakePath (toDirectory, *kt));
+                                            MakePath (toDirectory, *kt),
+                                            mode);
                                         manifest.AddFile (*kt, (*jt).second->path);
                                     }
                                 }
@@ -906,17 +1349,20 @@ namespace thekogans {
                                     end = pluginMap.end (); jt != end; ++jt) {
                                 CopyFile (
                                     MakePath (fromDirectory, jt->first),
-                                    MakePath (toDirectory, jt->first));
+                                    MakePath (toDirectory, jt->first),
+                                    mode);
                                 manifest.AddFile (jt->first, goalFileName);
                                 for (util::Plugins::Plugin::Dependencies::const_iterator
                                         kt = jt->second->dependencies.begin (),
                                         end = jt->second->dependencies.end (); kt != end; ++kt) {
                                     CopyFile (
                                         MakePath (fromDirectory, *kt),
-                                        MakePath (toDirectory, *kt));
+                                        MakePath (toDirectory, *kt),
+                                        mode);
                                     manifest.AddFile (*kt, jt->first);
                                 }
                             }
+                            // Always a copy, it's edited in place when merging.
                             CopyFile (fromPluginsPath, toPluginsPath);
                         }
                     }
@@ -1049,6 +1495,7 @@ namespace thekogans {
                     const std::string &type,
                     bool generateDependencies,
                     bool force) {
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("generator", generator_ + " " + project_root);
                 Generator::SharedPtr generator = Generator::CreateGenerator (generator_, true);
                 if (generator != nullptr) {
                     if (config == CONFIG_DEBUG || config == CONFIG_RELEASE) {
@@ -1118,6 +1565,7 @@ namespace thekogans {
                         const std::string &gnu_make,
                         const std::list<std::string> &arguments,
                         const std::string &target) {
+                    THEKOGANS_MAKE_CORE_TRACE_SPAN ("make", build_root + " " + target);
                     util::ChildProcess gnu_makeProcess (gnu_make);
                     gnu_makeProcess.AddArgument ("-f");
                     gnu_makeProcess.AddArgument (MakePath (build_root, MAKEFILE));
@@ -1136,14 +1584,45 @@ namespace thekogans {
                     }
                 }
 
-                void BuildProjectHelper (
+                // Building a project is done in two phases. First the
+                // dependency graph is walked (in process, single threaded)
+                // and the steps needed to build it are recorded. Then the
+                // steps are executed. This lets BuildProjectVariants run
+                // the (expensive) gnu_make steps of several variants
+                // concurrently.
+                struct BuildStep {
+                    enum Kind {
+                        Make,
+                        CopyDependencies,
+                        CopyPlugin
+                    } kind;
+                    // Make: build_root. Copy*: project_root.
+                    std::string root;
+                    std::string config;
+                    std::string type;
+                    std::string target;
+
+                    BuildStep (
+                        Kind kind_,
+                        const std::string &root_,
+                        const std::string &config_ = std::string (),
+                        const std::string &type_ = std::string (),
+                        const std::string &target_ = std::string ()) :
+                        kind (kind_),
+                        root (root_),
+                        config (config_),
+                        type (type_),
+                        target (target_) {}
+                };
+                typedef std::list<BuildStep> BuildPlan;
+
+                void PlanBuildProject (
                         const std::string &project_root,
                         const std::string &config_,
                         const std::string &type,
-                        const std::string &gnu_make,
-                        const std::list<std::string> &arguments,
                         const std::string &target,
-                        std::unordered_set<std::string> &builtProjects) {
+                        std::unordered_set<std::string> &builtProjects,
+                        BuildPlan &plan) {
                     if (builtProjects.find (project_root) == builtProjects.end ()) {
                         builtProjects.insert (project_root);
                         const thekogans_make &config = thekogans_make::GetConfig (
@@ -1157,14 +1636,13 @@ namespace thekogans {
                                     it = config.plugin_hosts.begin (),
                                     end = config.plugin_hosts.end (); it != end; ++it) {
                                 if ((*it)->GetConfigFile () == THEKOGANS_MAKE_XML) {
-                                    BuildProjectHelper (
+                                    PlanBuildProject (
                                         (*it)->GetProjectRoot (),
                                         (*it)->GetConfig (),
                                         (*it)->GetType (),
-                                        gnu_make,
-                                        arguments,
                                         target == TARGET_TESTS_SELF ? TARGET_ALL : target,
-                                        builtProjects);
+                                        builtProjects,
+                                        plan);
                                     if (target == TARGET_ALL || target == TARGET_TESTS) {
                                         const core::thekogans_make &plugin_host = thekogans_make::GetConfig (
                                             (*it)->GetProjectRoot (),
@@ -1173,15 +1651,19 @@ namespace thekogans {
                                             (*it)->GetConfig (),
                                             (*it)->GetType ());
                                         if (plugin_host.project_type == PROJECT_TYPE_PROGRAM) {
-                                            CopyDependencies (
-                                                (*it)->GetProjectRoot (),
-                                                (*it)->GetConfig (),
-                                                (*it)->GetType ());
+                                            plan.push_back (
+                                                BuildStep (
+                                                    BuildStep::CopyDependencies,
+                                                    (*it)->GetProjectRoot (),
+                                                    (*it)->GetConfig (),
+                                                    (*it)->GetType ()));
                                         }
                                         else if (plugin_host.project_type == PROJECT_TYPE_PLUGIN) {
-                                            CopyPlugin (
-                                                (*it)->GetProjectRoot (),
-                                                (*it)->GetConfig ());
+                                            plan.push_back (
+                                                BuildStep (
+                                                    BuildStep::CopyPlugin,
+                                                    (*it)->GetProjectRoot (),
+                                                    (*it)->GetConfig ()));
                                         }
                                     }
                                 }
@@ -1191,20 +1673,164 @@ namespace thekogans {
                                 it = config.dependencies.begin (),
                                 end = config.dependencies.end (); it != end; ++it) {
                             if ((*it)->GetConfigFile () == THEKOGANS_MAKE_XML) {
-                                BuildProjectHelper (
+                                PlanBuildProject (
                                     (*it)->GetProjectRoot (),
                                     (*it)->GetConfig (),
                                     (*it)->GetType (),
-                                    gnu_make,
-                                    arguments,
                                     target == TARGET_TESTS_SELF ? TARGET_ALL : target,
-                                    builtProjects);
+                                    builtProjects,
+                                    plan);
                             }
                         }
-                        std::string build_root = GetBuildRoot (project_root, "make", config_, type);
-                        Execgnu_make (build_root, gnu_make, arguments, target);
-                        if (target == TARGET_CLEAN) {
-                            DeleteFile (MakePath (build_root, MAKEFILE));
+                        plan.push_back (
+                            BuildStep (
+                                BuildStep::Make,
+                                GetBuildRoot (project_root, "make", config_, type),
+                                config_,
+                                type,
+                                target));
+                    }
+                }
+
+                void PlanBuildProject (
+                        const std::string &project_root,
+                        const std::string &config_,
+                        const std::string &type,
+                        const std::string &target,
+                        BuildPlan &plan) {
+                    std::string build_type =
+                        target == TARGET_TESTS || target == TARGET_TESTS_SELF ? GetTestsType (type) : type;
+                    CreateBuildSystem (
+                        project_root,
+                        "make",
+                        config_,
+                        build_type,
+                        true,
+                        false);
+                    if (target != TARGET_CLEAN_SELF) {
+                        std::unordered_set<std::string> builtProjects;
+                        PlanBuildProject (
+                            project_root,
+                            config_,
+                            build_type,
+                            target,
+                            builtProjects,
+                            plan);
+                        if (target == TARGET_ALL || target == TARGET_TESTS || target == TARGET_TESTS_SELF) {
+                            const thekogans_make &config = thekogans_make::GetConfig (
+                                project_root,
+                                THEKOGANS_MAKE_XML,
+                                MAKE,
+                                config_,
+                                build_type);
+                            if (config.project_type == PROJECT_TYPE_PROGRAM) {
+                                plan.push_back (
+                                    BuildStep (
+                                        BuildStep::CopyDependencies,
+                                        project_root,
+                                        config_,
+                                        type));
+                            }
+                            else if (config.project_type == PROJECT_TYPE_PLUGIN) {
+                                plan.push_back (
+                                    BuildStep (
+                                        BuildStep::CopyPlugin,
+                                        project_root,
+                                        config_));
+                            }
+                        }
+                    }
+                    else {
+                        plan.push_back (
+                            BuildStep (
+                                BuildStep::Make,
+                                GetBuildRoot (project_root, "make", config_, type),
+                                config_,
+                                type,
+                                target));
+                    }
+                }
+
+                std::string Getgnu_make () {
+                    return ToSystemPath (
+                        Toolchain::GetProgram ("gnu", "make",
+                            Toolchain::GetLatestVersion ("gnu", "make")));
+                }
+
+                void Getgnu_makeArguments (
+                        const std::string &mode,
+                        bool hide_commands,
+                        bool parallel_build,
+                        util::ui32 jobs,
+                        std::list<std::string> &arguments) {
+                    if (hide_commands) {
+                        arguments.push_back ("--quiet");
+                    }
+                    if (parallel_build) {
+                        arguments.push_back ("--output-sync");
+                        // jobs == 0 means unlimited.
+                        arguments.push_back (jobs > 0 ? "-j" + util::ui32Tostring (jobs) : "-j");
+                    }
+                    arguments.push_back ("mode=" + mode);
+                    arguments.push_back ("hide_commands=" + std::string (hide_commands ? VALUE_YES : VALUE_NO));
+                }
+
+                // Serializes gnu_make runs on the same build root. Variants
+                // building concurrently can share dependencies whose type
+                // or config is pinned in thekogans_make.xml.
+                struct BuildRootLocks {
+                    std::mutex mutex;
+                    std::map<std::string, std::unique_ptr<std::mutex>> locks;
+
+                    std::mutex &GetLock (const std::string &build_root) {
+                        std::lock_guard<std::mutex> guard (mutex);
+                        std::unique_ptr<std::mutex> &lock = locks[build_root];
+                        if (lock.get () == 0) {
+                            lock.reset (new std::mutex);
+                        }
+                        return *lock;
+                    }
+                };
+
+                void ExecuteMakeSteps (
+                        const BuildPlan &plan,
+                        const std::string &gnu_make,
+                        const std::list<std::string> &arguments,
+                        BuildRootLocks *buildRootLocks) {
+                    for (BuildPlan::const_iterator
+                            it = plan.begin (),
+                            end = plan.end (); it != end; ++it) {
+                        if (it->kind == BuildStep::Make) {
+                            if (buildRootLocks != 0) {
+                                std::lock_guard<std::mutex> guard (buildRootLocks->GetLock (it->root));
+                                Execgnu_make (it->root, gnu_make, arguments, it->target);
+                            }
+                            else {
+                                Execgnu_make (it->root, gnu_make, arguments, it->target);
+                            }
+                        }
+                    }
+                }
+
+                void ExecuteCopySteps (const BuildPlan &plan) {
+                    for (BuildPlan::const_iterator
+                            it = plan.begin (),
+                            end = plan.end (); it != end; ++it) {
+                        if (it->kind == BuildStep::Make) {
+                            if (it->target == TARGET_CLEAN || it->target == TARGET_CLEAN_SELF) {
+                                DeleteFile (MakePath (it->root, MAKEFILE));
+                            }
+                        }
+                        else if (it->kind == BuildStep::CopyDependencies) {
+                            CopyDependencies (
+                                it->root,
+                                it->config,
+                                it->type,
+                                std::string (),
+                                GetDependenciesCopyMode ());
+                        }
+                        else if (it->kind == BuildStep::CopyPlugin) {
+                            CopyPlugin (it->root, it->config);
                         }
                     }
                 }
@@ -1218,56 +1844,76 @@ namespace thekogans {
                     bool hide_commands,
                     bool parallel_build,
                     const std::string &target) {
-                CreateBuildSystem (
-                    project_root,
-                    "make",
-                    config_,
-                    target == TARGET_TESTS || target == TARGET_TESTS_SELF ? TYPE_STATIC : type,
-                    true,
-                    false);
-                std::string gnu_make =
-                    ToSystemPath (
-                        Toolchain::GetProgram ("gnu", "make",
-                            Toolchain::GetLatestVersion ("gnu", "make")));
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("build", project_root + " " + config_ + " " + type);
+                thekogans_make::TrimPoint trimPoint;
+                BuildPlan plan;
+                PlanBuildProject (project_root, config_, type, target, plan);
                 std::list<std::string> arguments;
-                if (hide_commands) {
-                    arguments.push_back ("--quiet");
-                }
-                if (parallel_build) {
-                    arguments.push_back ("--output-sync");
-                    arguments.push_back ("-j");
-                }
-                arguments.push_back ("mode=" + mode);
-                arguments.push_back ("hide_commands=" + std::string (hide_commands ? VALUE_YES : VALUE_NO));
-                if (target != TARGET_CLEAN_SELF) {
-                    std::unordered_set<std::string> builtProjects;
-                    BuildProjectHelper (
-                        project_root,
-                        config_,
-                        target == TARGET_TESTS || target == TARGET_TESTS_SELF ? TYPE_STATIC : type,
-                        gnu_make,
-                        arguments,
-                        target,
-                        builtProjects);
-                    if (target == TARGET_ALL || target == TARGET_TESTS || target == TARGET_TESTS_SELF) {
-                        const thekogans_make &config = thekogans_make::GetConfig (
-                            project_root,
-                            THEKOGANS_MAKE_XML,
-                            MAKE,
-                            config_,
-                            target == TARGET_TESTS || target == TARGET_TESTS_SELF ? TYPE_STATIC : type);
-                        if (config.project_type == PROJECT_TYPE_PROGRAM) {
-                            CopyDependencies (project_root, config_, type);
-                        }
-                        else if (config.project_type == PROJECT_TYPE_PLUGIN) {
-                            CopyPlugin (project_root, config_);
-                        }
+                Getgnu_makeArguments (mode, hide_commands, parallel_build, 0, arguments);
+                std::string gnu_make = Getgnu_make ();
+                // Preserve the original interleaving of builds and copies.
+                for (BuildPlan::const_iterator
+                        it = plan.begin (),
+                        end = plan.end (); it != end; ++it) {
+                    BuildPlan step (1, *it);
+                    ExecuteMakeSteps (step, gnu_make, arguments, 0);
+                    ExecuteCopySteps (step);
+                }
+            }
+
+            _LIB_THEKOGANS_MAKE_CORE_DECL void _LIB_THEKOGANS_MAKE_CORE_API BuildProjectVariants (
+                    const std::string &project_root,
+                    const std::list<BuildVariant> &variants,
+                    const std::string &mode,
+                    bool hide_commands,
+                    bool parallel_build,
+                    const std::string &target) {
+                if (variants.empty ()) {
+                    return;
+                }
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("build", project_root);
+                thekogans_make::TrimPoint trimPoint;
+                // Phase 1: generate the build systems and plan the builds.
+                std::vector<BuildPlan> plans;
+                for (std::list<BuildVariant>::const_iterator
+                        it = variants.begin (),
+                        end = variants.end (); it != end; ++it) {
+                    plans.push_back (BuildPlan ());
+                    PlanBuildProject (project_root, it->first, it->second, target, plans.back ());
+                }
+                // Phase 2: run gnu_make for all variants concurrently, splitting
+                // the job budget (one job per core) between them.
+                util::ui32 jobs = std::max (1u,
+                    std::max (1u, std::thread::hardware_concurrency ()) / (util::ui32)plans.size ());
+                std::list<std::string> arguments;
+                Getgnu_makeArguments (mode, hide_commands, parallel_build, jobs, arguments);
+                std::string gnu_make = Getgnu_make ();
+                BuildRootLocks buildRootLocks;
+                std::vector<std::exception_ptr> exceptions (plans.size ());
+                std::vector<std::thread> threads;
+                for (std::size_t i = 0, count = plans.size (); i < count; ++i) {
+                    threads.push_back (
+                        std::thread (
+                            [&, i] () {
+                                try {
+                                    ExecuteMakeSteps (plans[i], gnu_make, arguments, &buildRootLocks);
+                                }
+                                catch (...) {
+                                    exceptions[i] = std::current_exception ();
+                                }
+                            }));
+                }
+                for (std::size_t i = 0, count = threads.size (); i < count; ++i) {
+                    threads[i].join ();
+                }
+                for (std::size_t i = 0, count = exceptions.size (); i < count; ++i) {
+                    if (exceptions[i]) {
+                        std::rethrow_exception (exceptions[i]);
                     }
                 }
-                else {
-                    std::string build_root = GetBuildRoot (project_root, "make", config_, type);
-                    Execgnu_make (build_root, gnu_make, arguments, target);
-                    DeleteFile (MakePath (build_root, MAKEFILE));
+                // Phase 3: copy dependencies and plugins (in process, single threaded).
+                for (std::size_t i = 0, count = plans.size (); i < count; ++i) {
+                    ExecuteCopySteps (plans[i]);
                 }
             }
 
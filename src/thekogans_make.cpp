@@ -15,9 +15,16 @@
 // You should have received a copy of the GNU General Public License
 // along with thekogans_make_core. If not, see <http://www.gnu.org/licenses/>.
 
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <algorithm>
+#include <exception>
 #include <regex>
 #include <sstream>
+#include <unordered_set>
+#include <vector>
 #include "thekogans/util/Environment.h"
 #include "thekogans/util/Types.h"
 #include "thekogans/util/Version.h"
@@ -28,10 +35,14 @@
 #include "thekogans/util/ByteSwap.h"
 #include "thekogans/util/Exception.h"
 #include "thekogans/util/LoggerMgr.h"
+#include "thekogans/util/XMLUtils.h"
+#include "thekogans/make/core/Counters.h"
 #include "thekogans/make/core/Parser.h"
 #include "thekogans/make/core/Function.h"
+#include "thekogans/make/core/Profiler.h"
 #include "thekogans/make/core/Project.h"
 #include "thekogans/make/core/Toolchain.h"
+#include "thekogans/make/core/Trace.h"
 #include "thekogans/make/core/Utils.h"
 #include "thekogans/make/core/Version.h"
 #include "thekogans/make/core/thekogans_make.h"
@@ -64,6 +75,7 @@ namespace thekogans {
             const char * const thekogans_make::ATTR_TYPE = "type";
             const char * const thekogans_make::ATTR_FLAGS = "flags";
             const char * const thekogans_make::ATTR_PATH = "path";
+            const char * const thekogans_make::ATTR_SHA2_256 = "SHA2-256";
 
             const char * const thekogans_make::TAG_THEKOGANS_MAKE = "thekogans_make";
             const char * const thekogans_make::TAG_GOAL = "goal";
@@ -74,6 +86,9 @@ namespace thekogans {
             const char * const thekogans_make::TAG_PLUGIN_HOSTS = "plugin_hosts";
             const char * const thekogans_make::TAG_DEPENDENCIES = "dependencies";
             const char * const thekogans_make::TAG_DEPENDENCY = "dependency";
+            const char * const thekogans_make::TAG_CLOSURE = "closure";
+            const char * const thekogans_make::TAG_CONFIG_FILE = "config_file";
+            const char * const thekogans_make::TAG_DEPENDENCY_VERSION = "dependency_version";
             const char * const thekogans_make::TAG_PRECOMPILED_HEADER = "precompiled_header";
             const char * const thekogans_make::TAG_FILE = "file";
             const char * const thekogans_make::TAG_OUTPUT_FILE = "output_file";
@@ -93,6 +108,7 @@ namespace thekogans {
             const char * const thekogans_make::TAG_LIBRARIAN_FLAG = "librarian_flag";
             const char * const thekogans_make::TAG_LINK_LIBRARIES = "link_libraries";
             const char * const thekogans_make::TAG_LINK_LIBRARY = "link_library";
+            const char * const thekogans_make::TAG_SHARED_LIBRARY = "shared_library";
             const char * const thekogans_make::TAG_MASM_FLAGS = "masm_flags";
             const char * const thekogans_make::TAG_MASM_FLAG = "masm_flag";
             const char * const thekogans_make::TAG_MASM_PREPROCESSOR_DEFINITIONS = "masm_preprocessor_definitions";
@@ -202,6 +218,45 @@ namespace thekogans {
             THEKOGANS_UTIL_IMPLEMENT_HEAP_FUNCTIONS (thekogans_make::LinkLibraries)
 
             namespace {
+                // Libraries that dependency resolution pinned to a different
+                // version than the one (some of) their dependents were
+                // installed against. CheckDependencies fills it in before
+                // SetMinVersion rewrites any dependency versions.
+                std::set<std::string> &GetPinnedLibraries () {
+                    static std::set<std::string> pinnedLibraries;
+                    return pinnedLibraries;
+                }
+
+                // An installed closure can only stand in for the transitive
+                // configs if none of the libraries it was computed against
+                // were pinned to a different version.
+                bool HasClosure (const thekogans_make &config) {
+                    if (!config.closure.present) {
+                        return false;
+                    }
+                    const std::set<std::string> &pinnedLibraries = GetPinnedLibraries ();
+                    if (!pinnedLibraries.empty ()) {
+                        for (thekogans_make::Dependency::Versions::const_iterator
+                                it = config.closure.versions.begin (),
+                                end = config.closure.versions.end (); it != end; ++it) {
+                            if (pinnedLibraries.find (it->first) != pinnedLibraries.end ()) {
+                                return false;
+                            }
+                        }
+                    }
+                    return true;
+                }
+
+                void MergeVersions (
+                        const thekogans_make::Dependency::Versions &from,
+                        thekogans_make::Dependency::Versions &to) {
+                    for (thekogans_make::Dependency::Versions::const_iterator
+                            it = from.begin (),
+                            end = from.end (); it != end; ++it) {
+                        to[it->first].insert (it->second.begin (), it->second.end ());
+                    }
+                }
+
                 std::string FormatFeatures (const std::set<std::string> &features) {
                     std::string featureList;
                     if (!features.empty ()) {
@@ -324,6 +379,10 @@ namespace thekogans {
                         return dependency.GetProjectRoot () == GetProjectRoot ();
                     }
 
+                    virtual std::string GetEquivalenceKey () const {
+                        return "project:" + GetProjectRoot ();
+                    }
+
                     virtual void CollectVersions (Versions &versions) const {
                         const thekogans_make &config =
                             thekogans_make::GetConfig (
@@ -424,7 +483,7 @@ namespace thekogans {
                     }
 
                     virtual void GetPreprocessorDefinitions (
-                            std::list<std::string> &preprocessorDefinitions) const {
+                            OrderedSet<std::string> &preprocessorDefinitions) const {
                         const thekogans_make &config =
                             thekogans_make::GetConfig (
                                 GetProjectRoot (),
@@ -443,20 +502,8 @@ namespace thekogans {
                                     util::StringToUpper (SanitizeName (example).c_str ());
                                 PREFIX += PROJECT_EXAMPLE_SEPARATOR + EXAMPLE;
                             }
-                            std::string config_ = PREFIX + "_CONFIG_" + GetConfig ();
-                            if (std::find (
-                                    preprocessorDefinitions.begin (),
-                                    preprocessorDefinitions.end (), config_) ==
-                                    preprocessorDefinitions.end ()) {
-                                preprocessorDefinitions.push_back (config_);
-                            }
-                            std::string type = PREFIX + "_TYPE_" + GetType ();
-                            if (std::find (
-                                    preprocessorDefinitions.begin (),
-                                    preprocessorDefinitions.end (), type) ==
-                                    preprocessorDefinitions.end ()) {
-                                preprocessorDefinitions.push_back (type);
-                            }
+                            preprocessorDefinitions.Insert (PREFIX + "_CONFIG_" + GetConfig ());
+                            preprocessorDefinitions.Insert (PREFIX + "_TYPE_" + GetType ());
                             for (std::list<Dependency::Ptr>::const_iterator
                                     it = config.dependencies.begin (),
                                     end = config.dependencies.end (); it != end; ++it) {
@@ -711,6 +758,10 @@ namespace thekogans {
                         return dependency.GetConfigFile () == GetConfigFile ();
                     }
 
+                    virtual std::string GetEquivalenceKey () const {
+                        return "toolchain:" + GetConfigFile ();
+                    }
+
                     virtual void CollectVersions (Versions &versions) const {
                         const thekogans_make &config =
                             thekogans_make::GetConfig (
@@ -732,10 +783,17 @@ namespace thekogans {
                                     std::string (),
                                     std::string ());
                             versions[projectName].insert (VersionAndBranch (version, std::string ()));
-                            for (std::list<Dependency::Ptr>::const_iterator
-                                    it = config.dependencies.begin (),
-                                    end = config.dependencies.end (); it != end; ++it) {
-                                (*it)->CollectVersions (versions);
+                            if (HasClosure (config)) {
+                                // The closure recorded everything below us
+                                // when we were installed.
+                                MergeVersions (config.closure.versions, versions);
+                            }
+                            else {
+                                for (std::list<Dependency::Ptr>::const_iterator
+                                        it = config.dependencies.begin (),
+                                        end = config.dependencies.end (); it != end; ++it) {
+                                    (*it)->CollectVersions (versions);
+                                }
                             }
                         }
                     }
@@ -775,16 +833,21 @@ namespace thekogans {
                                 }
                                 version = versionSet.begin ()->first;
                             }
-                            for (std::list<Dependency::Ptr>::const_iterator
-                                    it = config.dependencies.begin (),
-                                    end = config.dependencies.end (); it != end; ++it) {
-                                (*it)->SetMinVersion (versions, visitedDependencies);
+                            // If nothing below us was pinned there's
+                            // nothing to rewrite, and no reason to
+                            // load the transitive configs.
+                            if (!HasClosure (config)) {
+                                for (std::list<Dependency::Ptr>::const_iterator
+                                        it = config.dependencies.begin (),
+                                        end = config.dependencies.end (); it != end; ++it) {
+                                    (*it)->SetMinVersion (versions, visitedDependencies);
+                                }
                             }
                         }
                     }
 
                     virtual void GetPreprocessorDefinitions (
-                            std::list<std::string> &preprocessorDefinitions) const {
+                            OrderedSet<std::string> &preprocessorDefinitions) const {
                         const thekogans_make &config =
                             thekogans_make::GetConfig (
                                 GetProjectRoot (),
@@ -798,18 +861,8 @@ namespace thekogans {
                             std::string NAME =
                                 util::StringToUpper (SanitizeName (name).c_str ());
                             std::string PREFIX = ORGANIZATION + ORGANIZATION_PROJECT_SEPARATOR + NAME;
-                            std::string config_ = PREFIX + "_CONFIG_" + GetConfig ();
-                            if (std::find (
-                                    preprocessorDefinitions.begin (),
-                                    preprocessorDefinitions.end (), config_) == preprocessorDefinitions.end ()) {
-                                preprocessorDefinitions.push_back (config_);
-                            }
-                            std::string type = PREFIX + "_TYPE_" + GetType ();
-                            if (std::find (
-                                    preprocessorDefinitions.begin (),
-                                    preprocessorDefinitions.end (), type) == preprocessorDefinitions.end ()) {
-                                preprocessorDefinitions.push_back (type);
-                            }
+                            preprocessorDefinitions.Insert (PREFIX + "_CONFIG_" + GetConfig ());
+                            preprocessorDefinitions.Insert (PREFIX + "_TYPE_" + GetType ());
                             for (std::list<Dependency::Ptr>::const_iterator
                                     it = config.dependencies.begin (),
                                     end = config.dependencies.end (); it != end; ++it) {
@@ -828,6 +881,12 @@ namespace thekogans {
                                 GetConfig (),
                                 GetType ());
                         if (config.project_type == PROJECT_TYPE_LIBRARY) {
+                            if (HasClosure (config)) {
+                                features.insert (
+                                    config.closure.features.begin (),
+                                    config.closure.features.end ());
+                                return;
+                            }
                             for (std::set<std::string>::const_iterator
                                     it = config.features.begin (),
                                     end = config.features.end (); it != end; ++it) {
@@ -851,6 +910,12 @@ namespace thekogans {
                                 GetConfig (),
                                 GetType ());
                         if (config.project_type == PROJECT_TYPE_LIBRARY) {
+                            if (HasClosure (config)) {
+                                include_directories.insert (
+                                    config.closure.include_directories.begin (),
+                                    config.closure.include_directories.end ());
+                                return;
+                            }
                             if (!config.include_directories.empty ()) {
                                 for (std::list<thekogans_make::IncludeDirectories::Ptr>::const_iterator
                                         it = config.include_directories.begin (),
@@ -866,6 +931,7 @@ namespace thekogans {
                             }
                             else {
                                 std::string include_directory = config.GetToolchainIncludeDirectory ();
+                                Counters::Increment (Counters::FILE_SYSTEM_STATS);
                                 if (util::Path (ToSystemPath (include_directory)).Exists ()) {
                                     include_directories.insert (include_directory);
                                 }
@@ -888,6 +954,13 @@ namespace thekogans {
                                 GetConfig (),
                                 GetType ());
                         if (config.project_type == PROJECT_TYPE_LIBRARY) {
+                            if (HasClosure (config)) {
+                                link_libraries.insert (
+                                    link_libraries.end (),
+                                    config.closure.link_libraries.begin (),
+                                    config.closure.link_libraries.end ());
+                                return;
+                            }
                             if (!config.link_libraries.empty ()) {
                                 for (std::list<thekogans_make::LinkLibraries::Ptr>::const_iterator
                                         it = config.link_libraries.begin (),
@@ -903,6 +976,7 @@ namespace thekogans {
                             }
                             else {
                                 std::string link_library = config.GetToolchainLinkLibrary ();
+                                Counters::Increment (Counters::FILE_SYSTEM_STATS);
                                 if (util::Path (ToSystemPath (link_library)).Exists ()) {
                                     link_libraries.push_back (link_library);
                                 }
@@ -926,6 +1000,12 @@ namespace thekogans {
                                 GetConfig (),
                                 GetType ());
                         if (config.project_type == PROJECT_TYPE_LIBRARY) {
+                            if (HasClosure (config)) {
+                                shared_libraries.insert (
+                                    config.closure.shared_libraries.begin (),
+                                    config.closure.shared_libraries.end ());
+                                return;
+                            }
                             if (GetType () == TYPE_SHARED) {
                                 if (!config.link_libraries.empty ()) {
                                     for (std::list<thekogans_make::LinkLibraries::Ptr>::const_iterator
@@ -951,6 +1031,7 @@ namespace thekogans {
                                 }
                                 else {
                                     std::string shared_library = config.GetToolchainGoal ();
+                                    Counters::Increment (Counters::FILE_SYSTEM_STATS);
                                     if (util::Path (ToSystemPath (shared_library)).Exists ()) {
                                         shared_libraries.insert (shared_library);
                                     }
@@ -964,6 +1045,39 @@ namespace thekogans {
                         }
                     }
 
+                    void GetConfigFiles (std::map<std::string, std::string> &config_files) const {
+                        std::string config_file =
+                            ToSystemPath (MakePath (GetProjectRoot (), GetConfigFile ()));
+                        if (config_files.find (config_file) == config_files.end ()) {
+                            config_files[config_file] = GetFileHash (config_file);
+                            const thekogans_make &config =
+                                thekogans_make::GetConfig (
+                                    GetProjectRoot (),
+                                    GetConfigFile (),
+                                    GetGenerator (),
+                                    GetConfig (),
+                                    GetType ());
+                            if (config.project_type == PROJECT_TYPE_LIBRARY) {
+                                if (HasClosure (config)) {
+                                    config_files.insert (
+                                        config.closure.config_files.begin (),
+                                        config.closure.config_files.end ());
+                                }
+                                else {
+                                    for (std::list<Dependency::Ptr>::const_iterator
+                                            it = config.dependencies.begin (),
+                                            end = config.dependencies.end (); it != end; ++it) {
+                                        const ToolchainDependency *toolchainDependency =
+                                            dynamic_cast<const ToolchainDependency *> ((*it).get ());
+                                        if (toolchainDependency != 0) {
+                                            toolchainDependency->GetConfigFiles (config_files);
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                    }
+
                     virtual bool IsInstalled () const {
                         return Toolchain::IsInstalled (organization, name, version);
                     }
@@ -1062,6 +1176,10 @@ namespace thekogans {
                             libraryDependency->library == library;
                     }
 
+                    virtual std::string GetEquivalenceKey () const {
+                        return "library:" + library;
+                    }
+
                     virtual void CollectVersions (
                             Versions & /*versions*/) const {
                     }
@@ -1071,7 +1189,7 @@ namespace thekogans {
                     }
 
                     virtual void GetPreprocessorDefinitions (
-                            std::list<std::string> & /*preprocessorDefinitions*/) const {
+                            OrderedSet<std::string> & /*preprocessorDefinitions*/) const {
                     }
 
                     virtual void  GetFeatures (
@@ -1159,6 +1277,10 @@ namespace thekogans {
                             frameworkDependency->framework == framework;
                     }
 
+                    virtual std::string GetEquivalenceKey () const {
+                        return "framework:" + path + "\n" + framework;
+                    }
+
                     virtual void CollectVersions (
                             Versions & /*versions*/) const {
                     }
@@ -1168,7 +1290,7 @@ namespace thekogans {
                     }
 
                     virtual void GetPreprocessorDefinitions (
-                            std::list<std::string> & /*preprocessorDefinitions*/) const {
+                            OrderedSet<std::string> & /*preprocessorDefinitions*/) const {
                     }
 
                     virtual void  GetFeatures (
@@ -1247,6 +1369,10 @@ namespace thekogans {
                             systemDependency->library == library;
                     }
 
+                    virtual std::string GetEquivalenceKey () const {
+                        return "system:" + library;
+                    }
+
                     virtual void CollectVersions (
                             Versions & /*versions*/) const {
                     }
@@ -1256,7 +1382,7 @@ namespace thekogans {
                     }
 
                     virtual void GetPreprocessorDefinitions (
-                            std::list<std::string> & /*preprocessorDefinitions*/) const {
+                            OrderedSet<std::string> & /*preprocessorDefinitions*/) const {
                     }
 
                     virtual void  GetFeatures (
@@ -1319,124 +1445,410 @@ namespace thekogans {
                     type == TYPE_CREATE ? Create : None;
             }
 
+            namespace {
+                struct ConfigEntry {
+                    thekogans_make::Ptr config;
+                    // Approximate footprint (see thekogans_make::GetSize).
+                    std::size_t size;
+                    // ConfigCache::clock at last GetConfig.
+                    util::ui64 lastUsed;
+
+                    ConfigEntry (
+                        thekogans_make::Ptr config_,
+                        std::size_t size_,
+                        util::ui64 lastUsed_) :
+                        config (std::move (config_)),
+                        size (size_),
+                        lastUsed (lastUsed_) {}
+                };
+
+                typedef std::map<std::string, ConfigEntry> ConfigMap;
+
+                std::size_t GetDefaultConfigCacheMaxSize () {
+                    std::string maxSize =
+                        util::TrimSpaces (
+                            util::GetEnvironmentVariable ("THEKOGANS_MAKE_CONFIG_CACHE_MAX_SIZE").c_str ());
+                    return !maxSize.empty () ? (std::size_t)ParseSize (maxSize) : 0;
+                }
+
+                struct ConfigCache {
+                    ConfigMap configMap;
+                    // Sum of ConfigEntry::size.
+                    std::size_t size;
+                    // 0 = unbounded.
+                    std::size_t maxSize;
+                    util::ui64 clock;
+                    // Pin counts of configs held by thekogans_make::Pin.
+                    std::map<const thekogans_make *, std::size_t> pins;
+                    // Pinned configs dropped from configMap. They're no
+                    // longer served, but live until their last pin goes.
+                    std::map<const thekogans_make *, thekogans_make::Ptr> retired;
+                    // Number of live thekogans_make::TrimPoints.
+                    std::size_t trimPoints;
+
+                    ConfigCache () :
+                        size (0),
+                        maxSize (GetDefaultConfigCacheMaxSize ()),
+                        clock (0),
+                        trimPoints (0) {}
+
+                    inline bool IsPinned (const thekogans_make *config) const {
+                        return pins.find (config) != pins.end ();
+                    }
+
+                    void Drop (ConfigMap::iterator it) {
+                        size -= it->second.size;
+                        const thekogans_make *config = it->second.config.get ();
+                        if (IsPinned (config)) {
+                            retired[config] = std::move (it->second.config);
+                        }
+                        configMap.erase (it);
+                    }
+                };
+
+                ConfigCache &GetConfigCache () {
+                    static ConfigCache configCache;
+                    return configCache;
+                }
+
+                // Config files (canonical system paths) read, directly or
+                // through dependencies, while loading each ConfigMap entry.
+                typedef std::map<std::string, std::set<std::string>> ConfigInputsMap;
+
+                ConfigInputsMap &GetConfigInputsMap () {
+                    static ConfigInputsMap configInputsMap;
+                    return configInputsMap;
+                }
+
+                // Keys of the configs being loaded (outermost first).
+                std::vector<std::string> &GetLoadingConfigs () {
+                    static std::vector<std::string> loadingConfigs;
+                    return loadingConfigs;
+                }
+
+                struct LoadingConfig {
+                    LoadingConfig (
+                            const std::string &configKey,
+                            const std::string &configFilePath) {
+                        // Forget the inputs of a previous (failed) attempt.
+                        std::set<std::string> &inputs = GetConfigInputsMap ()[configKey];
+                        inputs.clear ();
+                        inputs.insert (GetCanonicalPath (configFilePath));
+                        GetLoadingConfigs ().push_back (configKey);
+                    }
+                    ~LoadingConfig () {
+                        GetLoadingConfigs ().pop_back ();
+                    }
+                };
+
+                // The config being loaded depends on the given file.
+                void AddConfigInput (const std::string &configFilePath) {
+                    std::vector<std::string> &loadingConfigs = GetLoadingConfigs ();
+                    if (!loadingConfigs.empty ()) {
+                        GetConfigInputsMap ()[loadingConfigs.back ()].insert (
+                            GetCanonicalPath (configFilePath));
+                    }
+                }
+
+                // Whatever the config being loaded gets from
+                // configKey, it depends on configKey's inputs.
+                void AddConfigInputs (const std::string &configKey) {
+                    std::vector<std::string> &loadingConfigs = GetLoadingConfigs ();
+                    if (!loadingConfigs.empty () && loadingConfigs.back () != configKey) {
+                        ConfigInputsMap &configInputsMap = GetConfigInputsMap ();
+                        const std::set<std::string> &inputs = configInputsMap[configKey];
+                        configInputsMap[loadingConfigs.back ()].insert (inputs.begin (), inputs.end ());
+                    }
+                }
+            }
+
+            namespace {
+                // Root element attributes. They're plain (unexpanded)
+                // strings, so there's no need to parse and evaluate the
+                // whole config (and load its dependencies) to get them.
+                struct RootAttributes {
+                    util::i64 lastModifiedDate;
+                    std::string organization;
+                    std::string project;
+                    std::string project_type;
+                    std::string major_version;
+                    std::string minor_version;
+                    std::string patch_version;
+                    std::string naming_convention;
+                    std::string build_config;
+                    std::string build_type;
+                    util::GUID guid;
+                    std::string schema_version;
+
+                    RootAttributes () :
+                        lastModifiedDate (0) {}
+                    explicit RootAttributes (const thekogans_make &config) :
+                        lastModifiedDate (0),
+                        organization (config.organization),
+                        project (config.project),
+                        project_type (config.project_type),
+                        major_version (config.major_version),
+                        minor_version (config.minor_version),
+                        patch_version (config.patch_version),
+                        naming_convention (config.naming_convention),
+                        build_config (config.build_config),
+                        build_type (config.build_type),
+                        guid (config.guid),
+                        schema_version (config.schema_version) {}
+
+                    // Return false if the thekogans_make ctor would reject
+                    // the root. The caller then loads the config to get a
+                    // proper error.
+                    bool Parse (const pugi::xml_node &root) {
+                        if (std::string (root.name ()) != thekogans_make::TAG_THEKOGANS_MAKE) {
+                            return false;
+                        }
+                        organization = root.attribute (thekogans_make::ATTR_ORGANIZATION).value ();
+                        project = root.attribute (thekogans_make::ATTR_PROJECT).value ();
+                        project_type = root.attribute (thekogans_make::ATTR_PROJECT_TYPE).value ();
+                        major_version = root.attribute (thekogans_make::ATTR_MAJOR_VERSION).value ();
+                        minor_version = root.attribute (thekogans_make::ATTR_MINOR_VERSION).value ();
+                        patch_version = root.attribute (thekogans_make::ATTR_PATCH_VERSION).value ();
+                        naming_convention = root.attribute (thekogans_make::ATTR_NAMING_CONVENTION).value ();
+                        if (naming_convention.empty ()) {
+                            naming_convention = _TOOLCHAIN_NAMING_CONVENTION;
+                        }
+                        build_config = root.attribute (thekogans_make::ATTR_BUILD_CONFIG).value ();
+                        build_type = root.attribute (thekogans_make::ATTR_BUILD_TYPE).value ();
+                        std::string guidString = root.attribute (thekogans_make::ATTR_GUID).value ();
+                        if (!guidString.empty ()) {
+                            guid = util::GUID::FromHexString (guidString);
+                        }
+                        schema_version = root.attribute (thekogans_make::ATTR_SCHEMA_VERSION).value ();
+                        if (schema_version.empty ()) {
+                            schema_version = util::ui32Tostring (THEKOGANS_MAKE_XML_SCHEMA_VERSION);
+                        }
+                        return
+                            !organization.empty () &&
+                            !project.empty () &&
+                            !project_type.empty () &&
+                            !major_version.empty () &&
+                            !minor_version.empty () &&
+                            !patch_version.empty () &&
+                            (naming_convention == NAMING_CONVENTION_FLAT ||
+                                naming_convention == NAMING_CONVENTION_HIERARCHICAL) &&
+                            util::stringToui32 (schema_version.c_str ()) <= THEKOGANS_MAKE_XML_SCHEMA_VERSION &&
+                            // The ctor only accepts Shared plugins. One that
+                            // asks for anything else can't be loaded at all.
+                            (project_type != PROJECT_TYPE_PLUGIN ||
+                                build_type.empty () || build_type == TYPE_SHARED);
+                    }
+                };
+
+                enum ScanResult {
+                    SCAN_INCOMPLETE,
+                    SCAN_FOUND,
+                    SCAN_INVALID
+                };
+
+                // Skip the prolog (xml declaration, processing instructions,
+                // comments) and find the root start tag. Anything else (DOCTYPE,
+                // non UTF-8 encodings...) is left to the full parser.
+                ScanResult FindRootStartTag (
+                        const std::string &text,
+                        std::size_t &begin,
+                        std::size_t &end) {
+                    const char * const UTF8_BOM = "\xef\xbb\xbf";
+                    std::size_t i = text.compare (0, 3, UTF8_BOM) == 0 ? 3 : 0;
+                    for (std::size_t size = text.size ();;) {
+                        while (i < size && isspace ((unsigned char)text[i])) {
+                            ++i;
+                        }
+                        if (i + 4 > size) {
+                            return SCAN_INCOMPLETE;
+                        }
+                        if (text[i] != '<') {
+                            return SCAN_INVALID;
+                        }
+                        if (text[i + 1] == '?' || text[i + 1] == '!') {
+                            const char *close = text[i + 1] == '?' ? "?>" : "-->";
+                            if (text[i + 1] == '!' && text.compare (i, 4, "<!--") != 0) {
+                                return SCAN_INVALID;
+                            }
+                            std::size_t closeOffset = text.find (close, i + 2);
+                            if (closeOffset == std::string::npos) {
+                                return SCAN_INCOMPLETE;
+                            }
+                            i = closeOffset + strlen (close);
+                        }
+                        else {
+                            char quote = 0;
+                            for (std::size_t j = i + 1; j < size; ++j) {
+                                if (quote != 0) {
+                                    if (text[j] == quote) {
+                                        quote = 0;
+                                    }
+                                }
+                                else if (text[j] == '"' || text[j] == '\'') {
+                                    quote = text[j];
+                                }
+                                else if (text[j] == '>') {
+                                    begin = i;
+                                    end = j + 1;
+                                    return SCAN_FOUND;
+                                }
+                            }
+                            return SCAN_INCOMPLETE;
+                        }
+                    }
+                }
+
+                // Read the config file up to (and including) the root start
+                // tag, and turn it in to a well formed document.
+                bool ReadRootStartTag (
+                        const std::string &configFilePath,
+                        std::string &startTag) {
+                    util::ReadOnlyFile configFile (util::HostEndian, configFilePath);
+                    // Same limit as CreateDOM.
+                    const std::size_t MAX_CONFIG_FILE_SIZE = 1024 * 1024;
+                    const std::size_t CHUNK_SIZE = 1024;
+                    char chunk[CHUNK_SIZE];
+                    std::string text;
+                    while (text.size () < MAX_CONFIG_FILE_SIZE) {
+                        std::size_t size = configFile.Read (chunk, CHUNK_SIZE);
+                        if (size == 0) {
+                            break;
+                        }
+                        text.append (chunk, size);
+                        std::size_t begin;
+                        std::size_t end;
+                        ScanResult result = FindRootStartTag (text, begin, end);
+                        if (result == SCAN_FOUND) {
+                            Counters::Increment (Counters::XML_BYTES_PARSED, end);
+                            startTag = text.substr (begin, end - begin);
+                            if (startTag.compare (startTag.size () - 2, 2, "/>") != 0) {
+                                startTag += "</";
+                                startTag += thekogans_make::TAG_THEKOGANS_MAKE;
+                                startTag += ">";
+                            }
+                            return true;
+                        }
+                        if (result == SCAN_INVALID) {
+                            break;
+                        }
+                    }
+                    return false;
+                }
+
+                typedef std::map<std::string, RootAttributes> RootAttributesMap;
+
+                RootAttributesMap &GetRootAttributesMap () {
+                    static RootAttributesMap rootAttributesMap;
+                    return rootAttributesMap;
+                }
+
+                // Return the (cached) root attributes of the given config.
+                // Cache entries are validated by the config file mtime.
+                const RootAttributes &GetRootAttributes (
+                        const std::string &project_root,
+                        const std::string &config_file) {
+                    std::string configFilePath = ToSystemPath (MakePath (project_root, config_file));
+                    // Whoever is loading a config now depends on this one.
+                    AddConfigInput (configFilePath);
+                    Counters::Increment (Counters::FILE_SYSTEM_STATS);
+                    util::i64 lastModifiedDate =
+                        util::Directory::Entry (configFilePath).lastModifiedDate;
+                    RootAttributesMap &rootAttributesMap = GetRootAttributesMap ();
+                    RootAttributesMap::iterator it = rootAttributesMap.find (configFilePath);
+                    if (it != rootAttributesMap.end () &&
+                            it->second.lastModifiedDate == lastModifiedDate) {
+                        return it->second;
+                    }
+                    RootAttributes rootAttributes;
+                    std::string startTag;
+                    pugi::xml_document document;
+                    if (!ReadRootStartTag (configFilePath, startTag) ||
+                            !document.load_buffer (startTag.data (), startTag.size ()) ||
+                            !rootAttributes.Parse (document.document_element ())) {
+                        // Let the full parser deal with (and report) whatever
+                        // we didn't like.
+                        rootAttributes = RootAttributes (
+                            thekogans_make::GetConfig (
+                                project_root,
+                                config_file,
+                                std::string (),
+                                std::string (),
+                                std::string ()));
+                    }
+                    // mtime has a one second resolution. A file modified
+                    // within the second we read it might change again
+                    // without its mtime changing. Don't trust it next time.
+                    rootAttributes.lastModifiedDate =
+                        lastModifiedDate + 1 < (util::i64)time (0) ? lastModifiedDate : -1;
+                    RootAttributes &cachedRootAttributes = rootAttributesMap[configFilePath];
+                    cachedRootAttributes = rootAttributes;
+                    return cachedRootAttributes;
+                }
+            }
+
             std::string thekogans_make::GetOrganization (
                     const std::string &project_root,
                     const std::string &config_file) {
-                return GetConfig (
-                    project_root,
-                    config_file,
-                    std::string (),
-                    std::string (),
-                    std::string ()).organization;
+                return GetRootAttributes (project_root, config_file).organization;
             }
 
             std::string thekogans_make::GetProject (
                     const std::string &project_root,
                     const std::string &config_file) {
-                return GetConfig (
-                    project_root,
-                    config_file,
-                    std::string (),
-                    std::string (),
-                    std::string ()).project;
+                return GetRootAttributes (project_root, config_file).project;
             }
 
             std::string thekogans_make::GetProjectType (
                     const std::string &project_root,
                     const std::string &config_file) {
-                return GetConfig (
-                    project_root,
-                    config_file,
-                    std::string (),
-                    std::string (),
-                    std::string ()).project_type;
+                return GetRootAttributes (project_root, config_file).project_type;
             }
 
             std::string thekogans_make::GetVersion (
                     const std::string &project_root,
                     const std::string &config_file) {
-                const thekogans_make &config = GetConfig (
-                    project_root,
-                    config_file,
-                    std::string (),
-                    std::string (),
-                    std::string ());
-                return config.major_version + VERSION_SEPARATOR +
-                    config.minor_version + VERSION_SEPARATOR +
-                    config.patch_version;
+                const RootAttributes &rootAttributes =
+                    GetRootAttributes (project_root, config_file);
+                return rootAttributes.major_version + VERSION_SEPARATOR +
+                    rootAttributes.minor_version + VERSION_SEPARATOR +
+                    rootAttributes.patch_version;
             }
 
             std::string thekogans_make::GetNamingConvention (
                     const std::string &project_root,
                     const std::string &config_file) {
-                std::string naming_convention = GetConfig (
-                    project_root,
-                    config_file,
-                    std::string (),
-                    std::string (),
-                    std::string ()).naming_convention;
-                return naming_convention.empty () ?
-                    _TOOLCHAIN_NAMING_CONVENTION :
-                    naming_convention;
+                return GetRootAttributes (project_root, config_file).naming_convention;
             }
 
             std::string thekogans_make::GetBuildConfig (
                     const std::string &project_root,
                     const std::string &config_file) {
-                return GetConfig (
-                    project_root,
-                    config_file,
-                    std::string (),
-                    std::string (),
-                    std::string ()).build_config;
+                return GetRootAttributes (project_root, config_file).build_config;
             }
 
             std::string thekogans_make::GetBuildType (
                     const std::string &project_root,
                     const std::string &config_file) {
-                const thekogans_make &config = GetConfig (
-                    project_root,
-                    config_file,
-                    std::string (),
-                    std::string (),
-                    std::string ());
-                if (config.build_type.empty ()) {
-                    if (config.project_type == PROJECT_TYPE_PLUGIN) {
+                const RootAttributes &rootAttributes =
+                    GetRootAttributes (project_root, config_file);
+                if (rootAttributes.build_type.empty ()) {
+                    if (rootAttributes.project_type == PROJECT_TYPE_PLUGIN) {
                         return TYPE_SHARED;
                     }
                 }
-                return config.build_type;
+                return rootAttributes.build_type;
             }
 
             util::GUID thekogans_make::GetGUID (
                     const std::string &project_root,
                     const std::string &config_file) {
-                return GetConfig (
-                    project_root,
-                    config_file,
-                    std::string (),
-                    std::string (),
-                    std::string ()).guid;
+                return GetRootAttributes (project_root, config_file).guid;
             }
 
             std::string thekogans_make::GetSchemaVersion (
                     const std::string &project_root,
                     const std::string &config_file) {
-                return GetConfig (
-                    project_root,
-                    config_file,
-                    std::string (),
-                    std::string (),
-                    std::string ()).schema_version;
-            }
-
-            namespace {
-                typedef std::map<std::string, thekogans_make::Ptr> ConfigMap;
-
-                ConfigMap &GetConfigMap () {
-                    static ConfigMap configMap;
-                    return configMap;
-                }
+                return GetRootAttributes (project_root, config_file).schema_version;
             }
 
             const thekogans_make &thekogans_make::GetConfig (
@@ -1445,26 +1857,48 @@ namespace thekogans {
                     const std::string &generator,
                     const std::string &config,
                     const std::string &type) {
-                ConfigMap &configMap = GetConfigMap ();
+                ConfigCache &configCache = GetConfigCache ();
+                ConfigMap &configMap = configCache.configMap;
                 std::string configKey =
                     GetConfigKey (project_root, config_file, generator, config, type);
                 ConfigMap::iterator it = configMap.lower_bound (configKey);
                 if (it == configMap.end () ||
                         configKey.size () > it->first.size () ||
                         !std::equal (configKey.begin (), configKey.end (), it->first.begin ())) {
+                    Counters::Increment (Counters::CONFIG_CACHE_MISSES);
+                #if defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
+                    // Before the (serial) dependency resolution done by
+                    // the ctor, fetch missing source projects in parallel.
+                    // Prefetch walks the whole reachable graph, so it's
+                    // only done for top level loads. The dependency loads
+                    // nested in them have already been covered.
+                    if (!generator.empty () && config_file == THEKOGANS_MAKE_XML &&
+                            GetLoadingConfigs ().empty ()) {
+                        Project::Prefetch (project_root);
+                    }
+                #endif // defined (THEKOGANS_MAKE_CORE_HAVE_CURL)
+                    THEKOGANS_MAKE_CORE_TRACE_SPAN ("config", MakePath (project_root, config_file));
+                    thekogans_make::Ptr newConfig;
+                    {
+                        LoadingConfig loadingConfig (
+                            configKey, ToSystemPath (MakePath (project_root, config_file)));
+                        newConfig.reset (
+                            new thekogans_make (
+                                project_root,
+                                config_file,
+                                generator,
+                                config,
+                                type));
+                    }
+                    std::size_t size = newConfig->GetSize ();
                     std::pair<ConfigMap::iterator, bool> result =
                         configMap.insert (
                             ConfigMap::value_type (
                                 configKey,
-                                thekogans_make::Ptr (
-                                    new thekogans_make (
-                                        project_root,
-                                        config_file,
-                                        generator,
-                                        config,
-                                        type))));
+                                ConfigEntry (std::move (newConfig), size, ++configCache.clock)));
                     if (result.second) {
                         it = result.first;
+                        configCache.size += size;
                     }
                     else {
                         THEKOGANS_UTIL_THROW_STRING_EXCEPTION (
@@ -1472,10 +1906,305 @@ namespace thekogans {
                             configKey.c_str ());
                     }
                 }
-                return *it->second;
+                else {
+                    Counters::Increment (Counters::CONFIG_CACHE_HITS);
+                    it->second.lastUsed = ++configCache.clock;
+                }
+                AddConfigInputs (it->first);
+                return *it->second.config;
+            }
+
+            std::size_t thekogans_make::InvalidateConfigs (const std::string &configFilePath) {
+                std::string systemPath = GetCanonicalPath (ToSystemPath (configFilePath));
+                ConfigCache &configCache = GetConfigCache ();
+                ConfigInputsMap &configInputsMap = GetConfigInputsMap ();
+                std::size_t count = 0;
+                for (ConfigInputsMap::iterator it = configInputsMap.begin ();
+                        it != configInputsMap.end ();) {
+                    if (it->second.find (systemPath) != it->second.end ()) {
+                        ConfigMap::iterator config = configCache.configMap.find (it->first);
+                        if (config != configCache.configMap.end ()) {
+                            configCache.Drop (config);
+                            ++count;
+                        }
+                        configInputsMap.erase (it++);
+                    }
+                    else {
+                        ++it;
+                    }
+                }
+                return count;
+            }
+
+            std::size_t thekogans_make::ClearConfigs () {
+                ConfigCache &configCache = GetConfigCache ();
+                std::size_t count = configCache.configMap.size ();
+                while (!configCache.configMap.empty ()) {
+                    configCache.Drop (configCache.configMap.begin ());
+                }
+                GetConfigInputsMap ().clear ();
+                // The pinned versions were written in to the
+                // dependencies of the configs we just dropped.
+                GetPinnedLibraries ().clear ();
+                return count;
+            }
+
+            void thekogans_make::GetConfigFiles (std::set<std::string> &configFiles) {
+                const ConfigInputsMap &configInputsMap = GetConfigInputsMap ();
+                for (ConfigInputsMap::const_iterator
+                        it = configInputsMap.begin (),
+                        end = configInputsMap.end (); it != end; ++it) {
+                    configFiles.insert (it->second.begin (), it->second.end ());
+                }
+            }
+
+            thekogans_make::Pin::Pin (const thekogans_make &config_) :
+                    config (config_) {
+                ++GetConfigCache ().pins[&config];
+            }
+
+            thekogans_make::Pin::~Pin () {
+                ConfigCache &configCache = GetConfigCache ();
+                std::map<const thekogans_make *, std::size_t>::iterator it =
+                    configCache.pins.find (&config);
+                if (it != configCache.pins.end () && --it->second == 0) {
+                    configCache.pins.erase (it);
+                    configCache.retired.erase (&config);
+                }
+            }
+
+            thekogans_make::TrimPoint::TrimPoint () {
+                ++GetConfigCache ().trimPoints;
+            }
+
+            thekogans_make::TrimPoint::~TrimPoint () {
+                if (--GetConfigCache ().trimPoints == 0 && !std::uncaught_exception ()) {
+                    TrimConfigs ();
+                }
+            }
+
+            std::size_t thekogans_make::GetConfigCacheMaxSize () {
+                return GetConfigCache ().maxSize;
+            }
+
+            void thekogans_make::SetConfigCacheMaxSize (std::size_t maxSize) {
+                GetConfigCache ().maxSize = maxSize;
+            }
+
+            std::size_t thekogans_make::GetConfigCacheSize () {
+                return GetConfigCache ().size;
+            }
+
+            std::size_t thekogans_make::GetConfigCacheCount () {
+                return GetConfigCache ().configMap.size ();
+            }
+
+            namespace {
+                bool LeastRecentlyUsed (
+                        ConfigMap::iterator config1,
+                        ConfigMap::iterator config2) {
+                    return config1->second.lastUsed < config2->second.lastUsed;
+                }
+            }
+
+            std::size_t thekogans_make::TrimConfigs () {
+                ConfigCache &configCache = GetConfigCache ();
+                std::size_t evicted = 0;
+                // Never evict from under a config being loaded.
+                if (configCache.maxSize != 0 &&
+                        configCache.size > configCache.maxSize &&
+                        GetLoadingConfigs ().empty ()) {
+                    std::vector<ConfigMap::iterator> configs;
+                    for (ConfigMap::iterator
+                            it = configCache.configMap.begin (),
+                            end = configCache.configMap.end (); it != end; ++it) {
+                        if (!configCache.IsPinned (it->second.config.get ())) {
+                            configs.push_back (it);
+                        }
+                    }
+                    std::sort (configs.begin (), configs.end (), LeastRecentlyUsed);
+                    for (std::size_t i = 0, count = configs.size ();
+                            configCache.size > configCache.maxSize && i < count; ++i) {
+                        GetConfigInputsMap ().erase (configs[i]->first);
+                        configCache.Drop (configs[i]);
+                        Counters::Increment (Counters::CONFIG_CACHE_EVICTIONS);
+                        ++evicted;
+                    }
+                }
+                return evicted;
+            }
+
+            namespace {
+                // Rough per node overhead of the std containers.
+                const std::size_t NODE_SIZE = 3 * sizeof (void *);
+
+                inline std::size_t GetStringSize (const std::string &value) {
+                    return sizeof (std::string) + value.capacity ();
+                }
+
+                template<typename Strings>
+                std::size_t GetStringsSize (const Strings &strings) {
+                    std::size_t size = 0;
+                    for (typename Strings::const_iterator
+                            it = strings.begin (),
+                            end = strings.end (); it != end; ++it) {
+                        size += NODE_SIZE + GetStringSize (*it);
+                    }
+                    return size;
+                }
+
+                std::size_t GetStringMapSize (const std::map<std::string, std::string> &strings) {
+                    std::size_t size = 0;
+                    for (std::map<std::string, std::string>::const_iterator
+                            it = strings.begin (),
+                            end = strings.end (); it != end; ++it) {
+                        size += NODE_SIZE + GetStringSize (it->first) + GetStringSize (it->second);
+                    }
+                    return size;
+                }
+
+                std::size_t GetSymbolTableSize (const SymbolTable &symbolTable) {
+                    std::size_t size = 0;
+                    for (SymbolTable::const_iterator
+                            it = symbolTable.begin (),
+                            end = symbolTable.end (); it != end; ++it) {
+                        size += NODE_SIZE + GetStringSize (it->first) +
+                            sizeof (Value) + GetStringsSize (it->second.value);
+                    }
+                    return size;
+                }
+
+                std::size_t GetFileListsSize (const std::list<thekogans_make::FileList::Ptr> &fileLists) {
+                    std::size_t size = 0;
+                    for (std::list<thekogans_make::FileList::Ptr>::const_iterator
+                            it = fileLists.begin (),
+                            end = fileLists.end (); it != end; ++it) {
+                        size += NODE_SIZE + sizeof (thekogans_make::FileList) +
+                            (*it)->prefix.capacity () + (*it)->destinationPrefix.capacity ();
+                        for (std::list<thekogans_make::FileList::File::Ptr>::const_iterator
+                                jt = (*it)->files.begin (),
+                                end = (*it)->files.end (); jt != end; ++jt) {
+                            const thekogans_make::FileList::File &file = **jt;
+                            size += NODE_SIZE + sizeof (thekogans_make::FileList::File) +
+                                file.name.capacity () +
+                                file.precompiled_header.file.capacity () +
+                                file.precompiled_header.outputFile.capacity ();
+                            if (file.customBuild.get () != 0) {
+                                size += sizeof (thekogans_make::FileList::File::CustomBuild) +
+                                    GetStringsSize (file.customBuild->outputs) +
+                                    GetStringsSize (file.customBuild->dependencies) +
+                                    file.customBuild->message.capacity () +
+                                    file.customBuild->recipe.capacity ();
+                            }
+                        }
+                    }
+                    return size;
+                }
+            }
+
+            std::size_t thekogans_make::GetSize () const {
+                std::size_t size = sizeof (thekogans_make) +
+                    project_root.capacity () +
+                    config_file.capacity () +
+                    generator.capacity () +
+                    config.capacity () +
+                    type.capacity () +
+                    organization.capacity () +
+                    project.capacity () +
+                    project_type.capacity () +
+                    major_version.capacity () +
+                    minor_version.capacity () +
+                    patch_version.capacity () +
+                    naming_convention.capacity () +
+                    build_config.capacity () +
+                    build_type.capacity () +
+                    schema_version.capacity () +
+                    goal.capacity () +
+                    GetStringsSize (features) +
+                    // Dependency objects are small; they reload their
+                    // configs through GetConfig rather than owning them.
+                    (plugin_hosts.size () + dependencies.size ()) *
+                        (NODE_SIZE + sizeof (ProjectDependency)) +
+                    GetStringsSize (closure.features) +
+                    GetStringsSize (closure.include_directories) +
+                    GetStringsSize (closure.link_libraries) +
+                    GetStringsSize (closure.shared_libraries) +
+                    GetStringMapSize (closure.config_files) +
+                    precompiled_header.file.capacity () +
+                    precompiled_header.outputFile.capacity ();
+                for (std::list<IncludeDirectories::Ptr>::const_iterator
+                        it = include_directories.begin (),
+                        end = include_directories.end (); it != end; ++it) {
+                    size += NODE_SIZE + sizeof (IncludeDirectories) +
+                        (*it)->prefix.capacity () + GetStringsSize ((*it)->paths);
+                }
+                for (std::list<LinkLibraries::Ptr>::const_iterator
+                        it = link_libraries.begin (),
+                        end = link_libraries.end (); it != end; ++it) {
+                    size += NODE_SIZE + sizeof (LinkLibraries) +
+                        (*it)->prefix.capacity () + GetStringsSize ((*it)->files);
+                }
+                const std::list<std::string> *flags[] = {
+                    &preprocessor_definitions,
+                    &linker_flags,
+                    &librarian_flags,
+                    &masm_flags,
+                    &masm_preprocessor_definitions,
+                    &nasm_flags,
+                    &nasm_preprocessor_definitions,
+                    &c_flags,
+                    &c_preprocessor_definitions,
+                    &cpp_flags,
+                    &cpp_preprocessor_definitions,
+                    &objective_c_flags,
+                    &objective_c_preprocessor_definitions,
+                    &objective_cpp_flags,
+                    &objective_cpp_preprocessor_definitions,
+                    &rc_flags,
+                    &rc_preprocessor_definitions,
+                    &bundle.resources,
+                    &bundle.frameworks,
+                    &bundle.plugins,
+                    &bundle.shared_supports
+                };
+                for (std::size_t i = 0, count = sizeof (flags) / sizeof (flags[0]); i < count; ++i) {
+                    size += GetStringsSize (*flags[i]);
+                }
+                const std::list<FileList::Ptr> *fileLists[] = {
+                    &masm_headers,
+                    &masm_sources,
+                    &masm_tests,
+                    &nasm_headers,
+                    &nasm_sources,
+                    &nasm_tests,
+                    &c_headers,
+                    &c_sources,
+                    &c_tests,
+                    &cpp_headers,
+                    &cpp_sources,
+                    &cpp_tests,
+                    &objective_c_headers,
+                    &objective_c_sources,
+                    &objective_c_tests,
+                    &objective_cpp_headers,
+                    &objective_cpp_sources,
+                    &objective_cpp_tests,
+                    &resources,
+                    &rc_sources
+                };
+                for (std::size_t i = 0, count = sizeof (fileLists) / sizeof (fileLists[0]); i < count; ++i) {
+                    size += GetFileListsSize (*fileLists[i]);
+                }
+                return size +
+                    subsystem.capacity () +
+                    def_file.capacity () +
+                    bundle.info_plist.capacity () +
+                    GetSymbolTableSize (globalSymbolTable) +
+                    GetSymbolTableSize (localSymbolTable);
             }
 
             void thekogans_make::CheckDependencies () const {
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("dependencies", MakePath (project_root, config_file));
                 std::cout << "Checking dependencies for " <<
                     MakePath (project_root, config_file) << std::endl;
                 std::cout.flush ();
@@ -1485,6 +2214,16 @@ namespace thekogans {
                         end = dependencies.end (); it != end; ++it) {
                     (*it)->CollectVersions (versions);
                 }
+                // Record the pinned libraries before SetMinVersion
+                // consults any closures.
+                std::set<std::string> &pinnedLibraries = GetPinnedLibraries ();
+                for (Dependency::Versions::const_iterator
+                        it = versions.begin (),
+                        end = versions.end (); it != end; ++it) {
+                    if (it->second.size () > 1) {
+                        pinnedLibraries.insert (it->first);
+                    }
+                }
                 std::set<std::string> visitedDependencies;
                 for (std::list<Dependency::Ptr>::const_iterator
                         it = dependencies.begin (),
@@ -1494,6 +2233,7 @@ namespace thekogans {
             }
 
             void thekogans_make::ListDependencies (util::ui32 indentationLevel) const {
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("dependencies", MakePath (project_root, config_file));
                 std::cout <<
                     std::string (indentationLevel * 2, ' ') <<
                     MakePath (project_root, config_file) << std::endl;
@@ -1510,6 +2250,7 @@ namespace thekogans {
             }
 
             void thekogans_make::GetFeatures (std::set<std::string> &features_) const {
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("closure", "features " + MakePath (project_root, config_file));
                 for (std::set<std::string>::const_iterator
                         it = features.begin (),
                         end = features.end (); it != end; ++it) {
@@ -1528,6 +2269,7 @@ namespace thekogans {
 
             void thekogans_make::GetIncludeDirectories (
                     std::set<std::string> &include_directories_) const {
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("closure", "include_directories " + MakePath (project_root, config_file));
                 for (std::list<IncludeDirectories::Ptr>::const_iterator
                         it = include_directories.begin (),
                         end = include_directories.end (); it != end; ++it) {
@@ -1559,18 +2301,19 @@ namespace thekogans {
 
             void thekogans_make::GetLinkLibraries (
                     std::list<std::string> &link_libraries_) const {
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("closure", "link_libraries " + MakePath (project_root, config_file));
                 std::list<std::string> link_libraries;
                 for (std::list<Dependency::Ptr>::const_iterator
                         it = dependencies.begin (),
                         end = dependencies.end (); it != end; ++it) {
                     (*it)->GetLinkLibraries (link_libraries);
                 }
-                std::set<std::string> visited_link_libraries;
+                // Keep the last occurrence of each library.
+                std::unordered_set<std::string> visited_link_libraries;
                 for (std::list<std::string>::const_reverse_iterator
                         it = link_libraries.rbegin (),
                         end = link_libraries.rend (); it != end; ++it) {
-                    if (visited_link_libraries.find (*it) == visited_link_libraries.end ()) {
-                        visited_link_libraries.insert (*it);
+                    if (visited_link_libraries.insert (*it).second) {
                         link_libraries_.push_front (*it);
                     }
                 }
@@ -1578,6 +2321,7 @@ namespace thekogans {
 
             void thekogans_make::GetSharedLibraries (
                     std::set<std::string> &shared_libraries) const {
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("closure", "shared_libraries " + MakePath (project_root, config_file));
                 for (std::list<Dependency::Ptr>::const_iterator
                         it = dependencies.begin (),
                         end = dependencies.end (); it != end; ++it) {
@@ -1585,8 +2329,158 @@ namespace thekogans {
                 }
             }
 
+            std::string thekogans_make::Closure::ToString (
+                    util::ui32 indentationLevel,
+                    const std::string &config,
+                    const std::string &type) const {
+                std::stringstream stream;
+                util::Attributes attributes;
+                attributes.push_back (util::Attribute (ATTR_CONFIG, config));
+                attributes.push_back (util::Attribute (ATTR_TYPE, type));
+                stream << util::OpenTag (indentationLevel, TAG_CLOSURE, attributes, false, true);
+                for (std::set<std::string>::const_iterator
+                        it = features.begin (),
+                        end = features.end (); it != end; ++it) {
+                    stream <<
+                        util::OpenTag (indentationLevel + 1, TAG_FEATURE) <<
+                        util::EncodeXMLCharEntities (*it) <<
+                        util::CloseTag (0, TAG_FEATURE);
+                }
+                for (std::set<std::string>::const_iterator
+                        it = include_directories.begin (),
+                        end = include_directories.end (); it != end; ++it) {
+                    stream <<
+                        util::OpenTag (indentationLevel + 1, TAG_INCLUDE_DIRECTORY) <<
+                        util::EncodeXMLCharEntities (*it) <<
+                        util::CloseTag (0, TAG_INCLUDE_DIRECTORY);
+                }
+                for (std::list<std::string>::const_iterator
+                        it = link_libraries.begin (),
+                        end = link_libraries.end (); it != end; ++it) {
+                    stream <<
+                        util::OpenTag (indentationLevel + 1, TAG_LINK_LIBRARY) <<
+                        util::EncodeXMLCharEntities (*it) <<
+                        util::CloseTag (0, TAG_LINK_LIBRARY);
+                }
+                for (std::set<std::string>::const_iterator
+                        it = shared_libraries.begin (),
+                        end = shared_libraries.end (); it != end; ++it) {
+                    stream <<
+                        util::OpenTag (indentationLevel + 1, TAG_SHARED_LIBRARY) <<
+                        util::EncodeXMLCharEntities (*it) <<
+                        util::CloseTag (0, TAG_SHARED_LIBRARY);
+                }
+                for (Dependency::Versions::const_iterator
+                        it = versions.begin (),
+                        end = versions.end (); it != end; ++it) {
+                    for (Dependency::VersionSet::const_iterator
+                            jt = it->second.begin (),
+                            jend = it->second.end (); jt != jend; ++jt) {
+                        util::Attributes attributes;
+                        attributes.push_back (
+                            util::Attribute (ATTR_NAME, util::EncodeXMLCharEntities (it->first)));
+                        attributes.push_back (
+                            util::Attribute (ATTR_VERSION, util::EncodeXMLCharEntities (jt->first)));
+                        if (!jt->second.empty ()) {
+                            attributes.push_back (
+                                util::Attribute (ATTR_BRANCH, util::EncodeXMLCharEntities (jt->second)));
+                        }
+                        stream << util::OpenTag (indentationLevel + 1, TAG_DEPENDENCY_VERSION, attributes, true, true);
+                    }
+                }
+                for (std::map<std::string, std::string>::const_iterator
+                        it = config_files.begin (),
+                        end = config_files.end (); it != end; ++it) {
+                    util::Attributes attributes;
+                    attributes.push_back (
+                        util::Attribute (ATTR_PATH, util::EncodeXMLCharEntities (it->first)));
+                    attributes.push_back (util::Attribute (ATTR_SHA2_256, it->second));
+                    stream << util::OpenTag (indentationLevel + 1, TAG_CONFIG_FILE, attributes, true, true);
+                }
+                stream << util::CloseTag (indentationLevel, TAG_CLOSURE);
+                return stream.str ();
+            }
+
+            void thekogans_make::GetToolchainClosure (Closure &closure) const {
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("closure", "toolchain " + MakePath (project_root, config_file));
+                closure = Closure ();
+                if (project_type != PROJECT_TYPE_LIBRARY) {
+                    return;
+                }
+                // Our own contribution, as a ToolchainDependency
+                // on the installed library would compute it.
+                closure.features = features;
+                std::string include_directory = GetToolchainIncludeDirectory ();
+                if (util::Path (ToSystemPath (include_directory)).Exists ()) {
+                    closure.include_directories.insert (include_directory);
+                }
+                std::list<std::string> link_libraries;
+                std::string link_library = GetToolchainLinkLibrary ();
+                if (util::Path (ToSystemPath (link_library)).Exists ()) {
+                    link_libraries.push_back (link_library);
+                }
+                if (type == TYPE_SHARED) {
+                    std::string shared_library = GetToolchainGoal ();
+                    if (util::Path (ToSystemPath (shared_library)).Exists ()) {
+                        closure.shared_libraries.insert (shared_library);
+                    }
+                }
+                for (std::list<Dependency::Ptr>::const_iterator
+                        it = dependencies.begin (),
+                        end = dependencies.end (); it != end; ++it) {
+                    // Project dependencies are installed as toolchain dependencies.
+                    Dependency::Ptr installedDependency;
+                    const ProjectDependency *projectDependency =
+                        dynamic_cast<const ProjectDependency *> ((*it).get ());
+                    if (projectDependency != 0) {
+                        installedDependency.reset (
+                            new ToolchainDependency (
+                                projectDependency->organization,
+                                projectDependency->name,
+                                projectDependency->version.empty () ?
+                                    GetConfig (
+                                        projectDependency->GetProjectRoot (),
+                                        projectDependency->GetConfigFile (),
+                                        projectDependency->GetGenerator (),
+                                        projectDependency->GetConfig (),
+                                        projectDependency->GetType ()).GetVersion () :
+                                    projectDependency->version,
+                                projectDependency->config,
+                                projectDependency->type,
+                                projectDependency->features,
+                                *this));
+                    }
+                    const Dependency &dependency =
+                        installedDependency.get () != 0 ? *installedDependency : **it;
+                    dependency.GetFeatures (closure.features);
+                    dependency.GetIncludeDirectories (closure.include_directories);
+                    if (type == TYPE_STATIC) {
+                        dependency.GetLinkLibraries (link_libraries);
+                    }
+                    dependency.GetSharedLibraries (closure.shared_libraries);
+                    dependency.CollectVersions (closure.versions);
+                    const ToolchainDependency *toolchainDependency =
+                        dynamic_cast<const ToolchainDependency *> (&dependency);
+                    if (toolchainDependency != 0) {
+                        toolchainDependency->GetConfigFiles (closure.config_files);
+                    }
+                }
+                // Only the last occurrence of a library matters to GetLinkLibraries.
+                std::unordered_set<std::string> visited_link_libraries;
+                for (std::list<std::string>::const_reverse_iterator
+                        it = link_libraries.rbegin (),
+                        end = link_libraries.rend (); it != end; ++it) {
+                    if (visited_link_libraries.insert (*it).second) {
+                        closure.link_libraries.push_front (*it);
+                    }
+                }
+                closure.present = true;
+            }
+
             bool thekogans_make::Eval (const char *expression) const {
+                Counters::Increment (Counters::EVAL_CALLS);
                 if (expression != 0) {
+                    THEKOGANS_MAKE_CORE_PROFILE_EXPRESSION ("eval", expression);
                     THEKOGANS_UTIL_TRY {
                         Tokenizer tokenizer (expression, *this);
                         Parser parser (tokenizer);
@@ -1618,6 +2512,7 @@ namespace thekogans {
                 if (it != EnvironmentSymbolTable::Instance ()->end ()) {
                     return it->second;
                 }
+                Counters::Increment (Counters::ENVIRONMENT_LOOKUPS);
                 std::string environmentVariable =
                     util::GetEnvironmentVariable (symbol.c_str ());
                 if (!environmentVariable.empty ()) {
@@ -1627,6 +2522,8 @@ namespace thekogans {
             }
 
             std::string thekogans_make::Expand (const char *format) const {
+                Counters::Increment (Counters::EXPAND_CALLS);
+                THEKOGANS_MAKE_CORE_PROFILE_EXPRESSION ("expand", format);
                 std::string expanded;
                 std::size_t formatLength = strlen (format);
                 util::TenantReadBuffer buffer (util::HostEndian, format, formatLength);
@@ -1876,6 +2773,8 @@ namespace thekogans {
 
             void thekogans_make::GetCommonPreprocessorDefinitions (
                     std::list<std::string> &preprocessorDefinitions) const {
+                THEKOGANS_MAKE_CORE_TRACE_SPAN ("closure",
+                    "preprocessor_definitions " + MakePath (project_root, config_file));
                 std::string ORGANIZATION = util::StringToUpper (SanitizeName (organization).c_str ());
                 std::string PROJECT = util::StringToUpper (SanitizeName (project).c_str ());
                 std::string PREFIX = ORGANIZATION + ORGANIZATION_PROJECT_SEPARATOR + PROJECT;
@@ -1918,11 +2817,13 @@ namespace thekogans {
                     PREFIX + "_CONFIG_" + Expand ("$(config)"));
                 preprocessorDefinitions.push_back (
                     PREFIX + "_TYPE_" + Expand ("$(type)"));
+                OrderedSet<std::string> dependencyPreprocessorDefinitions (preprocessorDefinitions);
                 for (std::list<Dependency::Ptr>::const_iterator
                         it = dependencies.begin (),
                         end = dependencies.end (); it != end; ++it) {
-                    (*it)->GetPreprocessorDefinitions (preprocessorDefinitions);
+                    (*it)->GetPreprocessorDefinitions (dependencyPreprocessorDefinitions);
                 }
+                dependencyPreprocessorDefinitions.Release (preprocessorDefinitions);
             }
 
             std::string thekogans_make::GetGoalFileName () const {
@@ -2065,6 +2966,7 @@ namespace thekogans {
                 for (pugi::xml_node child = root.first_child ();
                         !child.empty (); child = child.next_sibling ()) {
                     if (child.type () == pugi::node_element) {
+                        THEKOGANS_MAKE_CORE_PROFILE_ELEMENT (MakePath (project_root, config_file), child);
                         std::string childName = child.name ();
                         if (childName == TAG_GOAL) {
                             goal = Expand (util::TrimSpaces (child.text ().get ()).c_str ());
@@ -2088,6 +2990,9 @@ namespace thekogans {
                         else if (childName == TAG_DEPENDENCIES) {
                             Parsedependencies (child, dependencies);
                         }
+                        else if (childName == TAG_CLOSURE) {
+                            Parseclosure (child);
+                        }
                         else if (childName == TAG_PRECOMPILED_HEADER) {
                             Parseprecompiled_header (child, precompiled_header);
                         }
@@ -2389,6 +3294,72 @@ namespace thekogans {
                         }
                     }
                 }
+                if (closure.present && !IsClosureConsistent ()) {
+                    closure = Closure ();
+                }
+            }
+
+            void thekogans_make::Parseclosure (pugi::xml_node &node) {
+                // Closures are per variant. Skip the ones that aren't ours.
+                if (config != node.attribute (ATTR_CONFIG).value () ||
+                        type != node.attribute (ATTR_TYPE).value ()) {
+                    return;
+                }
+                closure = Closure ();
+                for (pugi::xml_node child = node.first_child ();
+                        !child.empty (); child = child.next_sibling ()) {
+                    if (child.type () == pugi::node_element) {
+                        std::string childName = child.name ();
+                        std::string value = util::Decodestring (util::TrimSpaces (child.text ().get ()));
+                        if (childName == TAG_FEATURE) {
+                            closure.features.insert (value);
+                        }
+                        else if (childName == TAG_INCLUDE_DIRECTORY) {
+                            closure.include_directories.insert (value);
+                        }
+                        else if (childName == TAG_LINK_LIBRARY) {
+                            closure.link_libraries.push_back (value);
+                        }
+                        else if (childName == TAG_SHARED_LIBRARY) {
+                            closure.shared_libraries.insert (value);
+                        }
+                        else if (childName == TAG_DEPENDENCY_VERSION) {
+                            closure.versions[util::Decodestring (child.attribute (ATTR_NAME).value ())].insert (
+                                Dependency::VersionAndBranch (
+                                    util::Decodestring (child.attribute (ATTR_VERSION).value ()),
+                                    util::Decodestring (child.attribute (ATTR_BRANCH).value ())));
+                        }
+                        else if (childName == TAG_CONFIG_FILE) {
+                            closure.config_files[util::Decodestring (child.attribute (ATTR_PATH).value ())] =
+                                child.attribute (ATTR_SHA2_256).value ();
+                        }
+                    }
+                }
+                closure.present = true;
+            }
+
+            bool thekogans_make::IsClosureConsistent () const {
+                std::vector<std::string> paths;
+                std::vector<std::string> SHA2_256s;
+                paths.reserve (closure.config_files.size ());
+                SHA2_256s.reserve (closure.config_files.size ());
+                for (std::map<std::string, std::string>::const_iterator
+                        it = closure.config_files.begin (),
+                        end = closure.config_files.end (); it != end; ++it) {
+                    // The closure stands in for these configs, so a change
+                    // to any of them must invalidate the one being loaded.
+                    AddConfigInput (it->first);
+                    if (!util::Path (it->first).Exists ()) {
+                        return false;
+                    }
+                    paths.push_back (it->first);
+                    SHA2_256s.push_back (it->second);
+                }
+                // A closure can list hundreds of config files. Hash
+                // the cache misses concurrently.
+                std::vector<std::string> hashes;
+                GetFileHashes (paths, hashes);
+                return hashes == SHA2_256s;
             }
 
             void thekogans_make::Parseconstants (pugi::xml_node &node) {
@@ -2679,6 +3650,7 @@ namespace thekogans {
                         std::list<std::string> &results) {
                     util::Directory directory (ToSystemPath (MakePath (prefix, branch)));
                     util::Directory::Entry entry;
+                    Counters::Increment (Counters::FILE_SYSTEM_READDIRS);
                     try {
                         std::regex regex (pattern, flags);
                         for (bool gotEntry = directory.GetFirstEntry (entry);
@@ -2724,6 +3696,7 @@ namespace thekogans {
                             }
                         }
                         else if (childName == TAG_REGEX) {
+                            THEKOGANS_MAKE_CORE_PROFILE_ELEMENT (MakePath (project_root, config_file), child);
                             std::regex::flag_type flags = ParseRegexFlags (
                                 Expand (child.attribute (ATTR_FLAGS).value ()));
                             std::list<std::string> components;
@@ -2979,6 +3952,7 @@ namespace thekogans {
             void thekogans_make::ParseDefault (
                     const pugi::xml_node &node,
                     pugi::xml_node &parent) {
+                THEKOGANS_MAKE_CORE_PROFILE_ELEMENT (MakePath (project_root, config_file), node);
                 std::string nodeName = node.name ();
                 if (nodeName == TAG_IF) {
                     Parseif (node, parent);
@@ -3088,6 +4062,13 @@ namespace thekogans {
                         configFileSize,
                         configFilePath.c_str ());
                 }
+                Counters::Increment (Counters::XML_BYTES_PARSED, configFileSize);
+                if (ToolchainProfiler::Instance ()->IsEnabled ()) {
+                    ToolchainProfiler::Instance ()->AddFile (
+                        MakePath (project_root, config_file),
+                        (const char *)buffer.GetReadPtr (),
+                        buffer.GetDataAvailableForReading ());
+                }
                 pugi::xml_parse_result result =
                     document.load_buffer (
                         buffer.GetReadPtr (),